@@ -4,6 +4,8 @@
 #include <aes.h>
 #include <filters.h>
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include <immintrin.h>	// _rdrand32_step
 
@@ -24,7 +26,7 @@ AESWrapper::AESWrapper(const unsigned char* key, unsigned int length)
 {
 	if (length != DEFAULT_KEYLENGTH)
 		throw std::length_error("key length must be 16 bytes");
-	memcpy_s(_key, DEFAULT_KEYLENGTH, key, length);
+	memcpy(_key, key, length);
 }
 
 AESWrapper::~AESWrapper()
@@ -66,3 +68,183 @@ std::string AESWrapper::decrypt(const char* cipher, unsigned int length)
 
 	return decrypted;
 }
+
+
+
+size_t AESStreamEncryptor::encryptedSize(size_t length)
+{
+	// PKCS padding always adds between 1 and BLOCKSIZE bytes
+	return (length / BLOCKSIZE + 1) * BLOCKSIZE;
+}
+
+AESStreamEncryptor::AESStreamEncryptor(const unsigned char* key, unsigned int length)
+{
+	if (length != AESWrapper::DEFAULT_KEYLENGTH)
+		throw std::length_error("key length must be 16 bytes");
+	memcpy(_key, key, length);
+	restart();
+}
+
+void AESStreamEncryptor::restart()
+{
+	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };	// same fixed iv as AESWrapper
+	_cbc.SetKeyWithIV(_key, AESWrapper::DEFAULT_KEYLENGTH, iv);
+}
+
+void AESStreamEncryptor::update(unsigned char* data, size_t length)
+{
+	if (length % BLOCKSIZE != 0)
+		throw std::length_error("length must be a multiple of the block size");
+	_cbc.ProcessData(data, data, length);
+}
+
+size_t AESStreamEncryptor::final(unsigned char* data, size_t length)
+{
+	// PKCS #7 padding, as StreamTransformationFilter does by default
+	size_t padded_length = encryptedSize(length);
+	unsigned char padding = static_cast<unsigned char>(padded_length - length);
+	memset(data + length, padding, padding);
+
+	_cbc.ProcessData(data, data, padded_length);
+	return padded_length;
+}
+
+
+
+AESStreamDecryptor::AESStreamDecryptor(const unsigned char* key, unsigned int length)
+{
+	if (length != AESWrapper::DEFAULT_KEYLENGTH)
+		throw std::length_error("key length must be 16 bytes");
+	memcpy(_key, key, length);
+	restart();
+}
+
+void AESStreamDecryptor::restart()
+{
+	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };	// same fixed iv as AESWrapper
+	_cbc.SetKeyWithIV(_key, AESWrapper::DEFAULT_KEYLENGTH, iv);
+	_partialSize = 0;
+	_hasHeld = false;
+}
+
+size_t AESStreamDecryptor::update(const unsigned char* cipher, size_t length, unsigned char* out)
+{
+	size_t written = 0;
+
+	while (length > 0)
+	{
+		// Block aligned run - decrypt it straight into the output, after the block held back so far
+		if (_partialSize == 0 && length >= BLOCKSIZE)
+		{
+			size_t run = length - length % BLOCKSIZE;
+			if (_hasHeld) {
+				memcpy(out + written, _held, BLOCKSIZE);
+				written += BLOCKSIZE;
+			}
+
+			// Hold back the last block of the run - it is decrypted straight into _held, so nothing
+			// is written to out past the plaintext returned
+			if (run > BLOCKSIZE) {
+				_cbc.ProcessData(out + written, cipher, run - BLOCKSIZE);
+				written += run - BLOCKSIZE;
+			}
+			_cbc.ProcessData(_held, cipher + run - BLOCKSIZE, BLOCKSIZE);
+			_hasHeld = true;
+			cipher += run;
+			length -= run;
+			continue;
+		}
+
+		// Collect an incomplete block
+		size_t take = std::min<size_t>(BLOCKSIZE - _partialSize, length);
+		memcpy(_partial + _partialSize, cipher, take);
+		_partialSize += take;
+		cipher += take;
+		length -= take;
+
+		if (_partialSize == BLOCKSIZE)
+		{
+			if (_hasHeld) {
+				memcpy(out + written, _held, BLOCKSIZE);
+				written += BLOCKSIZE;
+			}
+			_cbc.ProcessData(_held, _partial, BLOCKSIZE);
+			_hasHeld = true;
+			_partialSize = 0;
+		}
+	}
+
+	return written;
+}
+
+size_t AESStreamDecryptor::final(unsigned char* out)
+{
+	if (_partialSize != 0 || !_hasHeld)
+		throw std::invalid_argument("ciphertext length is not a multiple of the block size");
+
+	// Check and strip the PKCS #7 padding
+	unsigned char padding = _held[BLOCKSIZE - 1];
+	if (padding == 0 || padding > BLOCKSIZE)
+		throw std::invalid_argument("invalid padding");
+	for (size_t i = BLOCKSIZE - padding; i < BLOCKSIZE; i++) {
+		if (_held[i] != padding)
+			throw std::invalid_argument("invalid padding");
+	}
+
+	size_t remaining = BLOCKSIZE - padding;
+	memcpy(out, _held, remaining);
+	_hasHeld = false;
+	return remaining;
+}
+
+
+
+AESSessionCipher::AESSessionCipher(const unsigned char* key, unsigned int length)
+{
+	if (length != AESWrapper::DEFAULT_KEYLENGTH)
+		throw std::length_error("key length must be 16 bytes");
+
+	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };	// same fixed iv as AESWrapper
+	_encryption.SetKeyWithIV(key, length, iv);
+	_decryption.SetKeyWithIV(key, length, iv);
+}
+
+size_t AESSessionCipher::encrypt(const unsigned char* plain, size_t length, unsigned char* out)
+{
+	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };
+	_encryption.Resynchronize(iv);
+
+	// Whole blocks straight from the input, then the last one with the PKCS #7 padding
+	size_t aligned_length = length - length % BLOCKSIZE;
+	if (aligned_length > 0)
+		_encryption.ProcessData(out, plain, aligned_length);
+
+	unsigned char last[BLOCKSIZE];
+	size_t remaining = length - aligned_length;
+	unsigned char padding = static_cast<unsigned char>(BLOCKSIZE - remaining);
+	memcpy(last, plain + aligned_length, remaining);
+	memset(last + remaining, padding, padding);
+	_encryption.ProcessData(out + aligned_length, last, BLOCKSIZE);
+
+	return aligned_length + BLOCKSIZE;
+}
+
+size_t AESSessionCipher::decrypt(const unsigned char* cipher, size_t length, unsigned char* out)
+{
+	if (length == 0 || length % BLOCKSIZE != 0)
+		throw std::invalid_argument("ciphertext length is not a multiple of the block size");
+
+	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };
+	_decryption.Resynchronize(iv);
+	_decryption.ProcessData(out, cipher, length);
+
+	// Check and strip the PKCS #7 padding
+	unsigned char padding = out[length - 1];
+	if (padding == 0 || padding > BLOCKSIZE)
+		throw std::invalid_argument("invalid padding");
+	for (size_t i = length - padding; i < length; i++) {
+		if (out[i] != padding)
+			throw std::invalid_argument("invalid padding");
+	}
+	return length - padding;
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <modes.h>
+#include <aes.h>
+
+#include <cstddef>
 #include <string>
 
 
@@ -21,4 +25,86 @@ public:
 
 	std::string encrypt(const char* plain, unsigned int length);
 	std::string decrypt(const char* cipher, unsigned int length);
-};
\ No newline at end of file
+};
+
+
+// Incremental AES-CBC encryption - the concatenated output of update() and final()
+// is the same as AESWrapper::encrypt of the whole plaintext
+class AESStreamEncryptor
+{
+public:
+	static const unsigned int BLOCKSIZE = CryptoPP::AES::BLOCKSIZE;
+private:
+	unsigned char _key[AESWrapper::DEFAULT_KEYLENGTH];
+	CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption _cbc;
+	AESStreamEncryptor(const AESStreamEncryptor& aes);
+public:
+	// Size of the ciphertext for a plaintext of the given size, including the padding
+	static size_t encryptedSize(size_t length);
+
+	AESStreamEncryptor(const unsigned char* key, unsigned int size);
+
+	// Start over with a new message
+	void restart();
+
+	// Encrypt the next part of the plaintext in place, length must be a multiple of BLOCKSIZE
+	void update(unsigned char* data, size_t length);
+
+	// Encrypt the last part of the plaintext in place and pad it.
+	// data must have room for encryptedSize(length) bytes, returns the ciphertext length
+	size_t final(unsigned char* data, size_t length);
+};
+
+
+// Incremental AES-CBC decryption of a message encrypted by AESWrapper::encrypt or AESStreamEncryptor.
+// The last block is held back until final() so the padding can be removed
+class AESStreamDecryptor
+{
+public:
+	static const unsigned int BLOCKSIZE = CryptoPP::AES::BLOCKSIZE;
+private:
+	unsigned char _key[AESWrapper::DEFAULT_KEYLENGTH];
+	CryptoPP::CBC_Mode<CryptoPP::AES>::Decryption _cbc;
+	unsigned char _partial[BLOCKSIZE];	// ciphertext of an incomplete block
+	size_t _partialSize;
+	unsigned char _held[BLOCKSIZE];	// last decrypted block - may hold the padding
+	bool _hasHeld;
+	AESStreamDecryptor(const AESStreamDecryptor& aes);
+public:
+	AESStreamDecryptor(const unsigned char* key, unsigned int size);
+
+	// Start over with a new message
+	void restart();
+
+	// Decrypt the next part of the ciphertext into out, which must have room for length + BLOCKSIZE bytes.
+	// Returns the number of plaintext bytes written
+	size_t update(const unsigned char* cipher, size_t length, unsigned char* out);
+
+	// Finish the message and write the rest of the plaintext without the padding (less than BLOCKSIZE bytes).
+	// Throws std::invalid_argument if the ciphertext is truncated or its padding is wrong
+	size_t final(unsigned char* out);
+};
+
+
+// Long lived AES-CBC cipher of one peer's session key. The key schedules are expanded once
+// and every message only resets the IV, so short messages don't pay for the setup.
+// Output is byte for byte the same as AESWrapper::encrypt / decrypt
+class AESSessionCipher
+{
+public:
+	static const unsigned int BLOCKSIZE = CryptoPP::AES::BLOCKSIZE;
+private:
+	CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption _encryption;
+	CryptoPP::CBC_Mode<CryptoPP::AES>::Decryption _decryption;
+	AESSessionCipher(const AESSessionCipher& aes);
+public:
+	AESSessionCipher(const unsigned char* key, unsigned int size);
+
+	// Encrypt and pad a whole message. out must have room for AESStreamEncryptor::encryptedSize(length) bytes.
+	// Returns the ciphertext length
+	size_t encrypt(const unsigned char* plain, size_t length, unsigned char* out);
+
+	// Decrypt a whole message and remove the padding. out must have room for length bytes.
+	// Returns the plaintext length, throws std::invalid_argument if the ciphertext length or padding is wrong
+	size_t decrypt(const unsigned char* cipher, size_t length, unsigned char* out);
+};
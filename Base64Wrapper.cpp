@@ -1,26 +1,23 @@
 #include "Base64Wrapper.h"
+#include "TextCodec.h"
 
 
 std::string Base64Wrapper::encode(const std::string& str)
 {
-	std::string encoded;
-	CryptoPP::StringSource ss(str, true,
-		new CryptoPP::Base64Encoder(
-			new CryptoPP::StringSink(encoded)
-		) // Base64Encoder
-	); // StringSource
+	std::string encoded(Base64Codec::encoded_size(str.size()), '\0');
+	Base64Codec::encode(reinterpret_cast<const uint8_t*>(str.data()), str.size(), &encoded[0]);
 
 	return encoded;
 }
 
 std::string Base64Wrapper::decode(const std::string& str)
 {
-	std::string decoded;
-	CryptoPP::StringSource ss(str, true,
-		new CryptoPP::Base64Decoder(
-			new CryptoPP::StringSink(decoded)
-		) // Base64Decoder
-	); // StringSource
+	std::string decoded(Base64Codec::max_decoded_size(str.size()), '\0');
+	size_t decoded_size = 0;
+	if (!Base64Codec::decode(str.data(), str.size(), reinterpret_cast<uint8_t*>(&decoded[0]), decoded_size)) {
+		return std::string();
+	}
+	decoded.resize(decoded_size);
 
 	return decoded;
 }
@@ -1,12 +1,14 @@
 #pragma once
 
 #include <string>
-#include <base64.h>
 
 
+// std::string front end of Base64Codec
 class Base64Wrapper
 {
 public:
 	static std::string encode(const std::string& str);
+
+	// Whitespace is skipped, returns an empty string if str is not base64
 	static std::string decode(const std::string& str);
 };
@@ -11,37 +11,42 @@ void ConsoleApp::register_client()
 
     ServerRequestHeader request_header{};
     ServerResponseHeader response_header{};
-    std::vector<uint8_t> c_payload;
 
     RegistrationPayload r_payload;
     request_header.version = CLIENT_VERSION;
     request_header.code = ServerRequestCodes::REGISTRATION_CLIENT_REQUEST;
     request_header.payload_size = sizeof(RegistrationPayload);
 
-    // Create an RSA decryptor. this is done here to generate a new private/public key pair
-    RSAPrivateWrapper rsapriv;
-
-    // Generate public key
-    rsapriv.getPublicKey(r_payload.public_key, RSAPublicWrapper::KEYSIZE);
-
-    // Save the private key base64
-    base64_private_key = Base64Wrapper::encode(rsapriv.getPrivateKey());
+    // The key pair is generated in the background since startup - start now if it wasn't
+    if (!key_pool) {
+        start_key_generation();
+    }
 
     // Get username from client
     std::cout << "Please enter registration user name:" << std::endl;
     std::cin.getline(r_payload.name, MAX_REGISTRATION_NAME_LENGTH - 1); // Don't let user to overlap null terminated char
 
-    // fill payload into vector
-    c_payload.assign((uint8_t*)&r_payload, (uint8_t*)&r_payload + sizeof(RegistrationPayload));
+    // Take the key pair - this only waits if it is still being generated
+    uint64_t crypto_start = RequestMetrics::start(&request_metrics);
+    RSAKeyPair key_pair = key_pool->take();
+    memcpy(r_payload.public_key, key_pair.public_key, RSAPublicWrapper::KEYSIZE);
+
+    // Keep the private key parsed for decrypting key deliveries - it is saved once the server accepts us
+    const std::string& private_key = key_pair.private_key;
+    private_key_decryptor = std::make_unique<RSAPrivateDecryptor>(private_key);
+    RequestMetrics::finish(&request_metrics, request_header.code, RequestPhase::CRYPTO, crypto_start);
 
-    // Send registration request to server
-    if (winsock_client.send_request(request_header, c_payload, response_header, client_id) && response_header.code == ServerResponseCodes::REGISTRATION_SUCCESS)
+    // Send registration request to server - the payload struct is sent in place
+    if (transport->send_request(request_header, { { &r_payload, sizeof(RegistrationPayload) } }, response_header, client_id) && response_header.code == ServerResponseCodes::REGISTRATION_SUCCESS)
     {
         std::cout << "Registering with username " << r_payload.name << " ..." << std::endl;
 
-        // Save username and uuid in me.info
-        if (create_me_info_file(r_payload.name, &client_id[0]))
+        // Save username, uuid and private key in me.info, and the binary identity loaded on startup
+        if (create_me_info_file(r_payload.name, &client_id[0], private_key))
         {
+            if (!identity.save(r_payload.name, &client_id[0], private_key, ME_INFO_PATH)) {
+                std::cerr << "Warning: failed to save " << IDENTITY_PATH << std::endl;
+            }
             std::cout << "Registeration done." << std::endl;
         }
         else
@@ -53,6 +58,11 @@ void ConsoleApp::register_client()
     {
         std::cerr << "Registration Failed: server responded with an error" << std::endl;
     }
+
+    // The pool only made the pair that was just taken - prepare another one if we may try again
+    if (!is_registered()) {
+        start_key_generation();
+    }
 }
 
 void ConsoleApp::request_for_client_list()
@@ -62,46 +72,141 @@ void ConsoleApp::request_for_client_list()
         return;
     }
 
+    // Only the clients added since the cached directory are fetched if the server supports it
+    bool succeeded;
+    if (client_list_delta_supported) {
+        succeeded = request_for_client_list_delta();
+
+        // The server turned the delta down - get the full list instead
+        if (!succeeded && !client_list_delta_supported) {
+            succeeded = request_for_full_client_list();
+        }
+    }
+    else {
+        succeeded = request_for_full_client_list();
+    }
+
+    if (succeeded)
+    {
+        std::cout << "There are " << contacts.size() << " in our list:" << std::endl;
+        for (size_t i = 0; i < contacts.size(); i++) {
+            std::cout << contacts.get_name(contacts.at(i)) << '\n';
+        }
+        std::cout << std::flush;
+    }
+    else
+    {
+        std::cerr << "Request for client list failed: server responded with an error" << std::endl;
+    }
+}
+
+bool ConsoleApp::request_for_client_list_delta()
+{
+    ServerRequestHeader request_header{};
+    ServerResponseHeader response_header{};
+    ClientListDeltaRequestPayload c_payload{};
+    std::vector<uint8_t> s_payload;
+
+    // Initialize request header
+    memcpy(request_header.client_id, &client_id[0], CLIENT_ID_LENGTH);
+    request_header.version = CLIENT_VERSION;
+    request_header.code = ServerRequestCodes::CLIENT_LIST_DELTA_REQUEST;
+    request_header.payload_size = sizeof(ClientListDeltaRequestPayload);
+
+    // Tell the server which directory we have
+    c_payload.directory_id = contact_cache.get_directory_id();
+    c_payload.cursor = contact_cache.get_cursor();
+
+    // Servers without delta support drop the connection or answer with a general failure - use the
+    // full list from now on. Any other failure only fails this refresh
+    bool sent = transport->send_request(request_header, { { &c_payload, sizeof(c_payload) } }, response_header, s_payload);
+    if ((!sent && transport->get_last_outcome() == RequestOutcome::REJECTED) ||
+        (sent && response_header.code == ServerResponseCodes::GENERAL_FAILURE))
+    {
+        client_list_delta_supported = false;
+        return false;
+    }
+    if (!sent || response_header.code != ServerResponseCodes::CLIENT_LIST_DELTA_RESPONSE) return false;
+
+    // The delta header, then the entries viewed in the payload
+    ProtocolCodec::Reader reader(s_payload.data(), s_payload.size());
+    ProtocolCodec::ClientListDeltaResponseHeaderView delta_header;
+    ProtocolCodec::ClientListEntries entries;
+    if (!reader.read(delta_header) || !ProtocolCodec::ClientListEntries::parse(reader.position(), reader.remaining(), entries)) {
+        return false;
+    }
+
+    add_client_list_entries(entries, delta_header.full_list());
+
+    // Keep the cache in step with the server directory
+    bool cached = delta_header.full_list() ?
+        contact_cache.rewrite(delta_header.directory_id(), delta_header.cursor(), entries) :
+        contact_cache.append(delta_header.cursor(), entries);
+    if (!cached) {
+        std::cerr << "Warning: failed to update " << CONTACTS_CACHE_PATH << std::endl;
+    }
+    return true;
+}
+
+bool ConsoleApp::request_for_full_client_list()
+{
     ServerRequestHeader request_header{};
     ServerResponseHeader response_header{};
     std::vector<uint8_t> c_payload;
     std::vector<uint8_t> s_payload;
 
     // Initialize request header
-    memcpy_s(request_header.client_id, CLIENT_ID_LENGTH, &client_id[0], client_id.size());
+    memcpy(request_header.client_id, &client_id[0], CLIENT_ID_LENGTH);
     request_header.version = CLIENT_VERSION;
     request_header.code = ServerRequestCodes::CLIENT_LIST_REQUEST;
     request_header.payload_size = 0;
 
-    if (winsock_client.send_request(request_header, c_payload, response_header, s_payload) && response_header.code == ServerResponseCodes::CLIENT_LIST_RESPONSE)
+    if (!transport->send_request(request_header, c_payload, response_header, s_payload) || response_header.code != ServerResponseCodes::CLIENT_LIST_RESPONSE) {
+        return false;
+    }
+    assert(response_header.payload_size == s_payload.size());
+
+    ProtocolCodec::ClientListEntries entries;
+    if (!ProtocolCodec::ClientListEntries::parse(s_payload.data(), s_payload.size(), entries)) return false;
+    add_client_list_entries(entries, true);
+
+    // Without a cursor the next refresh will fetch everything again, the cache still saves the cold start
+    if (!contact_cache.rewrite(0, 0, entries)) {
+        std::cerr << "Warning: failed to update " << CONTACTS_CACHE_PATH << std::endl;
+    }
+    return true;
+}
+
+void ConsoleApp::add_client_list_entries(const ProtocolCodec::ClientListEntries& entries, bool full_list)
+{
+    if (full_list)
     {
-        assert(response_header.payload_size == s_payload.size());
-        uint32_t num_of_clients = response_header.payload_size / (CLIENT_ID_LENGTH + MAX_REGISTRATION_NAME_LENGTH);
-        std::cout << "There are " << num_of_clients << " in our list:" << std::endl;
-        for (uint32_t i = 0; i < num_of_clients; i++)
+        // The server directory may have been replaced - clients it lost are dropped, and a name that
+        // came back with a new UUID is a new client. Only contacts known by the same UUID keep their keys
+        ContactDirectory directory;
+        directory.reserve(entries.size());
+        for (size_t i = 0; i < entries.size(); i++)
         {
-            // calculate client index in the returned payload
-            uint32_t current_client_index = i * (CLIENT_ID_LENGTH + MAX_REGISTRATION_NAME_LENGTH);
-
-            // Create client
-            Client current_client;
-            current_client.name = std::string((char*)(&s_payload[current_client_index + CLIENT_ID_LENGTH]));
-            current_client.uuid = std::vector<uint8_t>(s_payload.begin() + current_client_index, s_payload.begin() + current_client_index + CLIENT_ID_LENGTH);
-
-            // Check if client already exists in our map
-            auto it = username_to_client_map.find(current_client.name);
-            if (it == username_to_client_map.end()) {
-                // Not found - add it
-                username_to_client_map[current_client.name] = current_client;
-            }
+            Contact& contact = directory.add(entries[i].client_id(), entries[i].name());
+            const Contact* known = contacts.find_by_uuid(contact.uuid);
+            if (known == NULL || contacts.get_name(*known) != directory.get_name(contact)) continue;
 
-            // Print name
-            std::cout << current_client.name << std::endl;
+            const uint8_t* public_key = contacts.get_public_key(*known);
+            if (public_key != NULL) directory.set_public_key(contact, public_key);
+            if (known->has_session_key) directory.set_session_key(contact, known->session_key);
         }
+        contacts = std::move(directory);
+
+        // Public key indexes were reassigned - the encryptors are parsed again when next used
+        rsa_encryptors.clear();
+        return;
     }
-    else
+
+    contacts.reserve(contacts.size() + entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
     {
-        std::cerr << "Request for client list failed: server responded with an error" << std::endl;
+        // Add client unless it already exists in our directory
+        contacts.add(entries[i].client_id(), entries[i].name());
     }
 }
 
@@ -118,7 +223,7 @@ void ConsoleApp::request_for_public_key()
     std::string dest_username;
 
     // Initialize request header
-    memcpy_s(request_header.client_id, CLIENT_ID_LENGTH, &client_id[0], client_id.size());
+    memcpy(request_header.client_id, &client_id[0], CLIENT_ID_LENGTH);
     request_header.version = CLIENT_VERSION;
     request_header.code = ServerRequestCodes::PUBLIC_KEY_REQUEST;
     request_header.payload_size = CLIENT_ID_LENGTH;
@@ -128,27 +233,28 @@ void ConsoleApp::request_for_public_key()
     std::getline(std::cin, dest_username);
 
     // Figure out the UUID of the destination user by its name
-    auto it = username_to_client_map.find(dest_username);
-    if (it == username_to_client_map.end()) {
+    Contact* contact = contacts.find_by_name(dest_username);
+    if (contact == NULL) {
         // Not found
         std::cerr << "No user with such name (You may need to update your user list)" << std::endl;
         return;
     }
 
     // Send request to server
-    if (winsock_client.send_request(request_header, it->second.uuid, response_header, s_payload) && response_header.code == ServerResponseCodes::PUBLIC_KEY_RESPONSE)
+    if (transport->send_request(request_header, { { contact->uuid, CLIENT_ID_LENGTH } }, response_header, s_payload) && response_header.code == ServerResponseCodes::PUBLIC_KEY_RESPONSE)
     {
         assert(response_header.payload_size == s_payload.size());
 
-        // Save public key for this client
-        it->second.public_key.assign(s_payload.begin() + CLIENT_ID_LENGTH, s_payload.begin() + CLIENT_ID_LENGTH + RSAPublicWrapper::KEYSIZE);
+        // Save public key for this client and parse it once for the key deliveries to come
+        contacts.set_public_key(*contact, &s_payload[CLIENT_ID_LENGTH]);
+        if (!rsa_encryptors.put(contact->public_key_index, &s_payload[CLIENT_ID_LENGTH], RSAPublicWrapper::KEYSIZE)) {
+            std::cerr << "Warning: received an invalid public key" << std::endl;
+        }
         
         // Print client public key to console
-        for (uint32_t i = 0; i < RSAPublicWrapper::KEYSIZE; i++)
-        {
-            std::cout << std::setfill('0') << std::setw(2) << std::hex << static_cast<uint32_t>(s_payload[CLIENT_ID_LENGTH + i]);
-        }
-
+        char public_key_hex[HexCodec::encoded_size(RSAPublicWrapper::KEYSIZE)];
+        HexCodec::encode(&s_payload[CLIENT_ID_LENGTH], RSAPublicWrapper::KEYSIZE, public_key_hex);
+        std::cout.write(public_key_hex, sizeof(public_key_hex));
         std::cout << std::endl;
     }
     else
@@ -157,6 +263,58 @@ void ConsoleApp::request_for_public_key()
     }
 }
 
+void ConsoleApp::request_for_all_public_keys()
+{
+    if (!is_registered()) {
+        std::cout << "User is not registered" << std::endl;
+        return;
+    }
+
+    // One request per contact whose key we don't have yet
+    std::vector<PipelinedRequest> requests;
+    std::vector<size_t> contact_indexes;
+    for (size_t i = 0; i < contacts.size(); i++)
+    {
+        const Contact& contact = contacts.at(i);
+        if (contacts.get_public_key(contact) != NULL) continue;
+
+        PipelinedRequest request{};
+        memcpy(request.header.client_id, &client_id[0], CLIENT_ID_LENGTH);
+        request.header.version = CLIENT_VERSION;
+        request.header.code = ServerRequestCodes::PUBLIC_KEY_REQUEST;
+        request.header.payload_size = CLIENT_ID_LENGTH;
+        request.payload_buffers.push_back({ contact.uuid, CLIENT_ID_LENGTH });
+        requests.push_back(std::move(request));
+        contact_indexes.push_back(i);
+    }
+
+    if (requests.empty()) {
+        std::cout << "Public keys of all users are known (You may need to update your user list)" << std::endl;
+        return;
+    }
+
+    // Keep many requests in flight so the round trips overlap - responses may arrive in any order
+    size_t received = 0;
+    transport->send_pipelined(requests, Transport::DEFAULT_PIPELINE_DEPTH,
+        [&](size_t index, bool success, const ServerResponseHeader& response_header, std::vector<uint8_t>& s_payload) {
+            const Contact& contact = contacts.at(contact_indexes[index]);
+            if (!success || response_header.code != ServerResponseCodes::PUBLIC_KEY_RESPONSE || s_payload.size() != CLIENT_ID_LENGTH + PUBLIC_KEY_LENGTH) {
+                std::cerr << "Request for public key of " << contacts.get_name(contact) << " failed" << std::endl;
+                return;
+            }
+
+            // Save public key for this client and parse it once for the key deliveries to come
+            Contact* key_owner = contacts.find_by_uuid(contact.uuid);
+            contacts.set_public_key(*key_owner, &s_payload[CLIENT_ID_LENGTH]);
+            if (!rsa_encryptors.put(key_owner->public_key_index, &s_payload[CLIENT_ID_LENGTH], RSAPublicWrapper::KEYSIZE)) {
+                std::cerr << "Warning: received an invalid public key for " << contacts.get_name(contact) << std::endl;
+            }
+            received++;
+        });
+
+    std::cout << "Received " << received << " of " << requests.size() << " public keys" << std::endl;
+}
+
 void ConsoleApp::request_for_waiting_messages()
 {
     if (!is_registered()) {
@@ -164,131 +322,266 @@ void ConsoleApp::request_for_waiting_messages()
         return;
     }
 
+    if (inbox_receiver_state == ReceiverState::RUNNING) {
+        std::cout << "Messages are already received in the background" << std::endl;
+        return;
+    }
+
     ServerRequestHeader request_header{};
-    ServerResponseHeader response_header{};
-    std::vector<uint8_t> c_payload;
-    std::vector<uint8_t> s_payload;
 
     // Initialize request header
-    memcpy_s(request_header.client_id, CLIENT_ID_LENGTH, &client_id[0], client_id.size());
+    memcpy(request_header.client_id, &client_id[0], CLIENT_ID_LENGTH);
     request_header.version = CLIENT_VERSION;
     request_header.code = ServerRequestCodes::WAITING_MESSAGES_REQUEST;
     request_header.payload_size = 0;
 
+    prepare_inbox();
+    if (!receive_waiting_messages(*transport, request_header, {}, false))
+    {
+        std::cerr << "Request for waiting messages failed: server responded with an error" << std::endl;
+    }
+}
+
+void ConsoleApp::toggle_inbox_receiver()
+{
+    if (inbox_receiver_state == ReceiverState::RUNNING) {
+        // The receiver notices after its current poll - it is only joined when it is started again
+        inbox_receiver_state = ReceiverState::STOPPING;
+        std::cout << "Stopped receiving messages in the background" << std::endl;
+        return;
+    }
+
+    if (!is_registered()) {
+        std::cout << "User is not registered" << std::endl;
+        return;
+    }
+
+    prepare_inbox();
+
+    // A receiver still in its last poll just carries on
+    ReceiverState stopping = ReceiverState::STOPPING;
+    if (!inbox_receiver_state.compare_exchange_strong(stopping, ReceiverState::RUNNING))
+    {
+        // Otherwise it has finished polling, and exits without waiting for the state
+        if (inbox_receiver.joinable()) {
+            inbox_receiver.join();
+        }
+        inbox_receiver_state = ReceiverState::RUNNING;
+        inbox_receiver = std::thread(&ConsoleApp::run_inbox_receiver, this);
+    }
+    std::cout << "Receiving messages in the background" << std::endl;
+}
+
+void ConsoleApp::run_inbox_receiver()
+{
+    // Connection of its own, so a held poll never delays the requests of the actions
+    std::unique_ptr<Transport> receiver_transport = Transport::create();
+    receiver_transport->set_metrics(&request_metrics);
+
+    ServerRequestHeader request_header{};
+    WaitingMessagesLongPollPayload poll_payload{};
+
+    // Initialize request header - client ID doesn't change while the receiver runs
+    memcpy(request_header.client_id, &client_id[0], CLIENT_ID_LENGTH);
+    request_header.version = CLIENT_VERSION;
+    request_header.code = ServerRequestCodes::WAITING_MESSAGES_LONG_POLL;
+    request_header.payload_size = sizeof(poll_payload);
+    poll_payload.timeout_ms = LONG_POLL_TIMEOUT_MS;
+
+    // The server answers as soon as a message is queued, or empty when the timeout passed
+    while (true)
+    {
+        if (!receive_waiting_messages(*receiver_transport, request_header, { { &poll_payload, sizeof(poll_payload) } }, true))
+        {
+            std::cerr << "Background request for waiting messages failed" << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(RECEIVER_RETRY_DELAY_MS));
+        }
+
+        // Exit if asked to stop - unless the receiver was started again meanwhile
+        ReceiverState stopping = ReceiverState::STOPPING;
+        if (inbox_receiver_state.compare_exchange_strong(stopping, ReceiverState::STOPPED)) break;
+    }
+}
+
+void ConsoleApp::prepare_inbox()
+{
+    // Texts and key deliveries are decrypted in parallel while the rest of the inbox arrives
+    if (!inbox_decryptor) {
+        inbox_decryptor = std::make_unique<InboxDecryptor>([this](InboxRecord& record) { print_inbox_record(record); });
+    }
+    inbox_decryptor->set_private_key(get_private_key_decryptor());
+}
+
+bool ConsoleApp::receive_waiting_messages(Transport& inbox_transport, const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, bool background)
+{
+    ServerResponseHeader response_header{};
+
+    // The background receiver takes the state once messages arrive - not while the server holds its poll
+    std::unique_lock<std::mutex> state_lock(state_mutex, std::defer_lock);
+
+    // Each message is handled as soon as it arrives instead of buffering the whole inbox
+    WaitingMessagesParser parser([this](const WaitingMessagesParser::HeaderView& message_header, const uint8_t* content) {
+        handle_waiting_message(message_header, content);
+    });
+
+    // Files are decrypted to disk part by part instead of being buffered whole
+    parser.set_part_handler(
+        [](const WaitingMessagesParser::HeaderView& message_header) {
+            return message_header.message_type() == ClientMessageType::SEND_FILE || message_header.message_type() == ClientMessageType::SEND_COMPRESSED_FILE;
+        },
+        [this](const WaitingMessagesParser::HeaderView& message_header, const uint8_t* data, size_t size, bool last) {
+            handle_waiting_file_part(message_header, data, size, last);
+        });
+
     // Send request to server
-    if (winsock_client.send_request(request_header, c_payload, response_header, s_payload) && response_header.code == ServerResponseCodes::WAITING_MESSAGES_RESPONSE)
+    bool succeeded = inbox_transport.send_request_streamed(request_header, payload_buffers, response_header,
+        [&](const uint8_t* data, size_t size) {
+            // Only a messages response is parsed
+            if (response_header.code != ServerResponseCodes::WAITING_MESSAGES_RESPONSE) return false;
+            if (background && !state_lock.owns_lock()) state_lock.lock();
+            parser.feed(data, size);
+            return true;
+        });
+    if (background && !state_lock.owns_lock()) state_lock.lock();
+
+    // Messages still being decrypted - the time the caller waits for them after the response
     {
-        assert(response_header.payload_size == s_payload.size());
+        PhaseTimer crypto_timer(&request_metrics, request_header.code, RequestPhase::CRYPTO);
+        inbox_decryptor->drain();
+    }
+
+    // Don't leave a partly received file behind
+    if (file_download) {
+        file_download->abort();
+        file_download.reset();
+    }
+    file_download_started = false;
+
+    return succeeded && response_header.code == ServerResponseCodes::WAITING_MESSAGES_RESPONSE && parser.is_complete();
+}
+
+void ConsoleApp::handle_waiting_file_part(const WaitingMessagesParser::HeaderView& message_header, const uint8_t* data, size_t size, bool last)
+{
+    const Contact* client = contacts.find_by_uuid(message_header.client_id());
+
+    // First part - create the file if the message can be decrypted
+    if (!file_download_started)
+    {
+        file_download_started = true;
+
+        // Messages before the file, including key deliveries it may need, are done first
+        inbox_decryptor->drain();
+        if (client != NULL && client->has_session_key)
+        {
+            std::string temp_file_path = std::filesystem::temp_directory_path().generic_string() + std::to_string(message_header.message_id());
+            bool compressed = message_header.message_type() == ClientMessageType::SEND_COMPRESSED_FILE;
+            file_download = std::make_unique<FileDownloadSink>(temp_file_path, client->session_key, AESWrapper::DEFAULT_KEYLENGTH, compressed);
+            if (!file_download->open(message_header.message_size())) {
+                file_download->abort();
+                file_download.reset();
+            }
+        }
+    }
+
+    // Decrypt this part to disk
+    if (file_download && !file_download->write(data, size)) {
+        file_download->abort();
+        file_download.reset();
+    }
+
+    if (!last) return;
+    file_download_started = false;
+
+    if (client == NULL)
+    {
+        // Unknown client
+        std::cerr << "Message from unknown user (Please update client list)" << std::endl;
+        return;
+    }
+
+    std::cout << "From: " << contacts.get_name(*client) << "\nContent:\n";
+    if (!client->has_session_key)
+    {
+        std::cerr << "cant decrypt message";
+    }
+    else if (!file_download)
+    {
+        std::cerr << "Error: failed to store file";
+    }
+    else if (!file_download->finish())
+    {
+        file_download->abort();
+        std::cerr << "cant decrypt message";
+    }
+    else
+    {
+        // Print file path
+        std::cout << file_download->get_file_path();
+    }
+    file_download.reset();
+    std::cout << "\n----<EOM>-----" << std::endl;
+}
+
+void ConsoleApp::handle_waiting_message(const WaitingMessagesParser::HeaderView& message_header, const uint8_t* content)
+{
+    // Hash lookup by UUID - no allocation per message
+    const Contact* client = contacts.find_by_uuid(message_header.client_id());
+    const uint8_t* session_key = client != NULL && client->has_session_key ? client->session_key : NULL;
 
-        uint32_t s_payload_index = 0;
-        while (s_payload_index < s_payload.size())
+    // Decrypted on the inbox pool, the results come back in order to print_inbox_record
+    inbox_decryptor->submit(message_header, content, client != NULL, session_key);
+    inbox_decryptor->deliver_ready();
+}
+
+void ConsoleApp::print_inbox_record(InboxRecord& record)
+{
+    const WaitingMessageResponseHeader& message_header = record.header;
+    Contact* client = contacts.find_by_uuid(message_header.client_id);
+    if (client != NULL)
+    {
+        std::cout << "From: " << contacts.get_name(*client) << "\nContent:\n";
+        if (message_header.message_type == ClientMessageType::SYMMETRIC_KEY_REQUEST)
         {
-            WaitingMessageResponseHeader* message_header = (WaitingMessageResponseHeader*)&s_payload[s_payload_index];
-            std::string client_name;
-            // Linear search on binary tree to find client name
-            for (const auto& pair : username_to_client_map) {
-                std::vector<uint8_t> uuid_vector;
-                uuid_vector.assign(message_header->client_id, message_header->client_id + CLIENT_ID_LENGTH);
-                if (pair.second.uuid == uuid_vector)
-                {
-                    client_name = pair.first;
-                    break;
-                }
+            std::cout << "Request for symmetric key";
+        }
+        else if (message_header.message_type == ClientMessageType::SEND_SYMMETRIC_KEY)
+        {
+            if (!record.succeeded)
+            {
+                std::cerr << "Error: invalid symmetric key";
             }
-            if (client_name.size() > 0)
+            else
+            {
+                // Save symmetric key for the user
+                contacts.set_session_key(*client, reinterpret_cast<const uint8_t*>(record.plaintext.data()));
+
+                // Print to user that key have been recieved
+                std::cout << "symmetric key recieved";
+            }
+        }
+        else if (message_header.message_type == ClientMessageType::SEND_TEXT_MESSAGE || message_header.message_type == ClientMessageType::SEND_COMPRESSED_TEXT_MESSAGE)
+        {
+            // Fails if there was no session key between these two clients
+            if (!record.succeeded)
             {
-                std::cout << "From: " << client_name << "\nContent:\n";
-                if (message_header->message_type == ClientMessageType::SYMMETRIC_KEY_REQUEST)
-                {
-                    std::cout << "Request for symmetric key";
-                }
-                else if (message_header->message_type == ClientMessageType::SEND_SYMMETRIC_KEY)
-                {
-                    std::string ciphertext;
-                    for (uint32_t i = 0; i < message_header->message_size; i++)
-                    {
-                        ciphertext += s_payload[s_payload_index + sizeof(WaitingMessageResponseHeader) + i];
-                    }
-
-                    // Decrypt symmetric key with private key
-                    RSAPrivateWrapper rsapriv(Base64Wrapper::decode(base64_private_key));
-                    std::string plaintext_key = rsapriv.decrypt(ciphertext);
-
-                    // Save symmetric key for the user
-                    username_to_client_map[client_name].session_key.assign(plaintext_key.begin(), plaintext_key.end());
-
-                    // Print to user that key have been recieved
-                    std::cout << "symmetric key recieved";
-                }
-                else if (message_header->message_type == ClientMessageType::SEND_TEXT_MESSAGE)
-                {
-                    std::string ciphertext;
-                    std::vector<uint8_t>& session_key = username_to_client_map[client_name].session_key;
-                    // Check that a session key exists between these two clients
-                    if (session_key.empty())
-                    {
-                        std::cerr << "cant decrypt message";
-                    }
-                    else
-                    {
-                        for (uint32_t i = 0; i < message_header->message_size; i++)
-                        {
-                            ciphertext += s_payload[s_payload_index + sizeof(WaitingMessageResponseHeader) + i];
-                        }
-                        // Decrypt cipher to plaintext
-                        AESWrapper aes(&session_key[0], session_key.size());
-                        std::string plaintext = aes.decrypt(ciphertext.c_str(), static_cast<uint32_t>(ciphertext.length()));
-                        std::cout << plaintext;
-                    }
-                }
-                else if (message_header->message_type == ClientMessageType::SEND_FILE)
-                {
-                    std::string temp_file_path = std::filesystem::temp_directory_path().generic_string() + std::to_string(message_header->message_id);
-                    std::string ciphertext;
-                    std::vector<uint8_t>& session_key = username_to_client_map[client_name].session_key;
-                    // Check that a session key exists between these two clients
-                    if (session_key.empty())
-                    {
-                        std::cerr << "cant decrypt message";
-                    }
-                    else
-                    {
-                        for (uint32_t i = 0; i < message_header->message_size; i++)
-                        {
-                            ciphertext += s_payload[s_payload_index + sizeof(WaitingMessageResponseHeader) + i];
-                        }
-                        // Decrypt cipher to plaintext
-                        AESWrapper aes(&session_key[0], session_key.size());
-                        std::string plaintext = aes.decrypt(ciphertext.c_str(), static_cast<uint32_t>(ciphertext.length()));
-
-                        // Store file
-                        std::ofstream fileStream(temp_file_path);
-                        fileStream.write(plaintext.c_str(), plaintext.size());
-                        fileStream.close();
-
-                        // Print file path
-                        std::cout << temp_file_path;
-                    }
-                }
-                else
-                {
-                    // Error
-                    std::cerr << "Error: unknown message type: " << static_cast<uint32_t>(message_header->message_type);
-                }
-                std::cout << "\n----<EOM>-----" << std::endl;
+                std::cerr << "cant decrypt message";
             }
             else
             {
-                // Unknown client
-                std::cerr << "Message from unknown user (Please update client list)" << std::endl;
+                std::cout << record.plaintext;
             }
-            // Increment index to next message
-            s_payload_index += sizeof(WaitingMessageResponseHeader) + message_header->message_size;
         }
+        else
+        {
+            // Error
+            std::cerr << "Error: unknown message type: " << static_cast<uint32_t>(message_header.message_type);
+        }
+        std::cout << "\n----<EOM>-----" << std::endl;
     }
     else
     {
-        std::cerr << "Request for waiting messages failed: server responded with an error" << std::endl;
+        // Unknown client
+        std::cerr << "Message from unknown user (Please update client list)" << std::endl;
     }
 }
 
@@ -297,6 +590,96 @@ void ConsoleApp::send_text_message()
     send_message_to_client(ClientMessageType::SEND_TEXT_MESSAGE);
 }
 
+void ConsoleApp::send_text_message_to_many()
+{
+    if (!is_registered()) {
+        std::cout << "User is not registered" << std::endl;
+        return;
+    }
+
+    // Get destination users, one per line
+    std::cout << "Enter destination user names, one per line, and an empty line to finish:" << std::endl;
+    std::vector<Contact*> destinations;
+    std::string dest_username;
+    while (std::getline(std::cin, dest_username) && !dest_username.empty())
+    {
+        Contact* contact = contacts.find_by_name(dest_username);
+        if (contact == NULL) {
+            std::cerr << "No user named " << dest_username << " (You may need to update your user list)" << std::endl;
+            return;
+        }
+        if (!contact->has_session_key) {
+            std::cerr << "Does not have a symmetric key for " << dest_username << std::endl;
+            return;
+        }
+        destinations.push_back(contact);
+    }
+    if (destinations.empty()) {
+        return;
+    }
+
+    // Get message from user
+    std::cout << "Type your message:" << std::endl;
+    std::string message;
+    std::getline(std::cin, message);
+
+    // Encrypt the message for each user with its session cipher - compressed once first if enabled and smaller
+    MessageBatch batch;
+    uint64_t crypto_start = RequestMetrics::start(&request_metrics);
+    ClientMessageType message_type = ClientMessageType::SEND_TEXT_MESSAGE;
+    std::string compressed;
+    if (compress_text(message, compressed)) {
+        message.swap(compressed);
+        message_type = ClientMessageType::SEND_COMPRESSED_TEXT_MESSAGE;
+    }
+    for (Contact* contact : destinations)
+    {
+        std::string ciphertext(AESStreamEncryptor::encryptedSize(message.size()), '\0');
+        AESSessionCipher* cipher = contacts.get_session_cipher(*contact);
+        ciphertext.resize(cipher->encrypt(reinterpret_cast<const unsigned char*>(message.data()), message.size(), reinterpret_cast<unsigned char*>(&ciphertext[0])));
+        if (!batch.add(contact->uuid, message_type, std::move(ciphertext))) {
+            std::cerr << "Message is too big" << std::endl;
+            return;
+        }
+    }
+    RequestMetrics::finish(&request_metrics, ServerRequestCodes::SEND_MESSAGES_BATCH, RequestPhase::CRYPTO, crypto_start);
+
+    std::vector<BatchMessageResult> results;
+    if (!send_message_batch(batch, results))
+    {
+        std::cerr << "Send text message failed: server responded with an error" << std::endl;
+        return;
+    }
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        if (results[i].status == BatchMessageStatus::QUEUED) {
+            std::cout << "Message to " << contacts.get_name(*destinations[i]) << " sent to server" << std::endl;
+        }
+        else {
+            std::cerr << "Message to " << contacts.get_name(*destinations[i]) << " failed: user not found on server" << std::endl;
+        }
+    }
+}
+
+bool ConsoleApp::send_message_batch(MessageBatch& batch, std::vector<BatchMessageResult>& results)
+{
+    ServerRequestHeader request_header{};
+    ServerResponseHeader response_header{};
+    std::vector<uint8_t> s_payload;
+
+    // Initialize request header
+    memcpy(request_header.client_id, &client_id[0], CLIENT_ID_LENGTH);
+    request_header.version = CLIENT_VERSION;
+    request_header.code = ServerRequestCodes::SEND_MESSAGES_BATCH;
+    request_header.payload_size = batch.get_payload_size();
+
+    // All the records go out in one request, as views of the batch
+    return transport->send_request(request_header, batch.get_payload_buffers(), response_header, s_payload) &&
+        response_header.code == ServerResponseCodes::MESSAGES_BATCH_SENT_TO_SERVER &&
+        batch.parse_response(s_payload, results);
+}
+
 void ConsoleApp::send_request_for_symmetric_key()
 {
     send_message_to_client(ClientMessageType::SYMMETRIC_KEY_REQUEST);
@@ -312,8 +695,80 @@ void ConsoleApp::send_file()
     send_message_to_client(ClientMessageType::SEND_FILE);
 }
 
+bool ConsoleApp::compress_text(const std::string& message, std::string& compressed)
+{
+    if (!compress_messages) return false;
+
+    // Against the dictionary - most texts are too short to repeat themselves
+    std::vector<uint8_t> stream;
+    text_compressor.compress(reinterpret_cast<const uint8_t*>(message.data()), message.size(), stream);
+    if (stream.size() >= message.size()) return false;
+
+    compressed.assign(stream.begin(), stream.end());
+    return true;
+}
+
+void ConsoleApp::toggle_compression()
+{
+    compress_messages = !compress_messages;
+    std::cout << "Compression of sent messages and files " << (compress_messages ? "enabled - only clients that support it can read them" : "disabled") << std::endl;
+}
+
+void ConsoleApp::update_metric_gauges()
+{
+    request_metrics.set_gauge("messageu_rsa_encryptor_cache_hits", "Public key encryptors found already parsed.", static_cast<double>(rsa_encryptors.get_hits()));
+    request_metrics.set_gauge("messageu_rsa_encryptor_cache_misses", "Public key encryptors that had to be parsed.", static_cast<double>(rsa_encryptors.get_misses()));
+
+    const EndpointCache& endpoints = transport->get_endpoint_cache();
+    request_metrics.set_gauge("messageu_endpoint_cache_hits", "Connections made to cached server addresses.", static_cast<double>(endpoints.get_hits()));
+    request_metrics.set_gauge("messageu_endpoint_cache_misses", "Connections that had to resolve the server.", static_cast<double>(endpoints.get_misses()));
+    request_metrics.set_gauge("messageu_endpoint_cache_hit_ratio", "Fraction of connections made to cached server addresses.", endpoints.get_hit_ratio());
+    if (key_pool) {
+        request_metrics.set_gauge("messageu_rsa_key_pool_hits", "Registrations that found their key pair ready.", static_cast<double>(key_pool->get_hits()));
+        request_metrics.set_gauge("messageu_rsa_key_pool_misses", "Registrations that waited for their key pair.", static_cast<double>(key_pool->get_misses()));
+    }
+    if (inbox_decryptor) {
+        WorkStealingPool& pool = inbox_decryptor->get_pool();
+        request_metrics.set_gauge("messageu_inbox_pool_threads", "Worker threads decrypting the inbox.", static_cast<double>(pool.get_thread_count()));
+        request_metrics.set_gauge("messageu_inbox_pool_tasks_run", "Inbox messages decrypted by the pool.", static_cast<double>(pool.get_tasks_run()));
+        request_metrics.set_gauge("messageu_inbox_pool_tasks_stolen", "Inbox decryptions taken from the queue of another worker.", static_cast<double>(pool.get_tasks_stolen()));
+    }
+}
+
+void ConsoleApp::show_request_metrics()
+{
+    update_metric_gauges();
+    request_metrics.print(std::cout);
+}
+
+void ConsoleApp::save_request_metrics()
+{
+    // Prometheus text format - can be served by the node exporter textfile collector
+    update_metric_gauges();
+    if (!request_metrics.write_prometheus(METRICS_PATH)) {
+        std::cerr << "Failed to write " << METRICS_PATH << std::endl;
+        return;
+    }
+    std::cout << "Request metrics saved to " << METRICS_PATH << std::endl;
+}
+
+void ConsoleApp::toggle_request_metrics()
+{
+    request_metrics.set_enabled(!request_metrics.is_enabled());
+    std::cout << "Request metrics " << (request_metrics.is_enabled() ? "enabled" : "disabled") << std::endl;
+}
+
+void ConsoleApp::show_startup_timings()
+{
+    startup_timings.print(std::cout);
+}
+
 void ConsoleApp::exit_client()
 {
+    // Don't wait for a poll the server is holding
+    inbox_receiver_state = ReceiverState::STOPPING;
+    if (inbox_receiver.joinable()) inbox_receiver.detach();
+
     std::cout << "Bye bye!" << std::endl;
     exit(0);
 }
@@ -328,18 +783,18 @@ void ConsoleApp::send_message_to_client(ClientMessageType message_type)
     ServerRequestHeader request_header{};
     ServerResponseHeader response_header{};
     SendMessageToClientPayloadHeader payload_header{};
-    std::vector<uint8_t> c_payload;
     std::vector<uint8_t> s_payload;
     std::string dest_username;
     std::string ciphertext;
+    std::unique_ptr<FileUploadSource> file_source;
 
     // Get name of the destination user
     std::cout << "Enter destination user name:" << std::endl;
     std::getline(std::cin, dest_username);
 
     // Find destination user by its name
-    auto it = username_to_client_map.find(dest_username);
-    if (it == username_to_client_map.end()) {
+    Contact* contact = contacts.find_by_name(dest_username);
+    if (contact == NULL) {
         // Not found
         std::cerr << "No user with such name (You may need to update your user list)" << std::endl;
         return;
@@ -349,24 +804,35 @@ void ConsoleApp::send_message_to_client(ClientMessageType message_type)
     if (message_type == ClientMessageType::SEND_SYMMETRIC_KEY)
     {
         // Check that public key was recieved before for this user
-        if (it->second.public_key.size() == 0) {
+        const uint8_t* public_key = contacts.get_public_key(*contact);
+        if (public_key == NULL) {
             std::cerr << "Does not have a public key for this user" << std::endl;
             return;
         }
 
+        // Encryptor was created when the public key arrived
+        const RSAPublicEncryptor* encryptor = rsa_encryptors.get(contact->public_key_index);
+        if (encryptor == NULL) {
+            if (!rsa_encryptors.put(contact->public_key_index, public_key, RSAPublicWrapper::KEYSIZE)) {
+                std::cerr << "Invalid public key for this user" << std::endl;
+                return;
+            }
+            encryptor = rsa_encryptors.get(contact->public_key_index);
+        }
+
         // Generate symmetric key and save it in our clients map
+        PhaseTimer crypto_timer(&request_metrics, ServerRequestCodes::SEND_MESSAGE_TO_CLIENT, RequestPhase::CRYPTO);
         unsigned char key[AESWrapper::DEFAULT_KEYLENGTH];
         AESWrapper::GenerateKey(key, AESWrapper::DEFAULT_KEYLENGTH);
-        it->second.session_key.assign(key, key + AESWrapper::DEFAULT_KEYLENGTH);
+        contacts.set_session_key(*contact, key);
 
         // Encrypt symmetric key with destination client public key
-        RSAPublicWrapper rsapub((const char*)&it->second.public_key[0], RSAPublicWrapper::KEYSIZE);
-        ciphertext = rsapub.encrypt((const char*)key, AESWrapper::DEFAULT_KEYLENGTH);
+        ciphertext = rsa_encryptors.encrypt(*encryptor, (const char*)key, AESWrapper::DEFAULT_KEYLENGTH);
     }
     else if (message_type == ClientMessageType::SEND_TEXT_MESSAGE)
     {
         // Check that session key was recieved before for this user
-        if (it->second.session_key.size() == 0) {
+        if (!contact->has_session_key) {
             std::cerr << "Does not have a symmetric key for this user" << std::endl;
             return;
         }
@@ -376,55 +842,73 @@ void ConsoleApp::send_message_to_client(ClientMessageType message_type)
         std::string message;
         std::getline(std::cin, message);
 
-        if (message.size() > ULONG_MAX) {
+        if (message.size() > UINT32_MAX) {
             std::cerr << "Message is too big" << std::endl;
             return;
         }
 
-        // Encrypt message with symmetric key
-        AESWrapper aes(&it->second.session_key[0], it->second.session_key.size());
-        ciphertext = aes.encrypt(message.c_str(), static_cast<uint32_t>(message.length()));
+        // Encrypt message with the session cipher of this user - compressed first if enabled and smaller
+        PhaseTimer crypto_timer(&request_metrics, ServerRequestCodes::SEND_MESSAGE_TO_CLIENT, RequestPhase::CRYPTO);
+        std::string compressed;
+        if (compress_text(message, compressed)) {
+            message.swap(compressed);
+            message_type = ClientMessageType::SEND_COMPRESSED_TEXT_MESSAGE;
+        }
+        AESSessionCipher* cipher = contacts.get_session_cipher(*contact);
+        ciphertext.resize(AESStreamEncryptor::encryptedSize(message.size()));
+        ciphertext.resize(cipher->encrypt(reinterpret_cast<const unsigned char*>(message.data()), message.size(), reinterpret_cast<unsigned char*>(&ciphertext[0])));
     }
     else if (message_type == ClientMessageType::SEND_FILE)
     {
         // Check that session key was recieved before for this user
-        if (it->second.session_key.size() == 0) {
+        if (!contact->has_session_key) {
             std::cerr << "Does not have a symmetric key for this user" << std::endl;
             return;
         }
 
         // Get message from user
         std::cout << "Enter file path:" << std::endl;
-        std::string file_path, file_content;
+        std::string file_path;
         std::getline(std::cin, file_path);
 
-        if (!Util::read_file(file_path, file_content)) {
+        // The file is read and encrypted chunk by chunk while it is being sent
+        file_source = std::make_unique<FileUploadSource>(file_path, contact->session_key, AESWrapper::DEFAULT_KEYLENGTH, compress_messages);
+        if (!file_source->open()) {
             std::cerr << "file not found" << std::endl;
             return;
         }
+        if (file_source->is_compressed()) {
+            message_type = ClientMessageType::SEND_COMPRESSED_FILE;
+        }
 
-        // Encrypt message with symmetric key
-        AESWrapper aes(&it->second.session_key[0], it->second.session_key.size());
-        ciphertext = aes.encrypt(file_content.c_str(), static_cast<uint32_t>(file_content.length()));
+        if (sizeof(SendMessageToClientPayloadHeader) + file_source->get_encrypted_size() > UINT32_MAX) {
+            std::cerr << "File is too big" << std::endl;
+            return;
+        }
     }
 
     // Assign payload header members
-    memcpy_s(payload_header.client_id, CLIENT_ID_LENGTH, &it->second.uuid[0], it->second.uuid.size());
+    memcpy(payload_header.client_id, contact->uuid, CLIENT_ID_LENGTH);
     payload_header.message_type = message_type;
-    payload_header.content_size = ciphertext.size();
+    payload_header.content_size = static_cast<uint32_t>(file_source ? file_source->get_encrypted_size() : ciphertext.size());
 
-    // Assign client payload vector
-    c_payload.insert(c_payload.begin(), (uint8_t*)&payload_header, (uint8_t*)&payload_header + sizeof(SendMessageToClientPayloadHeader));
-    c_payload.insert(c_payload.end(), ciphertext.begin(), ciphertext.end());
+    // Client payload is the payload header followed by the ciphertext - sent as two views
+    std::vector<ConstBuffer> c_payload = {
+        { &payload_header, sizeof(SendMessageToClientPayloadHeader) },
+        { ciphertext.data(), ciphertext.size() },
+    };
 
     // Initialize request header
-    memcpy_s(request_header.client_id, CLIENT_ID_LENGTH, &client_id[0], client_id.size());
+    memcpy(request_header.client_id, &client_id[0], CLIENT_ID_LENGTH);
     request_header.version = CLIENT_VERSION;
     request_header.code = ServerRequestCodes::SEND_MESSAGE_TO_CLIENT;
-    request_header.payload_size = static_cast<uint32_t>(c_payload.size());
+    request_header.payload_size = static_cast<uint32_t>(sizeof(SendMessageToClientPayloadHeader) + payload_header.content_size);
 
-    // Send request to server
-    if (winsock_client.send_request(request_header, c_payload, response_header, s_payload) && response_header.code == ServerResponseCodes::MESSAGE_TO_CLIENT_SENT_TO_SERVER)
+    // Send request to server - a file is streamed after the payload header
+    bool sent = file_source
+        ? transport->send_request(request_header, c_payload, *file_source, response_header, s_payload)
+        : transport->send_request(request_header, c_payload, response_header, s_payload);
+    if (sent && response_header.code == ServerResponseCodes::MESSAGE_TO_CLIENT_SENT_TO_SERVER)
     {
         std::cout << "Message sent to server" << std::endl;
     }
@@ -434,7 +918,7 @@ void ConsoleApp::send_message_to_client(ClientMessageType message_type)
     }
 }
 
-bool ConsoleApp::create_me_info_file(const std::string& username, const uint8_t* uuid) const
+bool ConsoleApp::create_me_info_file(const std::string& username, const uint8_t* uuid, const std::string& private_key) const
 {
     // Check if already exists
     if (std::filesystem::exists(ME_INFO_PATH)) {
@@ -449,16 +933,13 @@ bool ConsoleApp::create_me_info_file(const std::string& username, const uint8_t*
     fileStream.write("\n", 1);
 
     // Write UUID
-    std::stringstream uuid_stream;
-    for (size_t i = 0; i < CLIENT_ID_LENGTH; i++)
-    {
-        uuid_stream << std::setfill('0') << std::setw(2) << std::hex << static_cast<int>(uuid[i]);
-    }
-    std::string uuid_as_str(uuid_stream.str());
-    fileStream.write(uuid_as_str.c_str(), uuid_as_str.length());
+    char uuid_hex[HexCodec::encoded_size(CLIENT_ID_LENGTH)];
+    HexCodec::encode(uuid, CLIENT_ID_LENGTH, uuid_hex);
+    fileStream.write(uuid_hex, sizeof(uuid_hex));
     fileStream.write("\n", 1);
 
     // Write private key
+    std::string base64_private_key = Base64Wrapper::encode(private_key);
     fileStream.write(base64_private_key.c_str(), base64_private_key.length());
 
     // close stream
@@ -466,36 +947,62 @@ bool ConsoleApp::create_me_info_file(const std::string& username, const uint8_t*
     return true;
 }
 
-void ConsoleApp::load_me_info_file()
+void ConsoleApp::load_identity()
 {
-    // First check if me info file exists
-    if (!std::filesystem::exists(ME_INFO_PATH)) {
+    // The binary identity is used as long as it matches me.info
+    bool loaded = identity.load();
+    if (loaded && (identity.is_from(ME_INFO_PATH) || !std::filesystem::exists(ME_INFO_PATH))) {
+        client_id.assign(identity.get_client_id(), identity.get_client_id() + CLIENT_ID_LENGTH);
+        startup_timings.record("identity");
         return;
     }
 
-    std::string temp_string, uuid_string;
-    std::ifstream me_info_file_stream(ME_INFO_PATH);
-
-    // Ignore the user name in the first line
-    std::getline(me_info_file_stream, temp_string);
-
-    // UUID should be in the second line of the file
-    std::getline(me_info_file_stream, uuid_string);
+    // No identity yet, or me.info was replaced - migrate it
+    if (std::filesystem::exists(ME_INFO_PATH)) {
+        std::string name, private_key;
+        std::vector<uint8_t> me_info_client_id;
+        if (IdentityStore::read_text(ME_INFO_PATH, name, me_info_client_id, private_key)) {
+            if (!identity.save(name, me_info_client_id.data(), private_key, ME_INFO_PATH)) {
+                std::cerr << "Warning: failed to save " << IDENTITY_PATH << ", " << ME_INFO_PATH << " will be read again next time" << std::endl;
+            }
+        }
+        else {
+            std::cerr << "Failed to parse " << ME_INFO_PATH << std::endl;
+        }
+    }
 
-    // Convert UUID from hex to ASCII
-    Util::convert_hex_str_to_bytes(uuid_string, client_id);
+    if (identity.is_loaded()) {
+        client_id.assign(identity.get_client_id(), identity.get_client_id() + CLIENT_ID_LENGTH);
+    }
+    startup_timings.record("identity migration");
+}
 
-    // Extract private key from rest of the file
-    while(std::getline(me_info_file_stream, temp_string))
-        base64_private_key += temp_string;
+RSAPrivateDecryptor* ConsoleApp::get_private_key_decryptor()
+{
+    // Parsing the key is most of the cost of loading an identity, and only key deliveries need it
+    if (!private_key_decryptor && identity.is_loaded()) {
+        uint64_t parse_start = StartupTimings::now_ns();
+        try {
+            private_key_decryptor = std::make_unique<RSAPrivateDecryptor>(identity.get_private_key());
+        }
+        catch (const CryptoPP::Exception&) {
+            std::cerr << "Failed to load the private key from " << IDENTITY_PATH << std::endl;
+        }
+        startup_timings.record_deferred("private key", StartupTimings::now_ns() - parse_start);
+    }
+    return private_key_decryptor.get();
+}
 
-    // Close stream
-    me_info_file_stream.close();
+void ConsoleApp::start_key_generation()
+{
+    // Limited to one pair, so taking it doesn't start another that a registered client never uses.
+    // The worker of a replaced pool is already done
+    key_pool = std::make_unique<RSAKeyPool>(1, 1, 1);
 }
 
 bool ConsoleApp::is_registered()
 {
-    return client_id.size() == CLIENT_ID_LENGTH && !base64_private_key.empty();
+    return client_id.size() == CLIENT_ID_LENGTH && (identity.is_loaded() || private_key_decryptor);
 }
 
 std::map<std::string, ConsoleApp::func_ptr> ConsoleApp::create_client_action_map()
@@ -504,11 +1011,19 @@ std::map<std::string, ConsoleApp::func_ptr> ConsoleApp::create_client_action_map
        {"10" , &ConsoleApp::register_client},
        {"20" , &ConsoleApp::request_for_client_list},
        {"30" , &ConsoleApp::request_for_public_key},
+       {"31" , &ConsoleApp::request_for_all_public_keys},
        {"40" , &ConsoleApp::request_for_waiting_messages},
+       {"41" , &ConsoleApp::toggle_inbox_receiver},
        {"50" , &ConsoleApp::send_text_message},
        {"51" , &ConsoleApp::send_request_for_symmetric_key},
        {"52" , &ConsoleApp::send_symmetric_key},
        {"53" , &ConsoleApp::send_file},
+       {"54" , &ConsoleApp::send_text_message_to_many},
+       {"55" , &ConsoleApp::toggle_compression},
+       {"60" , &ConsoleApp::show_request_metrics},
+       {"61" , &ConsoleApp::save_request_metrics},
+       {"62" , &ConsoleApp::toggle_request_metrics},
+       {"63" , &ConsoleApp::show_startup_timings},
        {"0" , &ConsoleApp::exit_client},
     };
     return temp_functions_map;
@@ -520,11 +1035,19 @@ void ConsoleApp::display_usage()
     std::cout << "10) Register\n";
     std::cout << "20) Request for clients list\n";
     std::cout << "30) Request for public key\n";
+    std::cout << "31) Request for public keys of all users\n";
     std::cout << "40) Request for waiting messages\n";
+    std::cout << "41) Start or stop receiving messages in the background\n";
     std::cout << "50) Send a text message\n";
     std::cout << "51) Send a request for symmetric key\n";
     std::cout << "52) Send your symmetric key\n";
     std::cout << "53) Send a file\n";
+    std::cout << "54) Send a text message to several users\n";
+    std::cout << "55) Enable or disable compression of sent messages and files\n";
+    std::cout << "60) Show request metrics\n";
+    std::cout << "61) Save request metrics to a file\n";
+    std::cout << "62) Enable or disable request metrics\n";
+    std::cout << "63) Show startup times\n";
     std::cout << "0) Exit client\n";
     std::cout << "?\n";
     std::cout << std::endl; // drop line and flush buffer
@@ -532,11 +1055,21 @@ void ConsoleApp::display_usage()
 
 void ConsoleApp::start()
 {
-    // Try to load me info file
-    load_me_info_file();
+    // Try to load our identity
+    load_identity();
+
+    // Generate the key pair of the registration while the user gets to it
+    if (!is_registered()) {
+        start_key_generation();
+    }
+
+    // Start with the clients we already know of
+    contact_cache.load(contacts);
+    startup_timings.record("contact cache");
 
     // Display usage
     display_usage();
+    startup_timings.finish();
 
     while (true)
     {
@@ -558,12 +1091,15 @@ void ConsoleApp::get_action_from_user()
         std::cerr << "Operation does not exists" << std::endl;
     }
     else {
-        // Correct input - run the mapped function
+        // Correct input - run the mapped function, messages received in the background wait for it
         func_ptr fp = it->second;
+        std::lock_guard<std::mutex> state_lock(state_mutex);
         (this->*fp)();
     }
 }
 
-ConsoleApp::ConsoleApp() : client_actions_map(create_client_action_map())
+ConsoleApp::ConsoleApp() : client_actions_map(create_client_action_map()), transport(Transport::create()), identity(IDENTITY_PATH), contact_cache(CONTACTS_CACHE_PATH)
 {
+    transport->set_metrics(&request_metrics);
+    startup_timings.record("client setup");
 }
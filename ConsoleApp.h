@@ -1,63 +1,153 @@
 #pragma once
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <filesystem>
 #include <string>
 #include <sstream>
 #include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 
 #include "Util.h"
-#include "WinsockClient.h"
+#include "Transport.h"
+#include "ProtocolCodec.h"
+#include "RequestMetrics.h"
+#include "WaitingMessagesParser.h"
 
 #include "Base64Wrapper.h"
+#include "TextCodec.h"
 #include "RSAWrapper.h"
 #include "AESWrapper.h"
-
-struct Client {
-    std::vector<uint8_t> uuid;
-    std::string name;
-    std::vector<uint8_t> public_key;
-    std::vector<uint8_t> session_key;
-};
+#include "FileUploadSource.h"
+#include "FileDownloadSink.h"
+#include "ContactDirectory.h"
+#include "ContactCache.h"
+#include "IdentityStore.h"
+#include "RSAEncryptorCache.h"
+#include "RSAKeyPool.h"
+#include "InboxDecryptor.h"
+#include "MessageBatch.h"
+#include "LZCodec.h"
+#include "StartupTimings.h"
 
 // This class encapsulate the functionality of the application
 class ConsoleApp
 {
     static constexpr uint8_t CLIENT_VERSION = 2;
     static constexpr const char ME_INFO_PATH[] = "me.info";
+    static constexpr const char IDENTITY_PATH[] = "me.identity";
+    static constexpr const char CONTACTS_CACHE_PATH[] = "contacts.cache";
+    static constexpr const char METRICS_PATH[] = "metrics.prom";
+
+    // How long the server may hold a long poll of the background receiver - also bounds how long stopping it takes
+    static constexpr uint32_t LONG_POLL_TIMEOUT_MS = 5000;
+    static constexpr int RECEIVER_RETRY_DELAY_MS = 1000;
+
     typedef void (ConsoleApp::* func_ptr)();
 
+    // Declared first, so its start is the start of the client
+    StartupTimings startup_timings;
+
     // One-to-one mapping between user input and function to execute
     const std::map<std::string, func_ptr> client_actions_map;
 
+    // Phase timings of the requests of both connections - declared first so it outlives them
+    RequestMetrics request_metrics;
+
     // Object for sending requests to server
-    WinsockClient winsock_client;
+    std::unique_ptr<Transport> transport;
 
     // Client ID for this application
     // Should be initialized on startup or after registration
     std::vector<uint8_t> client_id;
 
-    // Private key in base64 representation for current client
-    std::string base64_private_key;
+    // Name, client ID and private key of this client, migrated from me.info
+    IdentityStore identity;
+
+    // Private key parsed on its first use - decrypts the symmetric keys sent to us
+    std::unique_ptr<RSAPrivateDecryptor> private_key_decryptor;
+
+    // Generates key pairs in the background while the client is not registered
+    std::unique_ptr<RSAKeyPool> key_pool;
+
+    // Decrypts the inbox on a pool of workers - created on the first inbox request
+    std::unique_ptr<InboxDecryptor> inbox_decryptor;
+
+    // Known clients by UUID and user name - initialized in client list request
+    ContactDirectory contacts;
+
+    // Client list kept on disk between runs, refreshed with deltas
+    ContactCache contact_cache;
+    bool client_list_delta_supported = true;
+
+    // Parsed public keys of the clients, by their public key index in the directory
+    RSAEncryptorCache rsa_encryptors;
+
+    // Texts and files are compressed before they are encrypted when enabled.
+    // Off by default, since clients that don't know the compressed message types can't read them
+    bool compress_messages = false;
+    LZCompressor text_compressor{ true };
+
+    // File being received from the inbox - its parts are decrypted to disk as they arrive
+    std::unique_ptr<FileDownloadSink> file_download;
+    bool file_download_started = false;
 
-    // User name to client map - initialized in client list request
-    std::map<std::string, Client> username_to_client_map;
+    // Background receiver - long polls the server on a connection of its own and feeds the received
+    // messages to the same path as option 40. Actions and received messages take turns through state_mutex
+    enum class ReceiverState : uint8_t
+    {
+        STOPPED,
+        RUNNING,
+        STOPPING, // Asked to stop - the thread exits after its current poll unless it is started again
+    };
+    std::mutex state_mutex;
+    std::thread inbox_receiver;
+    std::atomic<ReceiverState> inbox_receiver_state{ ReceiverState::STOPPED };
 
     // User mapped functions
     void register_client();
     void request_for_client_list();
     void request_for_public_key();
+    void request_for_all_public_keys();
     void request_for_waiting_messages();
+    void toggle_inbox_receiver();
     void send_text_message();
     void send_request_for_symmetric_key();
     void send_symmetric_key();
     void send_file();
+    void send_text_message_to_many();
+    void toggle_compression();
+    void show_request_metrics();
+    void save_request_metrics();
+    void toggle_request_metrics();
+    void show_startup_timings();
     void exit_client();
 
     // Helper functions
     void send_message_to_client(ClientMessageType message_type); // Unify all message requests
-    bool create_me_info_file(const std::string& username, const uint8_t* uuid) const;
-    void load_me_info_file();
+    bool send_message_batch(MessageBatch& batch, std::vector<BatchMessageResult>& results); // Many messages in one request
+    bool request_for_client_list_delta(); // Only the clients added since the cache
+    bool request_for_full_client_list();
+    // A full list replaces the directory, otherwise the entries are added to it
+    void add_client_list_entries(const ProtocolCodec::ClientListEntries& entries, bool full_list);
+    void prepare_inbox();
+    bool receive_waiting_messages(Transport& inbox_transport, const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, bool background);
+    void run_inbox_receiver(); // Body of the background receiver thread
+    void update_metric_gauges(); // Counters of the caches and the decryption pool
+    bool compress_text(const std::string& message, std::string& compressed); // False if disabled or no smaller
+    void handle_waiting_message(const WaitingMessagesParser::HeaderView& message_header, const uint8_t* content);
+    void print_inbox_record(InboxRecord& record); // Decrypted inbox messages in their original order
+    void handle_waiting_file_part(const WaitingMessagesParser::HeaderView& message_header, const uint8_t* data, size_t size, bool last);
+    bool create_me_info_file(const std::string& username, const uint8_t* uuid, const std::string& private_key) const;
+    void load_identity(); // From the binary identity, migrating me.info to it when it changed
+    RSAPrivateDecryptor* get_private_key_decryptor(); // Parsed on the first call, NULL if the key is invalid
+    void start_key_generation(); // Generate the one key pair of the next registration in the background
     bool is_registered();
 
     // Creates the user input to function map
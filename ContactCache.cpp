@@ -0,0 +1,138 @@
+#include "ContactCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "MappedFile.h"
+
+ContactCache::ContactCache(const std::string& path) : path(path)
+{
+}
+
+bool ContactCache::load(ContactDirectory& contacts)
+{
+    MappedFile file;
+    if (!file.open(path)) return false;
+
+    const uint8_t* data = file.get_data();
+    size_t size = file.get_size();
+    if (size < sizeof(ContactCacheHeader)) return false;
+
+    ContactCacheHeader file_header;
+    memcpy(&file_header, data, sizeof(file_header));
+    if (memcmp(file_header.magic, MAGIC, sizeof(MAGIC)) != 0 || file_header.format_version != FORMAT_VERSION) {
+        return false;
+    }
+
+    // Check all the records are in the file before adding any of them
+    size_t offset = sizeof(ContactCacheHeader);
+    for (uint32_t i = 0; i < file_header.count; i++) {
+        if (size - offset < sizeof(ContactCacheRecord)) return false;
+        size_t name_length = data[offset + CLIENT_ID_LENGTH];
+        offset += sizeof(ContactCacheRecord);
+        if (size - offset < name_length) return false;
+        offset += name_length;
+    }
+
+    // Names are viewed straight from the mapping while they are added
+    contacts.reserve(contacts.size() + file_header.count);
+    offset = sizeof(ContactCacheHeader);
+    for (uint32_t i = 0; i < file_header.count; i++) {
+        const uint8_t* record = data + offset;
+        size_t name_length = record[CLIENT_ID_LENGTH];
+        contacts.add(record, std::string_view(reinterpret_cast<const char*>(record + sizeof(ContactCacheRecord)), name_length));
+        offset += sizeof(ContactCacheRecord) + name_length;
+    }
+
+    header = file_header;
+    end_offset = offset;
+    return true;
+}
+
+uint64_t ContactCache::get_directory_id() const
+{
+    return end_offset != 0 ? header.directory_id : 0;
+}
+
+uint64_t ContactCache::get_cursor() const
+{
+    return end_offset != 0 ? header.cursor : 0;
+}
+
+bool ContactCache::write_records(std::ostream& stream, const ProtocolCodec::ClientListEntries& entries)
+{
+    for (size_t i = 0; i < entries.size(); i++) {
+        std::string_view name = entries[i].name();
+        ContactCacheRecord record;
+        memcpy(record.client_id, entries[i].client_id(), CLIENT_ID_LENGTH);
+        record.name_length = static_cast<uint8_t>(name.size());
+        stream.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        stream.write(name.data(), record.name_length);
+    }
+    return static_cast<bool>(stream);
+}
+
+bool ContactCache::append(uint64_t cursor, const ProtocolCodec::ClientListEntries& entries)
+{
+    if (end_offset == 0) {
+        return rewrite(header.directory_id, cursor, entries);
+    }
+    if (header.count + static_cast<uint64_t>(entries.size()) > UINT32_MAX) return false;
+
+    std::fstream stream(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!stream.is_open()) return false;
+
+    // Records first and then the header, so an interrupted append leaves the old cache valid
+    stream.seekp(static_cast<std::streamoff>(end_offset));
+    if (!write_records(stream, entries)) return false;
+    uint64_t new_end_offset = static_cast<uint64_t>(stream.tellp());
+
+    ContactCacheHeader new_header = header;
+    new_header.cursor = cursor;
+    new_header.count += static_cast<uint32_t>(entries.size());
+    stream.seekp(0);
+    stream.write(reinterpret_cast<const char*>(&new_header), sizeof(new_header));
+    stream.flush();
+    if (!stream) return false;
+
+    header = new_header;
+    end_offset = new_end_offset;
+    return true;
+}
+
+bool ContactCache::rewrite(uint64_t directory_id, uint64_t cursor, const ProtocolCodec::ClientListEntries& entries)
+{
+    if (entries.size() > UINT32_MAX) return false;
+
+    ContactCacheHeader new_header{};
+    memcpy(new_header.magic, MAGIC, sizeof(MAGIC));
+    new_header.format_version = FORMAT_VERSION;
+    new_header.directory_id = directory_id;
+    new_header.cursor = cursor;
+    new_header.count = static_cast<uint32_t>(entries.size());
+
+    // Write a new file and move it over the old one
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+        if (!stream.is_open()) return false;
+        stream.write(reinterpret_cast<const char*>(&new_header), sizeof(new_header));
+        if (!write_records(stream, entries)) return false;
+        end_offset = static_cast<uint64_t>(stream.tellp());
+        stream.close();
+        if (!stream) {
+            end_offset = 0;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        end_offset = 0;
+        return false;
+    }
+    header = new_header;
+    return true;
+}
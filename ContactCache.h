@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "ContactDirectory.h"
+#include "ProtocolCodec.h"
+
+#pragma pack(push, 1)
+
+// Start of the cache file - followed by count records
+struct ContactCacheHeader
+{
+	uint8_t magic[4];
+	uint32_t format_version;
+	uint64_t directory_id; // Server directory the records came from
+	uint64_t cursor;       // Server directory version the records are up to date with
+	uint32_t count;
+};
+
+// Followed by name_length bytes of the name
+struct ContactCacheRecord
+{
+	uint8_t client_id[CLIENT_ID_LENGTH];
+	uint8_t name_length;
+};
+
+#pragma pack(pop)
+
+// On-disk copy of the client list, so the directory survives restarts and a refresh
+// only needs the clients added since the stored cursor.
+// The file is memory mapped once at startup, and new records are appended to it
+class ContactCache
+{
+	static constexpr uint8_t MAGIC[4] = { 'M', 'U', 'C', 'D' };
+	static constexpr uint32_t FORMAT_VERSION = 1;
+
+	std::string path;
+	ContactCacheHeader header{};
+
+	// End of the valid records in the file - zero if there is no valid file
+	uint64_t end_offset = 0;
+
+	// Append the records of the entries to the stream
+	static bool write_records(std::ostream& stream, const ProtocolCodec::ClientListEntries& entries);
+
+public:
+	explicit ContactCache(const std::string& path);
+
+	// Add the cached clients to the directory. Returns false if there is no valid cache
+	bool load(ContactDirectory& contacts);
+
+	// Zero if nothing is cached
+	uint64_t get_directory_id() const;
+	uint64_t get_cursor() const;
+
+	// Add clients received in a delta and move the cursor
+	bool append(uint64_t cursor, const ProtocolCodec::ClientListEntries& entries);
+
+	// Replace the whole cache with a full list
+	bool rewrite(uint64_t directory_id, uint64_t cursor, const ProtocolCodec::ClientListEntries& entries);
+};
@@ -0,0 +1,165 @@
+#include "ContactDirectory.h"
+
+#include <cstring>
+#include <functional>
+
+ContactDirectory::ContactDirectory() :
+    uuid_index(MIN_INDEX_CAPACITY, EMPTY_SLOT), name_index(MIN_INDEX_CAPACITY, EMPTY_SLOT)
+{
+}
+
+size_t ContactDirectory::hash_uuid(const uint8_t* uuid)
+{
+    // UUIDs are random, mixing both halves is enough to spread them
+    uint64_t low, high;
+    memcpy(&low, uuid, sizeof(low));
+    memcpy(&high, uuid + sizeof(low), sizeof(high));
+    uint64_t hash = (low ^ (high * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+    return static_cast<size_t>(hash ^ (hash >> 31));
+}
+
+size_t ContactDirectory::hash_name(std::string_view name)
+{
+    return std::hash<std::string_view>()(name);
+}
+
+size_t ContactDirectory::find_uuid_slot(const uint8_t* uuid) const
+{
+    size_t mask = uuid_index.size() - 1;
+    size_t slot = hash_uuid(uuid) & mask;
+
+    // Linear probing - the table is never full
+    while (uuid_index[slot] != EMPTY_SLOT && memcmp(contacts[uuid_index[slot]].uuid, uuid, CLIENT_ID_LENGTH) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+size_t ContactDirectory::find_name_slot(std::string_view name) const
+{
+    size_t mask = name_index.size() - 1;
+    size_t slot = hash_name(name) & mask;
+
+    while (name_index[slot] != EMPTY_SLOT && get_name(contacts[name_index[slot]]) != name) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void ContactDirectory::rehash(size_t count)
+{
+    size_t capacity = MIN_INDEX_CAPACITY;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    if (capacity <= uuid_index.size()) return;
+
+    uuid_index.assign(capacity, EMPTY_SLOT);
+    name_index.assign(capacity, EMPTY_SLOT);
+    for (uint32_t i = 0; i < contacts.size(); i++) {
+        uuid_index[find_uuid_slot(contacts[i].uuid)] = i;
+        name_index[find_name_slot(get_name(contacts[i]))] = i;
+    }
+}
+
+void ContactDirectory::reserve(size_t count)
+{
+    contacts.reserve(count);
+    rehash(count);
+}
+
+Contact& ContactDirectory::add(const uint8_t* uuid, std::string_view name)
+{
+    if (name.size() > UINT8_MAX) {
+        name = name.substr(0, UINT8_MAX);
+    }
+
+    // Already known by name or UUID - keep the existing contact and its keys
+    size_t name_slot = find_name_slot(name);
+    if (name_index[name_slot] != EMPTY_SLOT) return contacts[name_index[name_slot]];
+    size_t uuid_slot = find_uuid_slot(uuid);
+    if (uuid_index[uuid_slot] != EMPTY_SLOT) return contacts[uuid_index[uuid_slot]];
+
+    Contact contact{};
+    memcpy(contact.uuid, uuid, CLIENT_ID_LENGTH);
+    contact.name_offset = static_cast<uint32_t>(names.size());
+    contact.name_length = static_cast<uint8_t>(name.size());
+    contact.public_key_index = NO_PUBLIC_KEY;
+    contact.session_index = NO_SESSION;
+    names.append(name.data(), name.size());
+
+    uint32_t index = static_cast<uint32_t>(contacts.size());
+    contacts.push_back(contact);
+
+    // Keep the tables at most half full
+    if (contacts.size() * 2 > uuid_index.size()) {
+        rehash(contacts.size());
+    }
+    else {
+        uuid_index[uuid_slot] = index;
+        name_index[name_slot] = index;
+    }
+    return contacts[index];
+}
+
+Contact* ContactDirectory::find_by_uuid(const uint8_t* uuid)
+{
+    uint32_t index = uuid_index[find_uuid_slot(uuid)];
+    return index != EMPTY_SLOT ? &contacts[index] : NULL;
+}
+
+Contact* ContactDirectory::find_by_name(std::string_view name)
+{
+    uint32_t index = name_index[find_name_slot(name)];
+    return index != EMPTY_SLOT ? &contacts[index] : NULL;
+}
+
+const Contact& ContactDirectory::at(size_t index) const
+{
+    return contacts[index];
+}
+
+std::string_view ContactDirectory::get_name(const Contact& contact) const
+{
+    return std::string_view(names.data() + contact.name_offset, contact.name_length);
+}
+
+const uint8_t* ContactDirectory::get_public_key(const Contact& contact) const
+{
+    if (contact.public_key_index == NO_PUBLIC_KEY) return NULL;
+    return &public_keys[static_cast<size_t>(contact.public_key_index) * PUBLIC_KEY_LENGTH];
+}
+
+void ContactDirectory::set_public_key(Contact& contact, const uint8_t* public_key)
+{
+    // Keys are only stored for contacts we talk to
+    if (contact.public_key_index == NO_PUBLIC_KEY) {
+        contact.public_key_index = static_cast<uint32_t>(public_keys.size() / PUBLIC_KEY_LENGTH);
+        public_keys.resize(public_keys.size() + PUBLIC_KEY_LENGTH);
+    }
+    memcpy(&public_keys[static_cast<size_t>(contact.public_key_index) * PUBLIC_KEY_LENGTH], public_key, PUBLIC_KEY_LENGTH);
+}
+
+void ContactDirectory::set_session_key(Contact& contact, const uint8_t* session_key)
+{
+    memcpy(contact.session_key, session_key, AESWrapper::DEFAULT_KEYLENGTH);
+    contact.has_session_key = true;
+
+    // Expand the key schedules once for all the messages of this session
+    if (contact.session_index == NO_SESSION) {
+        contact.session_index = static_cast<uint32_t>(session_ciphers.size());
+        session_ciphers.emplace_back();
+    }
+    session_ciphers[contact.session_index] = std::make_unique<AESSessionCipher>(session_key, AESWrapper::DEFAULT_KEYLENGTH);
+}
+
+AESSessionCipher* ContactDirectory::get_session_cipher(const Contact& contact)
+{
+    if (contact.session_index == NO_SESSION) return NULL;
+    return session_ciphers[contact.session_index].get();
+}
+
+size_t ContactDirectory::size() const
+{
+    return contacts.size();
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ProtocolHeaders.h"
+#include "AESWrapper.h"
+
+// One entry of the contact directory - a fixed size record without heap members
+struct Contact
+{
+	uint8_t uuid[CLIENT_ID_LENGTH];
+	uint32_t name_offset;      // Name in the directory names arena
+	uint32_t public_key_index; // Key in the directory public keys table, or NO_PUBLIC_KEY
+	uint32_t session_index;    // Cipher in the directory session ciphers, or NO_SESSION
+	uint8_t name_length;
+	bool has_session_key;
+	uint8_t session_key[AESWrapper::DEFAULT_KEYLENGTH];
+};
+
+// Contacts received in the client list, indexed by UUID and by name.
+// Contacts are kept in one contiguous vector and looked up through open addressing hash
+// tables of contact indexes, so a lookup never allocates and the per contact overhead is small.
+// Contact pointers are valid until the next call to add()
+class ContactDirectory
+{
+public:
+	static constexpr uint32_t NO_PUBLIC_KEY = UINT32_MAX;
+	static constexpr uint32_t NO_SESSION = UINT32_MAX;
+
+private:
+	static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+	static constexpr size_t MIN_INDEX_CAPACITY = 16;
+
+	std::vector<Contact> contacts;
+	std::string names;
+	std::vector<uint8_t> public_keys; // PUBLIC_KEY_LENGTH bytes per contact with a key
+
+	// Ciphers of the contacts we have a session key with - kept apart so the records stay small
+	std::vector<std::unique_ptr<AESSessionCipher>> session_ciphers;
+
+	// Hash tables of contact indexes - capacity is a power of two and at most half full
+	std::vector<uint32_t> uuid_index;
+	std::vector<uint32_t> name_index;
+
+	static size_t hash_uuid(const uint8_t* uuid);
+	static size_t hash_name(std::string_view name);
+
+	// Slot of the contact in the index, or of the empty slot where it should go
+	size_t find_uuid_slot(const uint8_t* uuid) const;
+	size_t find_name_slot(std::string_view name) const;
+
+	// Grow the indexes to hold at least count contacts and reinsert all of them
+	void rehash(size_t count);
+
+public:
+	ContactDirectory();
+
+	// Make room for count contacts up front
+	void reserve(size_t count);
+
+	// Add a contact unless its name or UUID is already known. Returns the contact
+	Contact& add(const uint8_t* uuid, std::string_view name);
+
+	// Returns NULL if not found
+	Contact* find_by_uuid(const uint8_t* uuid);
+	Contact* find_by_name(std::string_view name);
+
+	// Contacts in the order they were added
+	const Contact& at(size_t index) const;
+
+	std::string_view get_name(const Contact& contact) const;
+
+	// Public key of the contact (PUBLIC_KEY_LENGTH bytes) or NULL if it wasn't received yet
+	const uint8_t* get_public_key(const Contact& contact) const;
+	void set_public_key(Contact& contact, const uint8_t* public_key);
+
+	// Also creates the contact's session cipher
+	void set_session_key(Contact& contact, const uint8_t* session_key);
+
+	// Session cipher of the contact or NULL if there is no session key yet
+	AESSessionCipher* get_session_cipher(const Contact& contact);
+
+	size_t size() const;
+};
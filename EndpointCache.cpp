@@ -0,0 +1,120 @@
+#include "EndpointCache.h"
+#include "Util.h"
+
+#include <cstring>
+#include <iostream>
+
+EndpointCache::EndpointCache(const std::string& path) : path(path)
+{
+}
+
+bool EndpointCache::load_server_info()
+{
+    // A stat per request instead of reading and parsing the file
+    std::error_code error;
+    std::filesystem::file_time_type write_time = std::filesystem::last_write_time(path, error);
+    if (error) {
+        std::cerr << "File " << path << " Not found" << std::endl;
+        return false;
+    }
+    if (loaded && write_time == file_time) return true;
+
+    std::string file_content;
+    if (!Util::read_file(path, file_content)) {
+        std::cerr << "File " << path << " Not found" << std::endl;
+        return false;
+    }
+
+    // find the colon seperator index
+    size_t colon_index = file_content.find(":");
+    if (colon_index == std::string::npos) {
+        std::cerr << "File " << path << " has no port" << std::endl;
+        return false;
+    }
+
+    // copy the servername, and the port section - without the trailing line break
+    std::string new_servername = file_content.substr(0, colon_index);
+    std::string new_port = file_content.substr(colon_index + 1);
+    new_port.erase(new_port.find_last_not_of(" \r\n\t") + 1);
+
+    // Another server - its addresses have to be resolved
+    if (new_servername != servername || new_port != port) {
+        servername = new_servername;
+        port = new_port;
+        addresses.clear();
+    }
+
+    file_time = write_time;
+    loaded = true;
+    return true;
+}
+
+bool EndpointCache::resolve()
+{
+    if (!addresses.empty()) {
+        hits++;
+        return true;
+    }
+    misses++;
+
+    struct addrinfo hints{};
+    struct addrinfo* result = NULL;
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    // Resolve the server address and port
+    int iResult = getaddrinfo(servername.c_str(), port.c_str(), &hints, &result);
+    if (iResult != 0) {
+        std::cerr << "getaddrinfo failed with error: " << gai_strerror(iResult) << std::endl;
+        return false;
+    }
+
+    // Keep copies, so the list can be freed right away
+    for (struct addrinfo* ptr = result; ptr != NULL; ptr = ptr->ai_next) {
+        if (ptr->ai_addrlen > sizeof(sockaddr_storage)) continue;
+
+        Endpoint endpoint{};
+        endpoint.family = ptr->ai_family;
+        endpoint.socktype = ptr->ai_socktype;
+        endpoint.protocol = ptr->ai_protocol;
+        memcpy(&endpoint.address, ptr->ai_addr, ptr->ai_addrlen);
+        endpoint.address_length = static_cast<socklen_t>(ptr->ai_addrlen);
+        addresses.push_back(endpoint);
+    }
+    freeaddrinfo(result);
+
+    return !addresses.empty();
+}
+
+bool EndpointCache::is_resolved() const
+{
+    return !addresses.empty();
+}
+
+void EndpointCache::invalidate()
+{
+    addresses.clear();
+}
+
+const std::vector<Endpoint>& EndpointCache::get_addresses() const
+{
+    return addresses;
+}
+
+uint64_t EndpointCache::get_hits() const
+{
+    return hits;
+}
+
+uint64_t EndpointCache::get_misses() const
+{
+    return misses;
+}
+
+double EndpointCache::get_hit_ratio() const
+{
+    uint64_t lookups = hits + misses;
+    return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+}
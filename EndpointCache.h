@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <sys/socket.h>
+#endif
+
+// One resolved address of the server, copied out of the getaddrinfo list
+struct Endpoint
+{
+	int family;
+	int socktype;
+	int protocol;
+	struct sockaddr_storage address;
+	socklen_t address_length;
+};
+
+// Server address from server.info and its resolved addresses, kept between requests.
+// The file is read again only when its modification time changes, and the server is
+// resolved again only when the file names another server or when invalidate is called
+class EndpointCache
+{
+	std::string path;
+
+	// Last version of the file that was read
+	bool loaded = false;
+	std::filesystem::file_time_type file_time{};
+
+	std::string servername;
+	std::string port;
+
+	// Empty until resolved
+	std::vector<Endpoint> addresses;
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+public:
+	explicit EndpointCache(const std::string& path);
+
+	// Read server info file if it changed since the last call. Returns false if it can't be read
+	bool load_server_info();
+
+	// Resolve the server unless its addresses are cached - counted as a hit or a miss.
+	// Returns false if the server can't be resolved
+	bool resolve();
+
+	// True if resolve will use cached addresses
+	bool is_resolved() const;
+
+	// Forget the resolved addresses - none of them could be connected
+	void invalidate();
+
+	const std::vector<Endpoint>& get_addresses() const;
+
+	uint64_t get_hits() const;
+	uint64_t get_misses() const;
+
+	// Fraction of resolves served from the cache, 0 before the first one
+	double get_hit_ratio() const;
+};
@@ -0,0 +1,64 @@
+#include "EpollLoop.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+EpollLoop::EpollLoop()
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        std::cerr << "epoll_create1 failed with error: " << strerror(errno) << std::endl;
+    }
+}
+
+EpollLoop::~EpollLoop()
+{
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+}
+
+bool EpollLoop::add(int fd, uint32_t events, EpollHandler* handler)
+{
+    struct epoll_event event{};
+    event.events = events;
+    event.data.ptr = handler;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool EpollLoop::modify(int fd, uint32_t events, EpollHandler* handler)
+{
+    struct epoll_event event{};
+    event.events = events;
+    event.data.ptr = handler;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+void EpollLoop::remove(int fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int EpollLoop::run_once(int timeout_ms)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (ready < 0) {
+        if (errno == EINTR) return 0;
+        std::cerr << "epoll_wait failed with error: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    for (int i = 0; i < ready; i++) {
+        static_cast<EpollHandler*>(events[i].data.ptr)->on_events(events[i].events);
+    }
+
+    return ready;
+}
+
+#endif // !_WIN32
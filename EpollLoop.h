@@ -0,0 +1,40 @@
+#pragma once
+#ifndef _WIN32
+
+#include <cstdint>
+#include <sys/epoll.h>
+
+// Object that gets notified when its file descriptor is ready
+class EpollHandler
+{
+public:
+	virtual ~EpollHandler() = default;
+
+	// Called from EpollLoop::run_once with the ready EPOLL* event flags
+	virtual void on_events(uint32_t events) = 0;
+};
+
+// Single threaded epoll event loop - one loop can drive any number of sockets
+class EpollLoop
+{
+	static constexpr int MAX_EVENTS = 256;
+
+	int epoll_fd = -1;
+
+	EpollLoop(const EpollLoop&) = delete;
+	EpollLoop& operator=(const EpollLoop&) = delete;
+
+public:
+	EpollLoop();
+	~EpollLoop();
+
+	// Register, update or unregister a file descriptor
+	bool add(int fd, uint32_t events, EpollHandler* handler);
+	bool modify(int fd, uint32_t events, EpollHandler* handler);
+	void remove(int fd);
+
+	// Wait up to timeout_ms for events and dispatch them, returns the number of dispatched events or -1 on error
+	int run_once(int timeout_ms);
+};
+
+#endif // !_WIN32
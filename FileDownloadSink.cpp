@@ -0,0 +1,140 @@
+#include "FileDownloadSink.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+FileDownloadSink::FileDownloadSink(const std::string& file_path, const unsigned char* key, unsigned int key_length, bool compressed) :
+    file_path(file_path), decryptor(key, key_length), compressed(compressed)
+{
+}
+
+FileDownloadSink::~FileDownloadSink()
+{
+    if (file_stream.is_open()) {
+        file_stream.close();
+    }
+}
+
+bool FileDownloadSink::open(uint64_t ciphertext_size)
+{
+    // Create the file and preallocate it so the writes don't keep growing it
+    {
+        std::ofstream create_stream(file_path, std::ios::binary | std::ios::trunc);
+        if (!create_stream.is_open()) return false;
+    }
+    std::error_code error;
+    std::filesystem::resize_file(file_path, ciphertext_size, error);
+    if (error) return false;
+
+    // Reopen without truncating the preallocated file
+    file_stream.open(file_path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file_stream.is_open()) return false;
+
+    buffer.resize(WRITE_CHUNK_SIZE + AESStreamDecryptor::BLOCKSIZE);
+    buffered = 0;
+    bytes_written = 0;
+    decryptor.restart();
+    if (compressed) {
+        // Parts of up to WRITE_CHUNK_SIZE bytes are decrypted here, plus a block that was held back
+        decrypted.resize(WRITE_CHUNK_SIZE + AESStreamDecryptor::BLOCKSIZE);
+        decompressor.restart();
+    }
+    return true;
+}
+
+bool FileDownloadSink::flush()
+{
+    if (buffered == 0) return true;
+
+    file_stream.write(reinterpret_cast<const char*>(buffer.data()), buffered);
+    if (!file_stream) return false;
+    bytes_written += buffered;
+    buffered = 0;
+    return true;
+}
+
+bool FileDownloadSink::append(const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        if (buffered == WRITE_CHUNK_SIZE && !flush()) return false;
+        size_t part_size = std::min(size, WRITE_CHUNK_SIZE - buffered);
+        memcpy(buffer.data() + buffered, data, part_size);
+        buffered += part_size;
+        data += part_size;
+        size -= part_size;
+    }
+    return true;
+}
+
+bool FileDownloadSink::decompress(size_t size)
+{
+    return decompressor.feed(decrypted.data(), size, [this](const uint8_t* data, size_t data_size) {
+        return append(data, data_size);
+    });
+}
+
+bool FileDownloadSink::write(const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        size_t part_size = std::min(size, WRITE_CHUNK_SIZE);
+
+        if (compressed) {
+            // Decrypt aside and decompress into the write buffer
+            if (!decompress(decryptor.update(data, part_size, decrypted.data()))) return false;
+        }
+        else {
+            // The decryptor may output a held back block on top of the part
+            if (buffered + part_size + AESStreamDecryptor::BLOCKSIZE > buffer.size()) {
+                if (!flush()) return false;
+            }
+            buffered += decryptor.update(data, part_size, buffer.data() + buffered);
+        }
+        data += part_size;
+        size -= part_size;
+    }
+    return true;
+}
+
+bool FileDownloadSink::finish()
+{
+    if (buffered + AESStreamDecryptor::BLOCKSIZE > buffer.size()) {
+        if (!flush()) return false;
+    }
+
+    try {
+        if (compressed) {
+            if (!decompress(decryptor.final(decrypted.data())) || !decompressor.is_complete()) return false;
+        }
+        else {
+            buffered += decryptor.final(buffer.data() + buffered);
+        }
+    }
+    catch (const std::invalid_argument&) {
+        return false;
+    }
+    if (!flush()) return false;
+
+    // Drop the preallocated bytes past the plaintext
+    file_stream.close();
+    std::error_code error;
+    std::filesystem::resize_file(file_path, bytes_written, error);
+    return !error;
+}
+
+void FileDownloadSink::abort()
+{
+    if (file_stream.is_open()) {
+        file_stream.close();
+    }
+    std::error_code error;
+    std::filesystem::remove(file_path, error);
+}
+
+const std::string& FileDownloadSink::get_file_path() const
+{
+    return file_path;
+}
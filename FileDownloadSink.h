@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "AESWrapper.h"
+#include "LZCodec.h"
+
+// Decrypts a received file straight to disk as its ciphertext streams in.
+// The plaintext is collected into large sequential writes, and the file is preallocated
+// from the ciphertext size, so memory use doesn't depend on the file size.
+// A compressed file is decompressed as it is decrypted
+class FileDownloadSink
+{
+	// Plaintext collected before it is written out
+	static constexpr size_t WRITE_CHUNK_SIZE = 1024 * 1024;
+
+	std::string file_path;
+	std::fstream file_stream;
+	AESStreamDecryptor decryptor;
+
+	// Decrypted bytes waiting to be written, with room for a held back block
+	std::vector<uint8_t> buffer;
+	size_t buffered = 0;
+	uint64_t bytes_written = 0;
+
+	// Set for compressed files - decrypted bytes go through the decompressor on their way to buffer
+	bool compressed;
+	LZDecompressor decompressor;
+	std::vector<uint8_t> decrypted;
+
+	FileDownloadSink(const FileDownloadSink&) = delete;
+	FileDownloadSink& operator=(const FileDownloadSink&) = delete;
+
+	// Write the buffered plaintext to the file
+	bool flush();
+
+	// Buffer decompressed plaintext, flushing as the buffer fills
+	bool append(const uint8_t* data, size_t size);
+
+	// Pass decrypted bytes on - through the decompressor if the file is compressed
+	bool decompress(size_t size);
+
+public:
+	FileDownloadSink(const std::string& file_path, const unsigned char* key, unsigned int key_length, bool compressed = false);
+	~FileDownloadSink();
+
+	// Create the file with room for ciphertext_size bytes (the plaintext is never longer unless it was compressed)
+	bool open(uint64_t ciphertext_size);
+
+	// Decrypt the next part of the ciphertext
+	bool write(const uint8_t* data, size_t size);
+
+	// Remove the padding, write the rest and truncate the file to the plaintext length.
+	// Fails if the ciphertext was truncated, can't be decrypted with the key or doesn't decompress
+	bool finish();
+
+	// Give up on the file and remove what was written
+	void abort();
+
+	const std::string& get_file_path() const;
+};
@@ -0,0 +1,224 @@
+#include "FileUploadSource.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+FileUploadSource::FileUploadSource(const std::string& file_path, const unsigned char* key, unsigned int key_length, bool compress) :
+    file_path(file_path), encryptor(key, key_length), compress(compress)
+{
+}
+
+FileUploadSource::~FileUploadSource()
+{
+    stop_worker();
+}
+
+bool FileUploadSource::open()
+{
+    std::error_code error;
+    file_size = std::filesystem::file_size(file_path, error);
+    if (error) return false;
+
+    file_stream.open(file_path, std::ios::binary);
+    if (!file_stream.is_open()) return false;
+
+    if (compress) {
+        read_buffer.resize(CHUNK_SIZE);
+        if (!measure_compressed_size()) return false;
+        compress = compressed_size < file_size;
+    }
+
+    // Room for a full chunk plus the padding block added to the last one,
+    // or for a compressed chunk with the bytes held back from the one before it
+    size_t chunk_capacity = compress ? LZCompressor::max_compressed_size(CHUNK_SIZE) + AESStreamEncryptor::BLOCKSIZE : CHUNK_SIZE;
+    for (Chunk& chunk : chunks) {
+        chunk.data.resize(chunk_capacity + AESStreamEncryptor::BLOCKSIZE);
+    }
+
+    start_worker();
+    return true;
+}
+
+bool FileUploadSource::measure_compressed_size()
+{
+    std::vector<uint8_t> compressed;
+    compressor.begin(compressed);
+    compressed_size = compressed.size();
+
+    // Compress chunk by chunk like the worker will, keeping only the sizes
+    for (uint64_t bytes_read = 0; bytes_read < file_size; )
+    {
+        size_t read_size = static_cast<size_t>(std::min<uint64_t>(CHUNK_SIZE, file_size - bytes_read));
+        file_stream.read(reinterpret_cast<char*>(read_buffer.data()), read_size);
+        if (static_cast<size_t>(file_stream.gcount()) != read_size) return false;
+        bytes_read += read_size;
+
+        compressed.clear();
+        compressor.update(read_buffer.data(), read_size, compressed);
+        compressed_size += compressed.size();
+    }
+    compressed.clear();
+    compressor.end(compressed);
+    compressed_size += compressed.size();
+
+    file_stream.clear();
+    file_stream.seekg(0);
+    return static_cast<bool>(file_stream);
+}
+
+uint64_t FileUploadSource::get_encrypted_size() const
+{
+    return AESStreamEncryptor::encryptedSize(static_cast<size_t>(compress ? compressed_size : file_size));
+}
+
+bool FileUploadSource::is_compressed() const
+{
+    return compress;
+}
+
+bool FileUploadSource::read_plaintext(Chunk& chunk, size_t read_size, bool first, bool last, size_t& plaintext_size)
+{
+    if (!compress) {
+        file_stream.read(reinterpret_cast<char*>(chunk.data.data()), read_size);
+        plaintext_size = read_size;
+        return static_cast<size_t>(file_stream.gcount()) == read_size;
+    }
+
+    file_stream.read(reinterpret_cast<char*>(read_buffer.data()), read_size);
+    if (static_cast<size_t>(file_stream.gcount()) != read_size) return false;
+
+    // Compress behind the bytes held back from the previous chunk
+    if (first) compressor.begin(pending_plaintext);
+    compressor.update(read_buffer.data(), read_size, pending_plaintext);
+    if (last) compressor.end(pending_plaintext);
+
+    // Encrypt whole AES blocks only, until the last chunk
+    plaintext_size = last ? pending_plaintext.size() : pending_plaintext.size() - pending_plaintext.size() % AESStreamEncryptor::BLOCKSIZE;
+    memcpy(chunk.data.data(), pending_plaintext.data(), plaintext_size);
+    pending_plaintext.erase(pending_plaintext.begin(), pending_plaintext.begin() + plaintext_size);
+    return true;
+}
+
+void FileUploadSource::start_worker()
+{
+    worker = std::thread(&FileUploadSource::produce_chunks, this);
+}
+
+void FileUploadSource::stop_worker()
+{
+    if (!worker.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(chunks_mutex);
+        stopping = true;
+    }
+    chunks_cv.notify_all();
+    worker.join();
+    stopping = false;
+}
+
+void FileUploadSource::produce_chunks()
+{
+    uint64_t bytes_read = 0;
+    size_t index = 0;
+
+    while (true)
+    {
+        Chunk& chunk = chunks[index];
+
+        // Wait until the chunk was sent and its buffer is free again
+        {
+            std::unique_lock<std::mutex> lock(chunks_mutex);
+            chunks_cv.wait(lock, [&] { return !chunk.ready || stopping; });
+            if (stopping) return;
+        }
+
+        // Read the next part of the file
+        size_t read_size = static_cast<size_t>(std::min<uint64_t>(CHUNK_SIZE, file_size - bytes_read));
+        bool first = bytes_read == 0;
+        bytes_read += read_size;
+        bool last = bytes_read == file_size;
+        size_t plaintext_size = 0;
+        if (!read_plaintext(chunk, read_size, first, last, plaintext_size)) {
+            std::lock_guard<std::mutex> lock(chunks_mutex);
+            failed = true;
+            chunks_cv.notify_all();
+            return;
+        }
+
+        // Encrypt it in place, the last part gets the padding
+        size_t encrypted_size = plaintext_size;
+        if (last) {
+            encrypted_size = encryptor.final(chunk.data.data(), plaintext_size);
+        }
+        else {
+            encryptor.update(chunk.data.data(), plaintext_size);
+        }
+
+        // Hand it over to the sender
+        {
+            std::lock_guard<std::mutex> lock(chunks_mutex);
+            chunk.size = encrypted_size;
+            chunk.last = last;
+            chunk.ready = true;
+        }
+        chunks_cv.notify_all();
+
+        if (last) return;
+        index = (index + 1) % CHUNK_COUNT;
+    }
+}
+
+bool FileUploadSource::next(ConstBuffer& buffer)
+{
+    std::unique_lock<std::mutex> lock(chunks_mutex);
+
+    // The previously handed out chunk was sent - give its buffer back to the worker
+    if (chunk_in_use) {
+        chunks[next_chunk].ready = false;
+        chunk_in_use = false;
+        next_chunk = (next_chunk + 1) % CHUNK_COUNT;
+        chunks_cv.notify_all();
+    }
+
+    if (finished) {
+        buffer = { NULL, 0 };
+        return true;
+    }
+
+    // Wait for the worker to encrypt the next chunk
+    Chunk& chunk = chunks[next_chunk];
+    chunks_cv.wait(lock, [&] { return chunk.ready || failed; });
+    if (!chunk.ready) return false;
+
+    buffer = { chunk.data.data(), chunk.size };
+    chunk_in_use = true;
+    finished = chunk.last;
+    return true;
+}
+
+bool FileUploadSource::rewind()
+{
+    stop_worker();
+
+    // Start over from the beginning of the file with a fresh cipher
+    for (Chunk& chunk : chunks) {
+        chunk.ready = false;
+        chunk.last = false;
+        chunk.size = 0;
+    }
+    next_chunk = 0;
+    chunk_in_use = false;
+    finished = false;
+    failed = false;
+
+    file_stream.clear();
+    file_stream.seekg(0);
+    if (!file_stream) return false;
+    encryptor.restart();
+    pending_plaintext.clear();
+
+    start_worker();
+    return true;
+}
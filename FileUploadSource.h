@@ -0,0 +1,91 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AESWrapper.h"
+#include "LZCodec.h"
+#include "Transport.h"
+
+// Streams a file as AES-CBC ciphertext into a request payload.
+// A worker thread reads and encrypts the next chunk while the transport sends the current one,
+// so disk, crypto and network overlap and memory use doesn't depend on the file size.
+// The file can be compressed before it is encrypted - see LZCompressor
+class FileUploadSource : public PayloadSource
+{
+	// Plaintext read per chunk - a multiple of the AES block size
+	static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+	// Number of chunks in the pipeline (double buffering)
+	static constexpr size_t CHUNK_COUNT = 2;
+
+	struct Chunk
+	{
+		std::vector<uint8_t> data;
+		size_t size = 0;
+		bool ready = false; // Encrypted and waiting to be sent
+		bool last = false;
+	};
+
+	std::string file_path;
+	std::ifstream file_stream;
+	uint64_t file_size = 0;
+	AESStreamEncryptor encryptor;
+
+	// Compression - the compressed size is found by a first pass over the file, since the
+	// payload size is sent before the payload. Compressed bytes wait in pending_plaintext
+	// until a whole number of AES blocks can be encrypted
+	bool compress;
+	uint64_t compressed_size = 0;
+	LZCompressor compressor;
+	std::vector<uint8_t> read_buffer;
+	std::vector<uint8_t> pending_plaintext;
+
+	std::mutex chunks_mutex;
+	std::condition_variable chunks_cv;
+	Chunk chunks[CHUNK_COUNT];
+	std::thread worker;
+	bool stopping = false;
+	bool failed = false;
+
+	// Index of the next chunk to hand out, and whether the previous one is still being sent
+	size_t next_chunk = 0;
+	bool chunk_in_use = false;
+	bool finished = false;
+
+	FileUploadSource(const FileUploadSource&) = delete;
+	FileUploadSource& operator=(const FileUploadSource&) = delete;
+
+	// Worker thread - reads and encrypts chunks as long as there is a free buffer
+	void produce_chunks();
+
+	// Read the next part of the file into the chunk, compressed if enabled. Returns its plaintext size
+	bool read_plaintext(Chunk& chunk, size_t read_size, bool first, bool last, size_t& plaintext_size);
+
+	// Size of the file once compressed, reading it through once
+	bool measure_compressed_size();
+
+	void start_worker();
+	void stop_worker();
+
+public:
+	FileUploadSource(const std::string& file_path, const unsigned char* key, unsigned int key_length, bool compress = false);
+	~FileUploadSource() override;
+
+	// Open the file and start encrypting its first chunks.
+	// Compression is dropped if it doesn't make the file smaller
+	bool open();
+
+	// Size of the ciphertext that will be produced, known up front from the padded length
+	uint64_t get_encrypted_size() const;
+
+	// True if the file is sent compressed
+	bool is_compressed() const;
+
+	bool next(ConstBuffer& buffer) override;
+	bool rewind() override;
+};
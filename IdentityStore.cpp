@@ -0,0 +1,190 @@
+#include "IdentityStore.h"
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "TextCodec.h"
+#include "Util.h"
+
+namespace
+{
+    // Checksummed bytes start after the checksum field
+    constexpr size_t CHECKSUM_OFFSET = offsetof(IdentityFileHeader, checksum) + sizeof(uint32_t);
+
+    // Line of text starting at position, without its line break - position moves past it
+    std::string_view read_line(std::string_view text, size_t& position)
+    {
+        size_t end = text.find('\n', position);
+        if (end == std::string_view::npos) end = text.size();
+        std::string_view line = text.substr(position, end - position);
+        position = end < text.size() ? end + 1 : end;
+
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+            line.remove_suffix(1);
+        }
+        return line;
+    }
+}
+
+IdentityStore::IdentityStore(const std::string& path) : path(path)
+{
+}
+
+uint32_t IdentityStore::checksum(const uint8_t* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool IdentityStore::get_source_stamp(const std::string& source_path, uint64_t& size, int64_t& time)
+{
+    std::error_code error;
+    size = static_cast<uint64_t>(std::filesystem::file_size(source_path, error));
+    if (error) return false;
+    time = static_cast<int64_t>(std::filesystem::last_write_time(source_path, error).time_since_epoch().count());
+    return !error;
+}
+
+bool IdentityStore::build_image(std::string_view name, const uint8_t* client_id, const std::string& private_key, const std::string& source_path, std::vector<uint8_t>& out)
+{
+    if (name.size() > UINT8_MAX || private_key.empty() || private_key.size() > UINT16_MAX) return false;
+
+    IdentityFileHeader new_header{};
+    memcpy(new_header.magic, MAGIC, sizeof(MAGIC));
+    new_header.format_version = FORMAT_VERSION;
+    if (!get_source_stamp(source_path, new_header.source_size, new_header.source_time)) {
+        new_header.source_size = 0;
+        new_header.source_time = 0;
+    }
+    memcpy(new_header.client_id, client_id, CLIENT_ID_LENGTH);
+    new_header.name_length = static_cast<uint8_t>(name.size());
+    new_header.private_key_size = static_cast<uint16_t>(private_key.size());
+
+    out.resize(sizeof(new_header) + name.size() + private_key.size());
+    memcpy(out.data(), &new_header, sizeof(new_header));
+    memcpy(out.data() + sizeof(new_header), name.data(), name.size());
+    memcpy(out.data() + sizeof(new_header) + name.size(), private_key.data(), private_key.size());
+
+    // The checksum covers the rest of the header too
+    new_header.checksum = checksum(out.data() + CHECKSUM_OFFSET, out.size() - CHECKSUM_OFFSET);
+    memcpy(out.data() + offsetof(IdentityFileHeader, checksum), &new_header.checksum, sizeof(new_header.checksum));
+    return true;
+}
+
+bool IdentityStore::use_image(const uint8_t* data, size_t size)
+{
+    image = nullptr;
+    if (size < sizeof(IdentityFileHeader)) return false;
+
+    IdentityFileHeader file_header;
+    memcpy(&file_header, data, sizeof(file_header));
+    if (memcmp(file_header.magic, MAGIC, sizeof(MAGIC)) != 0 || file_header.format_version != FORMAT_VERSION) {
+        return false;
+    }
+    if (size != sizeof(IdentityFileHeader) + file_header.name_length + file_header.private_key_size || file_header.private_key_size == 0) {
+        return false;
+    }
+    if (checksum(data + CHECKSUM_OFFSET, size - CHECKSUM_OFFSET) != file_header.checksum) return false;
+
+    header = file_header;
+    image = data;
+    return true;
+}
+
+bool IdentityStore::load()
+{
+    unsaved_image.clear();
+    if (!file.open(path)) return false;
+    if (!use_image(file.get_data(), file.get_size())) {
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+bool IdentityStore::save(std::string_view name, const uint8_t* client_id, const std::string& private_key, const std::string& source_path)
+{
+    // Unmap first - the file is replaced
+    image = nullptr;
+    file.close();
+
+    std::vector<uint8_t> new_image;
+    if (!build_image(name, client_id, private_key, source_path, new_image)) return false;
+
+    // Write a new file and move it over the old one
+    std::string temp_path = path + ".tmp";
+    bool written;
+    {
+        std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(new_image.data()), static_cast<std::streamsize>(new_image.size()));
+        stream.close();
+        written = static_cast<bool>(stream);
+    }
+    if (written) {
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        written = !error;
+    }
+
+    if (written && load()) return true;
+
+    unsaved_image = std::move(new_image);
+    use_image(unsaved_image.data(), unsaved_image.size());
+    return false;
+}
+
+bool IdentityStore::is_from(const std::string& source_path) const
+{
+    uint64_t size;
+    int64_t time;
+    return image != nullptr && get_source_stamp(source_path, size, time) && size == header.source_size && time == header.source_time;
+}
+
+bool IdentityStore::read_text(const std::string& source_path, std::string& name, std::vector<uint8_t>& client_id, std::string& private_key)
+{
+    std::string content;
+    if (!Util::read_file(source_path, content)) return false;
+
+    std::string_view text(content);
+    size_t position = 0;
+    name = std::string(read_line(text, position));
+    std::string_view id_hex = read_line(text, position);
+    if (id_hex.size() != HexCodec::encoded_size(CLIENT_ID_LENGTH)) return false;
+
+    client_id.resize(CLIENT_ID_LENGTH);
+    if (!HexCodec::decode(id_hex.data(), id_hex.size(), client_id.data())) return false;
+
+    // The key may be split over lines - the decoder skips the line breaks
+    std::string_view key_base64 = text.substr(position);
+    private_key.resize(Base64Codec::max_decoded_size(key_base64.size()));
+    size_t key_size = 0;
+    if (!Base64Codec::decode(key_base64.data(), key_base64.size(), reinterpret_cast<uint8_t*>(&private_key[0]), key_size)) return false;
+    private_key.resize(key_size);
+    return !private_key.empty();
+}
+
+bool IdentityStore::is_loaded() const
+{
+    return image != nullptr;
+}
+
+const uint8_t* IdentityStore::get_client_id() const
+{
+    return header.client_id;
+}
+
+std::string_view IdentityStore::get_name() const
+{
+    return std::string_view(reinterpret_cast<const char*>(image + sizeof(IdentityFileHeader)), header.name_length);
+}
+
+std::string IdentityStore::get_private_key() const
+{
+    const char* key = reinterpret_cast<const char*>(image + sizeof(IdentityFileHeader) + header.name_length);
+    return std::string(key, header.private_key_size);
+}
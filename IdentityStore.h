@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ProtocolHeaders.h"
+
+#pragma pack(push, 1)
+
+// Start of the identity file - followed by name_length bytes of the name
+// and private_key_size bytes of the private key (DER)
+struct IdentityFileHeader
+{
+	uint8_t magic[4];
+	uint32_t format_version;
+	uint32_t checksum;      // FNV-1a of the file after this field
+	uint64_t source_size;   // Size and write time of the me.info written with the identity or migrated to it
+	int64_t source_time;
+	uint8_t client_id[CLIENT_ID_LENGTH];
+	uint8_t name_length;
+	uint16_t private_key_size;
+};
+
+#pragma pack(pop)
+
+// The client's identity in a compact binary file, mapped and validated once at startup.
+// The private key is kept as its DER bytes, so nothing is decoded until it is parsed.
+// The text me.info stays the source of truth - the identity records which me.info it matches,
+// and is migrated again when that file changes
+class IdentityStore
+{
+	static constexpr uint8_t MAGIC[4] = { 'M', 'U', 'I', 'D' };
+	static constexpr uint32_t FORMAT_VERSION = 1;
+
+	std::string path;
+	MappedFile file;
+
+	// Identity that could not be written, used in place of the file for this run
+	std::vector<uint8_t> unsaved_image;
+
+	IdentityFileHeader header{};
+	const uint8_t* image = nullptr;
+
+	static uint32_t checksum(const uint8_t* data, size_t size);
+
+	// Stamp of the text file, false if it doesn't exist
+	static bool get_source_stamp(const std::string& source_path, uint64_t& size, int64_t& time);
+
+	static bool build_image(std::string_view name, const uint8_t* client_id, const std::string& private_key, const std::string& source_path, std::vector<uint8_t>& out);
+
+	// Check the image and view the identity in it
+	bool use_image(const uint8_t* data, size_t size);
+
+public:
+	explicit IdentityStore(const std::string& path);
+
+	// Map and validate the identity file. Returns false if there is no valid one
+	bool load();
+
+	// Write the identity, stamped with the current source_path, and load it.
+	// If it can't be written it is still kept for this run, and false is returned
+	bool save(std::string_view name, const uint8_t* client_id, const std::string& private_key, const std::string& source_path);
+
+	// The identity matches source_path as it is now
+	bool is_from(const std::string& source_path) const;
+
+	// Parse the text me.info: the name, the client id in hex, then the private key in base64 over any number of lines
+	static bool read_text(const std::string& source_path, std::string& name, std::vector<uint8_t>& client_id, std::string& private_key);
+
+	bool is_loaded() const;
+	const uint8_t* get_client_id() const;
+	std::string_view get_name() const;
+
+	// DER private key, to be parsed
+	std::string get_private_key() const;
+};
@@ -0,0 +1,195 @@
+#include "InboxDecryptor.h"
+
+#include <cstring>
+#include <stdexcept>
+
+InboxDecryptor::InboxDecryptor(RecordHandler on_record, size_t thread_count) :
+    on_record(std::move(on_record)), pool(thread_count)
+{
+    for (size_t i = 0; i < pool.get_thread_count(); i++) {
+        worker_states.push_back(std::make_unique<WorkerState>());
+    }
+}
+
+void InboxDecryptor::set_private_key(const RSAPrivateDecryptor* private_key)
+{
+    this->private_key = private_key;
+}
+
+void InboxDecryptor::submit(const ProtocolCodec::WaitingMessageResponseHeaderView& header_view, const uint8_t* content, bool known_sender, const uint8_t* session_key)
+{
+    // Don't let a large inbox run too far ahead of the console
+    while (records.size() >= MAX_PENDING_RECORDS) {
+        deliver_front(true);
+    }
+
+    auto record = std::make_shared<InboxRecord>();
+    // The header outlives the received chunk
+    record->header = header_view.to_struct();
+    const WaitingMessageResponseHeader& header = record->header;
+    record->known_sender = known_sender;
+    records.push_back(record);
+
+    // Only texts and key deliveries need decrypting, the rest is handed back as is
+    bool is_key_delivery = header.message_type == ClientMessageType::SEND_SYMMETRIC_KEY;
+    bool is_text = header.message_type == ClientMessageType::SEND_TEXT_MESSAGE || header.message_type == ClientMessageType::SEND_COMPRESSED_TEXT_MESSAGE;
+    if (!known_sender || (!is_key_delivery && !is_text)) {
+        record->succeeded = known_sender;
+        record->done = true;
+        return;
+    }
+    record->content.assign(content, content + header.message_size);
+
+    // A key delivery of this sender still in flight decides which key this message needs
+    std::string sender(reinterpret_cast<const char*>(header.client_id), CLIENT_ID_LENGTH);
+    std::shared_ptr<InboxRecord> key_delivery;
+    auto it = pending_key_deliveries.find(sender);
+    if (it != pending_key_deliveries.end()) {
+        key_delivery = it->second;
+    }
+    if (is_key_delivery) {
+        pending_key_deliveries[sender] = record;
+    }
+
+    if (key_delivery)
+    {
+        std::lock_guard<std::mutex> lock(key_delivery->mutex);
+        if (!key_delivery->done) {
+            // Runs when the key delivery finishes
+            key_delivery->continuations.push_back(record);
+            return;
+        }
+        memcpy(record->input_key, key_delivery->resolved_key, sizeof(record->input_key));
+        record->has_input_key = key_delivery->has_resolved_key;
+    }
+    else if (session_key != NULL)
+    {
+        memcpy(record->input_key, session_key, sizeof(record->input_key));
+        record->has_input_key = true;
+    }
+
+    schedule(record);
+}
+
+void InboxDecryptor::schedule(const std::shared_ptr<InboxRecord>& record)
+{
+    pool.submit([this, record] {
+        process(*record);
+        finish(record);
+    });
+}
+
+void InboxDecryptor::process(InboxRecord& record)
+{
+    WorkerState& state = *worker_states[pool.current_worker()];
+
+    if (record.header.message_type == ClientMessageType::SEND_SYMMETRIC_KEY)
+    {
+        // Decrypt symmetric key with private key
+        record.succeeded = private_key != nullptr &&
+            private_key->decrypt(state.rng, reinterpret_cast<const char*>(record.content.data()), static_cast<unsigned int>(record.content.size()), record.plaintext) &&
+            record.plaintext.size() == AESWrapper::DEFAULT_KEYLENGTH;
+
+        // Later messages of the sender use the new key, or keep the old one if this one is invalid
+        if (record.succeeded) {
+            memcpy(record.resolved_key, record.plaintext.data(), sizeof(record.resolved_key));
+            record.has_resolved_key = true;
+        }
+        else {
+            memcpy(record.resolved_key, record.input_key, sizeof(record.resolved_key));
+            record.has_resolved_key = record.has_input_key;
+        }
+    }
+    else if (record.has_input_key)
+    {
+        // Decrypt text with this worker's cipher of the session key
+        std::string key(reinterpret_cast<const char*>(record.input_key), sizeof(record.input_key));
+        std::unique_ptr<AESSessionCipher>& cipher = state.ciphers[key];
+        if (!cipher) {
+            cipher = std::make_unique<AESSessionCipher>(record.input_key, AESWrapper::DEFAULT_KEYLENGTH);
+        }
+
+        record.plaintext.resize(record.content.size());
+        try {
+            record.plaintext.resize(cipher->decrypt(record.content.data(), record.content.size(), reinterpret_cast<unsigned char*>(&record.plaintext[0])));
+            record.succeeded = true;
+        }
+        catch (const std::invalid_argument&) {
+            record.plaintext.clear();
+        }
+
+        // Compressed before it was encrypted
+        if (record.succeeded && record.header.message_type == ClientMessageType::SEND_COMPRESSED_TEXT_MESSAGE) {
+            std::string compressed;
+            compressed.swap(record.plaintext);
+            record.succeeded = LZDecompressor::decompress(reinterpret_cast<const uint8_t*>(compressed.data()), compressed.size(), record.plaintext);
+        }
+    }
+
+    record.content.clear();
+    record.content.shrink_to_fit();
+}
+
+void InboxDecryptor::finish(const std::shared_ptr<InboxRecord>& record)
+{
+    std::vector<std::shared_ptr<InboxRecord>> continuations;
+    {
+        std::lock_guard<std::mutex> lock(record->mutex);
+        record->done = true;
+        continuations.swap(record->continuations);
+    }
+
+    // Messages that waited for this key delivery can run now
+    for (const std::shared_ptr<InboxRecord>& continuation : continuations) {
+        memcpy(continuation->input_key, record->resolved_key, sizeof(continuation->input_key));
+        continuation->has_input_key = record->has_resolved_key;
+        schedule(continuation);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(done_mutex);
+    }
+    done_cv.notify_all();
+}
+
+void InboxDecryptor::deliver_front(bool wait)
+{
+    std::shared_ptr<InboxRecord> record = records.front();
+    if (!record->done)
+    {
+        if (!wait) return;
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait(lock, [&] { return record->done.load(); });
+    }
+    records.pop_front();
+
+    // Its key is handed back now - later messages of the sender get it from the caller
+    if (record->header.message_type == ClientMessageType::SEND_SYMMETRIC_KEY) {
+        std::string sender(reinterpret_cast<const char*>(record->header.client_id), CLIENT_ID_LENGTH);
+        auto it = pending_key_deliveries.find(sender);
+        if (it != pending_key_deliveries.end() && it->second == record) {
+            pending_key_deliveries.erase(it);
+        }
+    }
+
+    on_record(*record);
+}
+
+void InboxDecryptor::deliver_ready()
+{
+    while (!records.empty() && records.front()->done) {
+        deliver_front(false);
+    }
+}
+
+void InboxDecryptor::drain()
+{
+    while (!records.empty()) {
+        deliver_front(true);
+    }
+}
+
+WorkStealingPool& InboxDecryptor::get_pool()
+{
+    return pool;
+}
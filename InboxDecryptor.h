@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <osrng.h>
+
+#include "AESWrapper.h"
+#include "LZCodec.h"
+#include "ProtocolCodec.h"
+#include "RSAWrapper.h"
+#include "WorkStealingPool.h"
+
+// One inbox message on its way through the decryption pool
+struct InboxRecord
+{
+	WaitingMessageResponseHeader header{};
+	std::vector<uint8_t> content; // Ciphertext as received - released once decrypted
+	std::string plaintext;        // Decrypted text, or the symmetric key of a key delivery
+	bool known_sender = false;
+	bool succeeded = false;
+
+	// Session key in effect before this message, and after it for key deliveries
+	uint8_t input_key[AESWrapper::DEFAULT_KEYLENGTH];
+	bool has_input_key = false;
+	uint8_t resolved_key[AESWrapper::DEFAULT_KEYLENGTH];
+	bool has_resolved_key = false;
+
+	// Later messages of the same sender waiting for this key delivery
+	std::mutex mutex;
+	std::atomic<bool> done{ false };
+	std::vector<std::shared_ptr<InboxRecord>> continuations;
+};
+
+// Decrypts the messages of an inbox on a work stealing pool and hands the results back
+// on the submitting thread in the original order.
+// A key delivery is a barrier for its sender only: later messages of the same sender
+// continue from it once its key is known, messages of other senders don't wait for it
+class InboxDecryptor
+{
+public:
+	// Called on the submitting thread, in message order
+	typedef std::function<void(InboxRecord& record)> RecordHandler;
+
+private:
+	// Messages submitted but not handed back - bounds the memory of a large inbox
+	static constexpr size_t MAX_PENDING_RECORDS = 4096;
+
+	// Per worker state, so workers never share an RNG or a cipher
+	struct WorkerState
+	{
+		CryptoPP::AutoSeededRandomPool rng;
+		std::unordered_map<std::string, std::unique_ptr<AESSessionCipher>> ciphers; // By session key
+	};
+
+	RecordHandler on_record;
+	const RSAPrivateDecryptor* private_key = nullptr;
+
+	std::vector<std::unique_ptr<WorkerState>> worker_states;
+
+	// Records not handed back yet, in message order
+	std::deque<std::shared_ptr<InboxRecord>> records;
+
+	// Last key delivery of each sender that wasn't handed back yet, by sender UUID
+	std::unordered_map<std::string, std::shared_ptr<InboxRecord>> pending_key_deliveries;
+
+	std::mutex done_mutex;
+	std::condition_variable done_cv;
+
+	// Declared last so the workers stop before the state they use is destroyed
+	WorkStealingPool pool;
+
+	InboxDecryptor(const InboxDecryptor&) = delete;
+	InboxDecryptor& operator=(const InboxDecryptor&) = delete;
+
+	// Queue the record on the pool
+	void schedule(const std::shared_ptr<InboxRecord>& record);
+
+	// Worker side - decrypt the record, then release the messages waiting for it
+	void process(InboxRecord& record);
+	void finish(const std::shared_ptr<InboxRecord>& record);
+
+	// Hand back the record at the head of the order, waiting for it if needed
+	void deliver_front(bool wait);
+
+public:
+	// thread_count of 0 uses a thread per core
+	explicit InboxDecryptor(RecordHandler on_record, size_t thread_count = 0);
+
+	// Key for decrypting key deliveries - must stay alive while records are in flight
+	void set_private_key(const RSAPrivateDecryptor* private_key);
+
+	// Queue the next message. session_key is the sender's key as of the messages handed back so far
+	// (NULL if none), key deliveries still in flight take precedence over it
+	void submit(const ProtocolCodec::WaitingMessageResponseHeaderView& header, const uint8_t* content, bool known_sender, const uint8_t* session_key);
+
+	// Hand back the records that are done at the head of the order
+	void deliver_ready();
+
+	// Wait for all the submitted records and hand them back
+	void drain();
+
+	WorkStealingPool& get_pool();
+};
@@ -0,0 +1,370 @@
+#include "LZCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // Bytes of the block header
+    constexpr size_t BLOCK_HEADER_SIZE = 4;
+
+    // Position that was never hashed
+    constexpr uint32_t NO_POSITION = UINT32_MAX;
+
+    uint32_t read32(const uint8_t* data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    void append_block_header(std::vector<uint8_t>& out, uint32_t header)
+    {
+        // Little endian like the protocol structs
+        for (int i = 0; i < 4; i++) {
+            out.push_back(static_cast<uint8_t>(header >> (8 * i)));
+        }
+    }
+
+    size_t length_bytes(size_t length)
+    {
+        return length >= 15 ? (length - 15) / 255 + 1 : 0;
+    }
+
+    uint8_t* write_length(uint8_t* out, size_t length)
+    {
+        // The token holds 15 - the rest follows in bytes of 255 and a last smaller one
+        length -= 15;
+        while (length >= 255) {
+            *out++ = 255;
+            length -= 255;
+        }
+        *out++ = static_cast<uint8_t>(length);
+        return out;
+    }
+
+    bool read_length(const uint8_t*& in, const uint8_t* in_end, size_t& length)
+    {
+        uint8_t byte;
+        do {
+            if (in == in_end) return false;
+            byte = *in++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+}
+
+const std::string& LZCompressor::get_dictionary()
+{
+    // Later words are closer to the data, so the most frequent ones come last and get short offsets
+    static const std::string dictionary =
+        "https://www. .com .org .net localhost 127.0.0.1 GET POST PUT DELETE HTTP/1.1 200 OK 404 Not Found 500 "
+        "Internal Server Error Content-Type: application/json text/plain; charset=utf-8 "
+        "[TRACE] [DEBUG] [INFO] [WARN] [WARNING] [ERROR] [FATAL] Exception: Traceback (most recent call last): "
+        "at line  failed to connect timeout exceeded retrying connection refused success completed started stopped "
+        "request response status user server client message file directory path config version update "
+        "January February March April May June July August September October November December "
+        "Monday Tuesday Wednesday Thursday Friday Saturday Sunday today tomorrow yesterday morning evening "
+        "please thanks thank you sorry hello hi hey okay yes no maybe sure great good morning see you later "
+        "meeting tonight tomorrow weekend call me when you can let me know what do you think about "
+        "because before after again always never something nothing everything anything someone "
+        "should would could might must will shall have has had been being was were are is am "
+        "there their they them then than these those this that with from into onto over under "
+        "about which while where what when who why how your yours our ours his her its "
+        "the and for not but all any can one two new now out get got just like know make time ";
+    return dictionary;
+}
+
+size_t LZCompressor::max_compressed_size(size_t length)
+{
+    // Every block stored raw, plus the flags byte and the end of the stream
+    size_t blocks = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    return 1 + length + (blocks + 1) * BLOCK_HEADER_SIZE;
+}
+
+uint32_t LZCompressor::hash(const uint8_t* data)
+{
+    return (read32(data) * 2654435761U) >> (32 - HASH_BITS);
+}
+
+LZCompressor::LZCompressor(bool use_dictionary) :
+    use_dictionary(use_dictionary), hash_table(1 << HASH_BITS, NO_POSITION), dictionary_table(1 << HASH_BITS, NO_POSITION)
+{
+    compressed_block.resize(BLOCK_SIZE);
+
+    if (use_dictionary) {
+        // Hash the dictionary once - every block starts from this table
+        const std::string& dictionary = get_dictionary();
+        window.assign(dictionary.begin(), dictionary.end());
+        for (size_t i = 0; i + MIN_MATCH <= window.size(); i++) {
+            dictionary_table[hash(&window[i])] = static_cast<uint32_t>(i);
+        }
+    }
+}
+
+size_t LZCompressor::compress_block(const uint8_t* data, size_t length)
+{
+    size_t dictionary_size = use_dictionary ? get_dictionary().size() : 0;
+    window.resize(dictionary_size + length);
+    memcpy(&window[dictionary_size], data, length);
+    hash_table = dictionary_table;
+
+    const uint8_t* base = window.data();
+    size_t end = window.size();
+    size_t position = dictionary_size;
+    size_t anchor = position;
+
+    // Only a block that gets smaller is kept compressed
+    uint8_t* out = compressed_block.data();
+    uint8_t* out_end = out + length;
+
+    while (true)
+    {
+        // Find the next match, or run to the end of the block with literals only
+        size_t match_position = end;
+        size_t match_length = 0;
+        size_t offset = 0;
+        for (; position + MIN_MATCH <= end; position++) {
+            uint32_t& slot = hash_table[hash(base + position)];
+            uint32_t candidate = slot;
+            slot = static_cast<uint32_t>(position);
+            if (candidate != NO_POSITION && position - candidate <= MAX_OFFSET && read32(base + candidate) == read32(base + position)) {
+                match_position = position;
+                offset = position - candidate;
+                match_length = MIN_MATCH;
+                while (position + match_length < end && base[candidate + match_length] == base[position + match_length]) {
+                    match_length++;
+                }
+                break;
+            }
+        }
+
+        // Sequence of the literals before the match and the match itself
+        size_t literal_count = match_position - anchor;
+        size_t sequence_size = 1 + length_bytes(literal_count) + literal_count;
+        if (match_length > 0) sequence_size += 2 + length_bytes(match_length - MIN_MATCH);
+        if (sequence_size >= static_cast<size_t>(out_end - out)) return 0;
+
+        uint8_t* token = out++;
+        *token = static_cast<uint8_t>(std::min<size_t>(literal_count, 15) << 4);
+        if (literal_count >= 15) out = write_length(out, literal_count);
+        memcpy(out, base + anchor, literal_count);
+        out += literal_count;
+
+        if (match_length == 0) break;
+
+        *out++ = static_cast<uint8_t>(offset);
+        *out++ = static_cast<uint8_t>(offset >> 8);
+        *token |= static_cast<uint8_t>(std::min<size_t>(match_length - MIN_MATCH, 15));
+        if (match_length - MIN_MATCH >= 15) out = write_length(out, match_length - MIN_MATCH);
+
+        // Hash a position inside the match too, so repeats of its tail are found
+        if (match_length > MIN_MATCH + 1) {
+            size_t inside = match_position + match_length - 2;
+            if (inside + MIN_MATCH <= end) hash_table[hash(base + inside)] = static_cast<uint32_t>(inside);
+        }
+        position = match_position + match_length;
+        anchor = position;
+    }
+
+    return out - compressed_block.data();
+}
+
+void LZCompressor::begin(std::vector<uint8_t>& out) const
+{
+    out.push_back(use_dictionary ? FLAG_DICTIONARY : 0);
+}
+
+void LZCompressor::update(const uint8_t* data, size_t length, std::vector<uint8_t>& out)
+{
+    while (length > 0)
+    {
+        size_t block_length = std::min(length, BLOCK_SIZE);
+        size_t compressed_size = compress_block(data, block_length);
+        if (compressed_size > 0) {
+            append_block_header(out, static_cast<uint32_t>(compressed_size));
+            out.insert(out.end(), compressed_block.begin(), compressed_block.begin() + compressed_size);
+        }
+        else {
+            append_block_header(out, BLOCK_STORED | static_cast<uint32_t>(block_length));
+            out.insert(out.end(), data, data + block_length);
+        }
+        data += block_length;
+        length -= block_length;
+    }
+}
+
+void LZCompressor::end(std::vector<uint8_t>& out) const
+{
+    append_block_header(out, 0);
+}
+
+void LZCompressor::compress(const uint8_t* data, size_t length, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.reserve(max_compressed_size(length));
+    begin(out);
+    update(data, length, out);
+    end(out);
+}
+
+long long LZDecompressor::decode_block(const uint8_t* data, size_t size)
+{
+    const uint8_t* in = data;
+    const uint8_t* in_end = data + size;
+    uint8_t* out_start = window.data() + dictionary_size;
+    uint8_t* out = out_start;
+    uint8_t* out_end = out_start + LZCompressor::BLOCK_SIZE;
+
+    while (true)
+    {
+        if (in == in_end) return -1;
+        uint8_t token = *in++;
+
+        // Literals
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !read_length(in, in_end, literal_count)) return -1;
+        if (literal_count > static_cast<size_t>(in_end - in) || literal_count > static_cast<size_t>(out_end - out)) return -1;
+        memcpy(out, in, literal_count);
+        in += literal_count;
+        out += literal_count;
+
+        // The last sequence has no match
+        if (in == in_end) break;
+
+        // Match - may overlap the bytes it produces
+        if (in_end - in < 2) return -1;
+        size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !read_length(in, in_end, match_length)) return -1;
+        match_length += LZCompressor::MIN_MATCH;
+
+        if (offset == 0 || offset > static_cast<size_t>(out - window.data()) || match_length > static_cast<size_t>(out_end - out)) return -1;
+        const uint8_t* match = out - offset;
+        if (offset >= match_length) {
+            memcpy(out, match, match_length);
+            out += match_length;
+        }
+        else {
+            for (size_t i = 0; i < match_length; i++) {
+                *out++ = match[i];
+            }
+        }
+    }
+
+    return out - out_start;
+}
+
+bool LZDecompressor::feed(const uint8_t* data, size_t size, const OutputHandler& on_output)
+{
+    while (size > 0)
+    {
+        switch (state)
+        {
+        case State::FLAGS:
+        {
+            uint8_t flags = *data++;
+            size--;
+            if ((flags & ~LZCompressor::FLAG_DICTIONARY) != 0) {
+                state = State::FAILED;
+                return false;
+            }
+
+            // Matches may refer back into the dictionary, so blocks are decoded right after it
+            const std::string& dictionary = LZCompressor::get_dictionary();
+            dictionary_size = (flags & LZCompressor::FLAG_DICTIONARY) ? dictionary.size() : 0;
+            window.resize(dictionary_size + LZCompressor::BLOCK_SIZE);
+            memcpy(window.data(), dictionary.data(), dictionary_size);
+            header_bytes = 0;
+            state = State::BLOCK_HEADER;
+            break;
+        }
+        case State::BLOCK_HEADER:
+        {
+            header[header_bytes++] = *data++;
+            size--;
+            if (header_bytes < sizeof(header)) break;
+            header_bytes = 0;
+
+            uint32_t value = header[0] | (header[1] << 8) | (header[2] << 16) | (static_cast<uint32_t>(header[3]) << 24);
+            if (value == 0) {
+                state = State::COMPLETE;
+                break;
+            }
+            block_stored = (value & LZCompressor::BLOCK_STORED) != 0;
+            block_size = value & ~LZCompressor::BLOCK_STORED;
+            if (block_size == 0 || block_size > LZCompressor::BLOCK_SIZE) {
+                state = State::FAILED;
+                return false;
+            }
+            block.clear();
+            state = State::BLOCK_DATA;
+            break;
+        }
+        case State::BLOCK_DATA:
+        {
+            // A stored block that arrived whole is handed over without a copy
+            size_t part = std::min<size_t>(size, block_size - block.size());
+            if (block_stored && block.empty() && part == block_size) {
+                if (!on_output(data, part)) {
+                    state = State::FAILED;
+                    return false;
+                }
+            }
+            else {
+                block.insert(block.end(), data, data + part);
+            }
+            data += part;
+            size -= part;
+            if (!block.empty() && block.size() < block_size) break;
+
+            if (!block.empty()) {
+                bool delivered;
+                if (block_stored) {
+                    delivered = on_output(block.data(), block.size());
+                }
+                else {
+                    long long decoded_size = decode_block(block.data(), block.size());
+                    delivered = decoded_size >= 0 && on_output(window.data() + dictionary_size, static_cast<size_t>(decoded_size));
+                }
+                if (!delivered) {
+                    state = State::FAILED;
+                    return false;
+                }
+            }
+            state = State::BLOCK_HEADER;
+            break;
+        }
+        case State::COMPLETE:
+        case State::FAILED:
+            // Nothing may follow the end of the stream
+            state = State::FAILED;
+            return false;
+        }
+    }
+    return state != State::FAILED;
+}
+
+bool LZDecompressor::is_complete() const
+{
+    return state == State::COMPLETE;
+}
+
+void LZDecompressor::restart()
+{
+    state = State::FLAGS;
+    header_bytes = 0;
+    block.clear();
+}
+
+bool LZDecompressor::decompress(const uint8_t* data, size_t size, std::string& out)
+{
+    LZDecompressor decompressor;
+    out.clear();
+    return decompressor.feed(data, size, [&out](const uint8_t* part, size_t part_size) {
+        out.append(reinterpret_cast<const char*>(part), part_size);
+        return true;
+    }) && decompressor.is_complete();
+}
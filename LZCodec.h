@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Fast LZ77 compression of message contents, applied before they are encrypted.
+// A stream is a flags byte, then blocks that are each compressed on their own so the receiver
+// can decompress them as they arrive, then a zero block header:
+//   uint32_t header - BLOCK_STORED if the block holds raw bytes, or'ed with the block data size
+//   block data      - LZ sequences, or the raw bytes of a stored block
+// A sequence is a token (literal count << 4 | match length - 4, 15 meaning more length bytes follow),
+// the literals and a 16 bit offset back to the match. The last sequence of a block has literals only
+class LZCompressor
+{
+public:
+	// Uncompressed bytes per block
+	static constexpr size_t BLOCK_SIZE = 64 * 1024;
+	static constexpr uint32_t BLOCK_STORED = 0x80000000;
+
+	// Stream flags - matches may refer back into the built-in dictionary
+	static constexpr uint8_t FLAG_DICTIONARY = 1;
+
+	static constexpr size_t MIN_MATCH = 4;
+	static constexpr size_t MAX_OFFSET = 65535;
+
+	// Upper bound of the stream size for length bytes of input
+	static size_t max_compressed_size(size_t length);
+
+	// Words common in chat and log lines - short texts have little history of their own to match
+	static const std::string& get_dictionary();
+
+private:
+	static constexpr int HASH_BITS = 14;
+
+	bool use_dictionary;
+
+	// Dictionary followed by the block being compressed
+	std::vector<uint8_t> window;
+
+	// Last position of each hashed 4 byte sequence, and the table with only the dictionary hashed
+	std::vector<uint32_t> hash_table;
+	std::vector<uint32_t> dictionary_table;
+
+	std::vector<uint8_t> compressed_block;
+
+	static uint32_t hash(const uint8_t* data);
+
+	// Compress one block into compressed_block, returns its size or 0 if it doesn't get smaller
+	size_t compress_block(const uint8_t* data, size_t length);
+
+public:
+	explicit LZCompressor(bool use_dictionary = false);
+
+	// Append the stream flags
+	void begin(std::vector<uint8_t>& out) const;
+
+	// Append the data as blocks of up to BLOCK_SIZE bytes
+	void update(const uint8_t* data, size_t length, std::vector<uint8_t>& out);
+
+	// Append the end of the stream
+	void end(std::vector<uint8_t>& out) const;
+
+	// Replace out with the stream of a whole message
+	void compress(const uint8_t* data, size_t length, std::vector<uint8_t>& out);
+};
+
+// Decompresses an LZCompressor stream part by part as it arrives
+class LZDecompressor
+{
+public:
+	// Called with each decompressed block, returns false to stop
+	typedef std::function<bool(const uint8_t* data, size_t size)> OutputHandler;
+
+private:
+	enum class State
+	{
+		FLAGS,
+		BLOCK_HEADER,
+		BLOCK_DATA,
+		COMPLETE,
+		FAILED,
+	};
+
+	State state = State::FLAGS;
+	size_t dictionary_size = 0;
+
+	uint8_t header[4];
+	size_t header_bytes = 0;
+	uint32_t block_size = 0;
+	bool block_stored = false;
+
+	// Block data collected until the block is complete
+	std::vector<uint8_t> block;
+
+	// Dictionary followed by the block being decompressed
+	std::vector<uint8_t> window;
+
+	// Decode the LZ sequences of a block into window after the dictionary, returns the block size or -1
+	long long decode_block(const uint8_t* data, size_t size);
+
+public:
+	// Decompress the next part of the stream. Returns false if the stream is invalid or on_output stopped it
+	bool feed(const uint8_t* data, size_t size, const OutputHandler& on_output);
+
+	// True once the end of the stream was decompressed
+	bool is_complete() const;
+
+	// Start over with a new stream
+	void restart();
+
+	// Decompress a whole stream
+	static bool decompress(const uint8_t* data, size_t size, std::string& out);
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file (Win32 file mapping or POSIX mmap)
+class MappedFile
+{
+#ifdef _WIN32
+	// Kept as void* so this header doesn't pull in windows.h
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#else
+	int file_descriptor = -1;
+#endif
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	// Map the file - fails if it doesn't exist or is empty
+	bool open(const std::string& path);
+	void close();
+
+	const uint8_t* get_data() const;
+	size_t get_size() const;
+};
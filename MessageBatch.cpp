@@ -0,0 +1,70 @@
+#include "MessageBatch.h"
+
+#include <cstring>
+
+bool MessageBatch::add(const uint8_t* destination, ClientMessageType message_type, std::string content)
+{
+    uint64_t record_size = sizeof(SendMessageToClientPayloadHeader) + static_cast<uint64_t>(content.size());
+    if (payload_size + record_size > UINT32_MAX) return false;
+
+    headers.emplace_back();
+    ProtocolCodec::SendMessageToClientPayloadHeaderWriter header(headers.back().data());
+    header.set_client_id(destination);
+    header.set_message_type(message_type);
+    header.set_content_size(static_cast<uint32_t>(content.size()));
+
+    contents.push_back(std::move(content));
+    payload_size += record_size;
+    ProtocolCodec::SendMessagesBatchPayloadHeaderWriter(batch_header).set_message_count(++message_count);
+    return true;
+}
+
+size_t MessageBatch::size() const
+{
+    return headers.size();
+}
+
+uint32_t MessageBatch::get_payload_size() const
+{
+    return static_cast<uint32_t>(payload_size);
+}
+
+std::vector<ConstBuffer> MessageBatch::get_payload_buffers()
+{
+    std::vector<ConstBuffer> buffers;
+    buffers.reserve(1 + headers.size() * 2);
+    buffers.push_back({ batch_header, sizeof(batch_header) });
+    for (size_t i = 0; i < headers.size(); i++) {
+        buffers.push_back({ headers[i].data(), headers[i].size() });
+        if (!contents[i].empty()) {
+            buffers.push_back({ contents[i].data(), contents[i].size() });
+        }
+    }
+    return buffers;
+}
+
+bool MessageBatch::parse_response(const std::vector<uint8_t>& server_payload, std::vector<BatchMessageResult>& results) const
+{
+    ProtocolCodec::ArrayView<ProtocolCodec::BatchMessageResultView> response;
+    if (!ProtocolCodec::ArrayView<ProtocolCodec::BatchMessageResultView>::parse(server_payload.data(), server_payload.size(), response) || response.size() != headers.size()) {
+        return false;
+    }
+
+    // Results come back in the order of the request
+    results.resize(headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        ProtocolCodec::SendMessageToClientPayloadHeaderView header(headers[i].data());
+        if (memcmp(response[i].client_id(), header.client_id(), CLIENT_ID_LENGTH) != 0) return false;
+        results[i] = response[i].to_struct();
+    }
+    return true;
+}
+
+void MessageBatch::clear()
+{
+    headers.clear();
+    contents.clear();
+    message_count = 0;
+    ProtocolCodec::SendMessagesBatchPayloadHeaderWriter(batch_header).set_message_count(0);
+    payload_size = sizeof(SendMessagesBatchPayloadHeader);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "ProtocolCodec.h"
+#include "Transport.h"
+
+// Messages to any number of clients, sent in one SEND_MESSAGES_BATCH request.
+// The records are kept as they go on the wire and sent as views without copying them together
+class MessageBatch
+{
+	typedef std::array<uint8_t, ProtocolCodec::SendMessageToClientPayloadHeaderWriter::SIZE> RecordHeader;
+
+	uint8_t batch_header[ProtocolCodec::SendMessagesBatchPayloadHeaderWriter::SIZE] = {};
+	uint32_t message_count = 0;
+
+	// Deques so the records don't move while views of them are handed out
+	std::deque<RecordHeader> headers;
+	std::deque<std::string> contents;
+	uint64_t payload_size = sizeof(SendMessagesBatchPayloadHeader);
+
+public:
+	// Add a message with its encrypted content (empty for a symmetric key request).
+	// Returns false if the batch would be too big for one request
+	bool add(const uint8_t* destination, ClientMessageType message_type, std::string content);
+
+	size_t size() const;
+	uint32_t get_payload_size() const;
+
+	// Views of the request payload - valid while the batch isn't changed
+	std::vector<ConstBuffer> get_payload_buffers();
+
+	// Check the response matches the batch and extract its results
+	bool parse_response(const std::vector<uint8_t>& server_payload, std::vector<BatchMessageResult>& results) const;
+
+	void clear();
+};
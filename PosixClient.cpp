@@ -0,0 +1,827 @@
+#include "PosixClient.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+PosixClient::PosixClient() : loop(std::make_shared<EpollLoop>())
+{
+}
+
+PosixClient::PosixClient(std::shared_ptr<EpollLoop> shared_loop) : loop(std::move(shared_loop))
+{
+}
+
+PosixClient::~PosixClient()
+{
+    close_connection();
+}
+
+void PosixClient::set_keep_alive(bool enable)
+{
+    keep_alive = enable;
+    server_supports_sessions = true;
+    single_request_sessions = 0;
+    if (state == State::IDLE) {
+        close_connection();
+    }
+}
+
+bool PosixClient::is_busy() const
+{
+    return state != State::IDLE;
+}
+
+std::shared_ptr<EpollLoop> PosixClient::get_loop() const
+{
+    return loop;
+}
+
+bool PosixClient::connect_server()
+{
+    // Get server address and port from server.info - read again only if it changed
+    if (!endpoints.load_server_info()) {
+        std::cerr << "Was not able to parse server address and port" << std::endl;
+        return false;
+    }
+    begin_phase(RequestPhase::RESOLVE);
+
+    // Resolve the server address and port - unless they are cached
+    resolve_again = endpoints.is_resolved();
+    if (!endpoints.resolve()) return false;
+    begin_phase(RequestPhase::CONNECT);
+
+    next_address = 0;
+    return try_next_address();
+}
+
+bool PosixClient::try_next_address()
+{
+    // Attempt to connect to an address until one succeeds or is in progress
+    const std::vector<Endpoint>& addresses = endpoints.get_addresses();
+    for (; next_address < addresses.size(); next_address++) {
+        const Endpoint& endpoint = addresses[next_address];
+
+        // Create a non-blocking socket for connecting to server
+        connect_socket = socket(endpoint.family, endpoint.socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, endpoint.protocol);
+        if (connect_socket < 0) {
+            std::cerr << "socket failed with error: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        if (connect(connect_socket, reinterpret_cast<const struct sockaddr*>(&endpoint.address), endpoint.address_length) == 0) {
+            loop->add(connect_socket, 0, this);
+            on_connected();
+            return true;
+        }
+
+        if (errno == EINPROGRESS) {
+            // Wait for the socket to become writable
+            next_address++;
+            state = State::CONNECTING;
+            loop->add(connect_socket, EPOLLOUT, this);
+            return true;
+        }
+
+        close(connect_socket);
+        connect_socket = -1;
+    }
+
+    if (connect_socket >= 0) {
+        close(connect_socket);
+        connect_socket = -1;
+    }
+
+    // Every cached address failed - the server may have moved, so resolve it again
+    if (resolve_again) {
+        resolve_again = false;
+        endpoints.invalidate();
+        if (endpoints.resolve()) {
+            next_address = 0;
+            return try_next_address();
+        }
+        return false;
+    }
+
+    std::cerr << "Unable to connect to server!" << std::endl;
+    return false;
+}
+
+void PosixClient::on_connected()
+{
+    // Header and payload are sent separately - don't let Nagle hold the payload
+    // back while waiting for the header to be acknowledged on a reused connection
+    int no_delay = 1;
+    setsockopt(connect_socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    requests_on_connection = 0;
+    begin_phase(RequestPhase::HEADER_SEND);
+    if (pipeline_requests != nullptr) {
+        start_pipeline();
+    }
+    else {
+        start_sending();
+    }
+}
+
+void PosixClient::start_sending()
+{
+    // Gather the request header and the payload views - no copy into a send buffer
+    send_buffers.clear();
+    send_buffers.push_back({ &request_header, sizeof(request_header) });
+    for (const ConstBuffer& buffer : payload_buffers) {
+        if (buffer.size > 0) {
+            send_buffers.push_back({ const_cast<void*>(buffer.data), buffer.size });
+        }
+    }
+    send_index = 0;
+    payload_source_done = false;
+
+    state = State::SENDING;
+    loop->modify(connect_socket, EPOLLOUT, this);
+    handle_send();
+}
+
+void PosixClient::close_connection()
+{
+    if (connect_socket >= 0) {
+        loop->remove(connect_socket);
+        close(connect_socket);
+        connect_socket = -1;
+    }
+    requests_on_connection = 0;
+}
+
+bool PosixClient::async_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ResponseCallback callback, PayloadHandler on_payload, PayloadSource* payload_source)
+{
+    if (state != State::IDLE) {
+        std::cerr << "A request is already in flight" << std::endl;
+        return false;
+    }
+
+    bool session = keep_alive && server_supports_sessions;
+
+    last_outcome = RequestOutcome::FAILED;
+    this->request_header = request_header;
+    this->payload_buffers = payload_buffers;
+    this->callback = std::move(callback);
+    this->payload_handler = std::move(on_payload);
+    this->payload_source = payload_source;
+    one_shot = !session;
+    reused_connection = session && connect_socket >= 0;
+    header_bytes_received = 0;
+    payload_bytes_received = 0;
+    start_metrics(request_header.code, reused_connection ? RequestPhase::HEADER_SEND : RequestPhase::SERVER_INFO);
+
+    if (reused_connection) {
+        // Send over the open session
+        start_sending();
+        return true;
+    }
+
+    // First connect to server
+    close_connection();
+    if (!connect_server()) {
+        finish_metrics(false);
+        this->callback = nullptr;
+        this->payload_handler = nullptr;
+        this->payload_source = nullptr;
+        this->payload_buffers.clear();
+        return false;
+    }
+    return true;
+}
+
+void PosixClient::advance_send_buffers(size_t bytes_sent)
+{
+    // Skip the buffers that were sent and advance into a partially sent one
+    while (send_index < send_buffers.size() && bytes_sent >= send_buffers[send_index].iov_len) {
+        bytes_sent -= send_buffers[send_index].iov_len;
+        send_index++;
+    }
+    if (send_index < send_buffers.size()) {
+        send_buffers[send_index].iov_base = static_cast<uint8_t*>(send_buffers[send_index].iov_base) + bytes_sent;
+        send_buffers[send_index].iov_len -= bytes_sent;
+    }
+}
+
+void PosixClient::handle_send()
+{
+    // Send the request header and payload with vectored writes until everything is sent
+    while (true)
+    {
+        if (send_index == send_buffers.size())
+        {
+            if (payload_source == nullptr || payload_source_done) break;
+
+            // Send the streamed part of the payload as it is produced
+            ConstBuffer part{};
+            if (!payload_source->next(part)) {
+                std::cerr << "Failed to produce request payload" << std::endl;
+                complete(false);
+                return;
+            }
+            if (part.size == 0) {
+                payload_source_done = true;
+                break;
+            }
+            send_buffers.assign(1, { const_cast<void*>(part.data), part.size });
+            send_index = 0;
+        }
+
+        struct msghdr message{};
+        message.msg_iov = &send_buffers[send_index];
+        message.msg_iovlen = std::min<size_t>(send_buffers.size() - send_index, IOV_MAX);
+
+        ssize_t iBytesSent = sendmsg(connect_socket, &message, MSG_NOSIGNAL);
+        if (iBytesSent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return; // Wait for EPOLLOUT
+            if (errno == EINTR) continue;
+            if (!reused_connection) {
+                std::cerr << "send failed with error: " << strerror(errno) << std::endl;
+            }
+            on_connection_dropped();
+            return;
+        }
+        stats.bytes_sent += static_cast<uint64_t>(iBytesSent);
+        advance_send_buffers(static_cast<size_t>(iBytesSent));
+
+        // The header is the first view - whatever follows it is the payload
+        if (current_phase == RequestPhase::HEADER_SEND && send_index > 0 && (send_index < send_buffers.size() || payload_source != nullptr)) {
+            begin_phase(RequestPhase::PAYLOAD_SEND);
+        }
+    }
+    begin_phase(RequestPhase::FIRST_BYTE);
+
+    // One-shot: shut down the send half because no more data will be sent
+    if (one_shot && shutdown(connect_socket, SHUT_WR) < 0) {
+        std::cerr << "shutdown failed: " << strerror(errno) << std::endl;
+        complete(false);
+        return;
+    }
+
+    // Wait for the response
+    state = State::RECEIVING_HEADER;
+    loop->modify(connect_socket, EPOLLIN | EPOLLRDHUP, this);
+    handle_receive();
+}
+
+void PosixClient::handle_receive()
+{
+    while (true)
+    {
+        ssize_t iBytesReceived;
+        if (state == State::RECEIVING_HEADER) {
+            // Retrieve the response header
+            iBytesReceived = recv(connect_socket, reinterpret_cast<uint8_t*>(&response_header) + header_bytes_received, sizeof(response_header) - header_bytes_received, 0);
+        }
+        else if (payload_handler) {
+            // Retrieve the next chunk of a streamed payload.
+            // Framed by the payload size so the connection can be reused
+            size_t bytes_left = response_header.payload_size - payload_bytes_received;
+            iBytesReceived = recv(connect_socket, &receive_chunk[0], std::min(bytes_left, RECEIVE_CHUNK_SIZE), 0);
+        }
+        else {
+            // Retrieve the payload straight into its buffer
+            iBytesReceived = recv(connect_socket, &server_payload[payload_bytes_received], server_payload.size() - payload_bytes_received, 0);
+        }
+
+        if (iBytesReceived < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return; // Wait for EPOLLIN
+            if (errno == EINTR) continue;
+        }
+        if (iBytesReceived <= 0) {
+            if (state == State::RECEIVING_HEADER && header_bytes_received == 0) {
+                // Nothing was received - the server closed the connection without handling the request
+                on_connection_dropped();
+            }
+            else {
+                std::cerr << "recv failed or connection closed" << std::endl;
+                complete(false);
+            }
+            return;
+        }
+        stats.bytes_received += static_cast<uint64_t>(iBytesReceived);
+
+        if (state == State::RECEIVING_HEADER) {
+            if (header_bytes_received == 0) begin_phase(RequestPhase::PAYLOAD_RECEIVE);
+            header_bytes_received += static_cast<size_t>(iBytesReceived);
+            if (header_bytes_received < sizeof(response_header)) continue;
+
+            // Size the payload buffer once from the header
+            state = State::RECEIVING_PAYLOAD;
+            payload_bytes_received = 0;
+            if (payload_handler) {
+                receive_chunk.resize(RECEIVE_CHUNK_SIZE);
+            }
+            else {
+                server_payload.resize(response_header.payload_size);
+            }
+        }
+        else {
+            payload_bytes_received += static_cast<size_t>(iBytesReceived);
+            if (payload_handler && !payload_handler(&receive_chunk[0], static_cast<size_t>(iBytesReceived))) {
+                std::cerr << "Response payload rejected" << std::endl;
+                complete(false);
+                return;
+            }
+        }
+
+        if (payload_bytes_received == response_header.payload_size) {
+            requests_on_connection++;
+            stats.requests++;
+            complete(true);
+            return;
+        }
+    }
+}
+
+void PosixClient::on_events(uint32_t)
+{
+    switch (state)
+    {
+    case State::CONNECTING:
+    {
+        int error = 0;
+        socklen_t error_length = sizeof(error);
+        getsockopt(connect_socket, SOL_SOCKET, SO_ERROR, &error, &error_length);
+        if (error != 0) {
+            // Connect to this address failed - try the next one
+            loop->remove(connect_socket);
+            close(connect_socket);
+            connect_socket = -1;
+            if (!try_next_address()) complete(false);
+            return;
+        }
+        on_connected();
+        break;
+    }
+    case State::SENDING:
+        handle_send();
+        break;
+    case State::RECEIVING_HEADER:
+    case State::RECEIVING_PAYLOAD:
+        handle_receive();
+        break;
+    case State::PIPELINING:
+        handle_pipeline();
+        break;
+    case State::IDLE:
+        // Nothing is expected on an idle session - the server closed it
+        close_connection();
+        break;
+    }
+}
+
+void PosixClient::on_connection_dropped()
+{
+    if (!reused_connection) {
+        std::cerr << "recv failed or connection closed" << std::endl;
+        last_outcome = RequestOutcome::REJECTED;
+        complete(false);
+        return;
+    }
+
+    // The server closed the idle session. Count sessions that only served a single request,
+    // a server that does this repeatedly is closing the connection after every response
+    if (requests_on_connection == 1 && ++single_request_sessions >= MAX_SINGLE_REQUEST_SESSIONS) {
+        server_supports_sessions = false;
+        one_shot = true;
+    }
+
+    // Reconnect transparently and send the request again
+    restart_phases(RequestPhase::SERVER_INFO);
+    reused_connection = false;
+    header_bytes_received = 0;
+    payload_bytes_received = 0;
+    close_connection();
+    if (payload_source != nullptr && !payload_source->rewind()) {
+        complete(false);
+        return;
+    }
+    if (!connect_server()) complete(false);
+}
+
+void PosixClient::start_metrics(ServerRequestCodes code, RequestPhase first_phase)
+{
+    metrics_code = code;
+    request_start = RequestMetrics::start(metrics);
+    phase_start = request_start;
+    current_phase = first_phase;
+    request_bytes_sent = stats.bytes_sent;
+    request_bytes_received = stats.bytes_received;
+}
+
+void PosixClient::begin_phase(RequestPhase phase)
+{
+    if (phase_start == 0) return;
+
+    uint64_t now = RequestMetrics::now_ns();
+    metrics->record_phase(metrics_code, current_phase, now - phase_start);
+    current_phase = phase;
+    phase_start = now;
+}
+
+void PosixClient::restart_phases(RequestPhase phase)
+{
+    if (phase_start == 0) return;
+
+    current_phase = phase;
+    phase_start = RequestMetrics::now_ns();
+}
+
+void PosixClient::finish_metrics(bool success)
+{
+    if (request_start == 0) return;
+
+    // The last phase of a successful request is receiving its payload
+    if (success) begin_phase(RequestPhase::PAYLOAD_RECEIVE);
+    metrics->record_request(metrics_code, success, RequestMetrics::now_ns() - request_start,
+        stats.bytes_sent - request_bytes_sent, stats.bytes_received - request_bytes_received);
+    request_start = 0;
+    phase_start = 0;
+}
+
+void PosixClient::complete(bool success)
+{
+    if (pipeline_requests != nullptr) {
+        finish_pipeline(success);
+        return;
+    }
+    finish_metrics(success);
+    if (success) last_outcome = RequestOutcome::SUCCESS;
+
+    if (success && requests_on_connection > 1) {
+        // Server kept the session open for more than one request
+        single_request_sessions = 0;
+    }
+
+    // cleanup - keep the connection only for a healthy session
+    if (one_shot || !success) {
+        close_connection();
+    }
+    else {
+        // Keep watching the idle session so a close by the server is noticed early
+        loop->modify(connect_socket, EPOLLIN | EPOLLRDHUP, this);
+    }
+
+    state = State::IDLE;
+    payload_handler = nullptr;
+    payload_source = nullptr;
+    payload_buffers.clear();
+    send_buffers.clear();
+
+    ServerResponseHeader header = success ? response_header : ServerResponseHeader{};
+    std::vector<uint8_t> payload;
+    if (success) payload.swap(server_payload);
+    server_payload.clear();
+
+    ResponseCallback done = std::move(callback);
+    callback = nullptr;
+    if (done) done(success, header, payload);
+}
+
+bool PosixClient::send_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload)
+{
+    server_payload.clear();
+    return wait_for_request(request_header, payload_buffers, response_header, &server_payload, nullptr);
+}
+
+bool PosixClient::send_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, PayloadSource& payload_source, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload)
+{
+    server_payload.clear();
+    return wait_for_request(request_header, payload_buffers, response_header, &server_payload, nullptr, &payload_source);
+}
+
+bool PosixClient::send_request_streamed(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, const PayloadHandler& on_payload)
+{
+    return wait_for_request(request_header, payload_buffers, response_header, nullptr, on_payload);
+}
+
+bool PosixClient::wait_for_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, std::vector<uint8_t>* server_payload, PayloadHandler on_payload, PayloadSource* payload_source)
+{
+    bool done = false;
+    bool succeeded = false;
+
+    bool started = async_request(request_header, payload_buffers,
+        [&](bool success, const ServerResponseHeader& header, std::vector<uint8_t>& payload) {
+            done = true;
+            succeeded = success;
+            response_header = header;
+            if (server_payload != nullptr) server_payload->swap(payload);
+        }, std::move(on_payload), payload_source);
+    if (!started) return false;
+
+    // Run the loop until our request completes - other clients on the loop are served meanwhile
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+    while (!done)
+    {
+        auto time_left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (time_left <= 0 || loop->run_once(static_cast<int>(time_left)) < 0) {
+            std::cerr << "Request timed out" << std::endl;
+            complete(false);
+            break;
+        }
+    }
+
+    // Exit success
+    return succeeded;
+}
+
+bool PosixClient::send_pipelined(const std::vector<PipelinedRequest>& requests, size_t max_in_flight, const PipelinedResponseHandler& on_response)
+{
+    if (requests.empty()) return true;
+    if (state != State::IDLE) {
+        std::cerr << "A request is already in flight" << std::endl;
+        return false;
+    }
+
+    // Responses can only be matched on a connection that stays open between them
+    if (!keep_alive || !server_supports_sessions || !server_supports_pipelining) {
+        return send_sequential(requests, on_response);
+    }
+
+    pipeline_requests = &requests;
+    pipeline_handler = &on_response;
+    first_request_id = make_pipelined_headers(requests, pipeline_headers);
+    pipeline_answered.assign(requests.size(), false);
+    pipeline_depth = std::max<size_t>(max_in_flight, 1);
+    pipeline_completed = 0;
+    pipeline_succeeded = true;
+    one_shot = false;
+    reused_connection = connect_socket >= 0;
+
+    // Connecting is timed under the code of the first request, the requests themselves one by one
+    start_metrics(requests[0].header.code, reused_connection ? RequestPhase::HEADER_SEND : RequestPhase::SERVER_INFO);
+    pipeline_queued_at.assign(request_start != 0 ? requests.size() : 0, request_start);
+
+    if (reused_connection) {
+        // Send over the open session
+        start_pipeline();
+    }
+    else {
+        // First connect to server
+        close_connection();
+        if (!connect_server()) finish_pipeline(false);
+    }
+
+    // Run the loop until every request completes - the timeout restarts with every response
+    size_t completed = pipeline_completed;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+    while (pipeline_requests != nullptr)
+    {
+        if (pipeline_completed != completed) {
+            completed = pipeline_completed;
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+        }
+        auto time_left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (time_left <= 0 || loop->run_once(static_cast<int>(time_left)) < 0) {
+            std::cerr << "Request timed out" << std::endl;
+            finish_pipeline(false);
+        }
+    }
+
+    if (pipeline_fallback) {
+        // The server answered without a request id - send it the requests left one by one
+        pipeline_fallback = false;
+        std::vector<bool> answered = std::move(pipeline_answered);
+        return send_sequential(requests, on_response, &answered) && pipeline_succeeded;
+    }
+    return pipeline_succeeded;
+}
+
+void PosixClient::start_pipeline()
+{
+    // Phases of requests in flight overlap - only connecting is timed by phase
+    phase_start = 0;
+
+    send_buffers.clear();
+    send_index = 0;
+    pipeline_sent = 0;
+    pipeline_bytes_in_flight = 0;
+    header_bytes_received = 0;
+    payload_bytes_received = 0;
+    receive_chunk.resize(RECEIVE_CHUNK_SIZE);
+
+    state = State::PIPELINING;
+    handle_pipeline();
+}
+
+void PosixClient::queue_pipelined_requests()
+{
+    // Forget the views that were sent so the list doesn't grow with the number of requests
+    if (send_index == send_buffers.size()) {
+        send_buffers.clear();
+        send_index = 0;
+    }
+
+    // Queue requests until the window is full - each one is its header and payload views
+    while (pipeline_sent < pipeline_requests->size() && pipeline_sent - pipeline_completed < pipeline_depth &&
+        fits_pipeline_budget(pipeline_headers[pipeline_sent], pipeline_bytes_in_flight))
+    {
+        if (!pipeline_queued_at.empty()) pipeline_queued_at[pipeline_sent] = RequestMetrics::now_ns();
+        pipeline_bytes_in_flight += sizeof(PipelinedRequestHeader) + pipeline_headers[pipeline_sent].header.payload_size;
+        send_buffers.push_back({ &pipeline_headers[pipeline_sent], sizeof(PipelinedRequestHeader) });
+        for (const ConstBuffer& buffer : (*pipeline_requests)[pipeline_sent].payload_buffers) {
+            if (buffer.size > 0) {
+                send_buffers.push_back({ const_cast<void*>(buffer.data), buffer.size });
+            }
+        }
+        pipeline_sent++;
+    }
+}
+
+void PosixClient::handle_pipeline()
+{
+    while (true)
+    {
+        queue_pipelined_requests();
+
+        // Send the queued requests until the socket buffer is full
+        while (send_index < send_buffers.size())
+        {
+            struct msghdr message{};
+            message.msg_iov = &send_buffers[send_index];
+            message.msg_iovlen = std::min<size_t>(send_buffers.size() - send_index, IOV_MAX);
+
+            ssize_t iBytesSent = sendmsg(connect_socket, &message, MSG_NOSIGNAL);
+            if (iBytesSent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break; // Wait for EPOLLOUT
+                if (errno == EINTR) continue;
+                if (!reused_connection) {
+                    std::cerr << "send failed with error: " << strerror(errno) << std::endl;
+                }
+                if (pipeline_completed == 0 && header_bytes_received == 0) {
+                    on_connection_dropped();
+                }
+                else {
+                    finish_pipeline(false);
+                }
+                return;
+            }
+            stats.bytes_sent += static_cast<uint64_t>(iBytesSent);
+            advance_send_buffers(static_cast<size_t>(iBytesSent));
+        }
+
+        // Dispatch the responses that arrived - they make room in the window for more requests
+        size_t completed = pipeline_completed;
+        if (!receive_pipelined_responses()) return;
+        if (pipeline_completed == completed) break;
+    }
+
+    // Wait for responses, and for room in the socket buffer while requests are left to send
+    uint32_t events = EPOLLIN | EPOLLRDHUP;
+    if (send_index < send_buffers.size()) events |= EPOLLOUT;
+    loop->modify(connect_socket, events, this);
+}
+
+bool PosixClient::receive_pipelined_responses()
+{
+    while (true)
+    {
+        ssize_t iBytesReceived = recv(connect_socket, &receive_chunk[0], RECEIVE_CHUNK_SIZE, 0);
+        if (iBytesReceived < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true; // Wait for EPOLLIN
+            if (errno == EINTR) continue;
+        }
+        if (iBytesReceived <= 0) {
+            if (pipeline_completed == 0 && header_bytes_received == 0) {
+                // Nothing was received - the server closed the connection without handling the requests
+                on_connection_dropped();
+            }
+            else {
+                std::cerr << "recv failed or connection closed" << std::endl;
+                finish_pipeline(false);
+            }
+            return false;
+        }
+        stats.bytes_received += static_cast<uint64_t>(iBytesReceived);
+
+        // A chunk may hold any number of responses, split it into headers and payloads
+        const uint8_t* data = &receive_chunk[0];
+        size_t size = static_cast<size_t>(iBytesReceived);
+        while (size > 0)
+        {
+            if (header_bytes_received < sizeof(pipelined_response))
+            {
+                size_t header_part = std::min(size, sizeof(pipelined_response) - header_bytes_received);
+                memcpy(reinterpret_cast<uint8_t*>(&pipelined_response) + header_bytes_received, data, header_part);
+                header_bytes_received += header_part;
+                data += header_part;
+                size -= header_part;
+                if (header_bytes_received < sizeof(pipelined_response)) break;
+
+                if (pipelined_response.header.version != PIPELINED_PROTOCOL_VERSION) {
+                    std::cerr << "Server does not support pipelined requests" << std::endl;
+
+                    // An older server answers the first request with its own version - fall back to one by one
+                    if (pipeline_completed == 0) {
+                        server_supports_pipelining = false;
+                        pipeline_fallback = true;
+                    }
+                    finish_pipeline(false);
+                    return false;
+                }
+                server_payload.resize(pipelined_response.header.payload_size);
+                payload_bytes_received = 0;
+            }
+
+            size_t payload_part = std::min(size, server_payload.size() - payload_bytes_received);
+            if (payload_part > 0) {
+                memcpy(&server_payload[payload_bytes_received], data, payload_part);
+                payload_bytes_received += payload_part;
+                stats.bytes_copied += payload_part;
+                data += payload_part;
+                size -= payload_part;
+            }
+
+            if (payload_bytes_received == server_payload.size() && !dispatch_pipelined_response()) return false;
+        }
+    }
+}
+
+bool PosixClient::dispatch_pipelined_response()
+{
+    // Find the request by its id
+    uint32_t index = pipelined_response.request_id - first_request_id;
+    header_bytes_received = 0;
+    if (index >= pipeline_sent || pipeline_answered[index]) {
+        std::cerr << "Server responded to an unknown request" << std::endl;
+        finish_pipeline(false);
+        return false;
+    }
+
+    if (!pipeline_queued_at.empty()) {
+        uint64_t request_bytes = sizeof(PipelinedRequestHeader) + pipeline_headers[index].header.payload_size;
+        metrics->record_request(pipeline_headers[index].header.code, true, RequestMetrics::now_ns() - pipeline_queued_at[index],
+            request_bytes, sizeof(PipelinedResponseHeader) + server_payload.size());
+    }
+
+    pipeline_answered[index] = true;
+    pipeline_bytes_in_flight -= sizeof(PipelinedRequestHeader) + pipeline_headers[index].header.payload_size;
+    pipeline_completed++;
+    requests_on_connection++;
+    stats.requests++;
+    (*pipeline_handler)(index, true, pipelined_response.header, server_payload);
+    server_payload.clear();
+
+    if (pipeline_completed == pipeline_requests->size()) {
+        finish_pipeline(true);
+        return false;
+    }
+    return true;
+}
+
+void PosixClient::finish_pipeline(bool success)
+{
+    if (success && requests_on_connection > 1) {
+        // Server kept the session open for more than one request
+        single_request_sessions = 0;
+    }
+
+    // cleanup - keep the connection only for a healthy session
+    if (!success) {
+        close_connection();
+    }
+    else {
+        loop->modify(connect_socket, EPOLLIN | EPOLLRDHUP, this);
+    }
+
+    const std::vector<PipelinedRequest>* requests = pipeline_requests;
+    const PipelinedResponseHandler* handler = pipeline_handler;
+    pipeline_requests = nullptr;
+    pipeline_handler = nullptr;
+    state = State::IDLE;
+    send_buffers.clear();
+    server_payload.clear();
+    header_bytes_received = 0;
+
+    if (!success && !pipeline_fallback) {
+        // Report the requests left without a response
+        pipeline_succeeded = false;
+        ServerResponseHeader empty_header{};
+        std::vector<uint8_t> empty_payload;
+        uint64_t now = RequestMetrics::now_ns();
+        for (size_t i = 0; i < requests->size(); i++) {
+            if (pipeline_answered[i]) continue;
+            if (!pipeline_queued_at.empty()) {
+                metrics->record_request((*requests)[i].header.code, false, now - pipeline_queued_at[i], 0, 0);
+            }
+            (*handler)(i, false, empty_header, empty_payload);
+        }
+    }
+    pipeline_queued_at.clear();
+    request_start = 0;
+}
+
+#endif // !_WIN32
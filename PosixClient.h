@@ -0,0 +1,194 @@
+#pragma once
+#ifndef _WIN32
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "EpollLoop.h"
+#include "ProtocolHeaders.h"
+#include "Transport.h"
+
+// Non-blocking POSIX sockets backend of the transport, driven by an epoll event loop.
+// Many clients can share one loop: while any of them waits for its response the loop
+// keeps serving the others, and asynchronous requests complete from EpollLoop::run_once
+class PosixClient : public Transport, private EpollHandler
+{
+public:
+	// Called when a request completes. On failure the header and payload are empty
+	typedef std::function<void(bool success, const ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload)> ResponseCallback;
+
+private:
+	// Time to wait for a full response in the blocking send_request
+	static constexpr int REQUEST_TIMEOUT_MS = 30000;
+
+	// Number of sessions in a row that the server closed right after the first response
+	// before we decide it does not support sessions and fall back to one-shot connections
+	static constexpr int MAX_SINGLE_REQUEST_SESSIONS = 2;
+
+	enum class State
+	{
+		IDLE,
+		CONNECTING,
+		SENDING,
+		RECEIVING_HEADER,
+		RECEIVING_PAYLOAD,
+		PIPELINING,
+	};
+
+	std::shared_ptr<EpollLoop> loop;
+	int connect_socket = -1;
+	State state = State::IDLE;
+
+	// Session mode, see WinsockClient
+	bool keep_alive = true;
+	bool server_supports_sessions = true;
+	uint32_t requests_on_connection = 0;
+	int single_request_sessions = 0;
+
+	// Cached address to try next while connecting. If the cached addresses all fail,
+	// the server is resolved again once in case it moved
+	size_t next_address = 0;
+	bool resolve_again = false;
+
+	// Request in flight - the payload buffers are owned by the caller until the callback is called
+	ServerRequestHeader request_header{};
+	std::vector<ConstBuffer> payload_buffers;
+
+	// Streamed rest of the payload - optional
+	PayloadSource* payload_source = nullptr;
+	bool payload_source_done = false;
+
+	// Header and payload views still to be sent, starting at send_index
+	std::vector<struct iovec> send_buffers;
+	size_t send_index = 0;
+	bool one_shot = false;
+	bool reused_connection = false;
+	ResponseCallback callback;
+
+	// Response being received
+	ServerResponseHeader response_header{};
+	size_t header_bytes_received = 0;
+	size_t payload_bytes_received = 0;
+	std::vector<uint8_t> server_payload;
+
+	// Set for streamed responses - the payload is received through receive_chunk
+	PayloadHandler payload_handler;
+	std::vector<uint8_t> receive_chunk;
+
+	// Pipelined exchange in progress - set only in the PIPELINING state.
+	// Request i has the id first_request_id + i
+	const std::vector<PipelinedRequest>* pipeline_requests = nullptr;
+	const PipelinedResponseHandler* pipeline_handler = nullptr;
+	std::vector<PipelinedRequestHeader> pipeline_headers;
+	std::vector<bool> pipeline_answered;
+	uint32_t first_request_id = 0;
+	size_t pipeline_depth = 0;
+	size_t pipeline_sent = 0;       // Requests queued for sending
+	size_t pipeline_completed = 0;  // Requests that got their response
+	size_t pipeline_bytes_in_flight = 0; // Bytes of the queued requests still waiting for a response
+	bool pipeline_succeeded = true;
+	bool pipeline_fallback = false; // The requests left are to be sent one by one
+	PipelinedResponseHeader pipelined_response{};
+
+	// Timing of the request in flight - request_start is 0 when metrics are not recorded.
+	// Pipelined requests are timed one by one from the moment they are queued
+	ServerRequestCodes metrics_code{};
+	uint64_t request_start = 0;
+	uint64_t phase_start = 0;
+	RequestPhase current_phase = RequestPhase::SERVER_INFO;
+	uint64_t request_bytes_sent = 0;     // Transport counters when the request started
+	uint64_t request_bytes_received = 0;
+	std::vector<uint64_t> pipeline_queued_at;
+
+	PosixClient(const PosixClient&) = delete;
+	PosixClient& operator=(const PosixClient&) = delete;
+
+	// Look up the server of server.info and start connecting its addresses
+	bool connect_server();
+
+	// Start a non-blocking connect to the next resolved address
+	bool try_next_address();
+
+	// Connection is established - start sending the request
+	void on_connected();
+
+	// Gather the request header and payload views and start sending them
+	void start_sending();
+
+	// Close the current connection socket (if open)
+	void close_connection();
+
+	// Skip bytes_sent bytes of send_buffers, starting at send_index
+	void advance_send_buffers(size_t bytes_sent);
+
+	// Socket state machine steps
+	void handle_send();
+	void handle_receive();
+	void on_events(uint32_t events) override;
+
+	// The server closed the connection before sending any part of the response
+	void on_connection_dropped();
+
+	// Pipelined exchange steps - queue requests while the window has room, send them
+	// and dispatch every response that arrived, whatever request it belongs to
+	void start_pipeline();
+	void queue_pipelined_requests();
+	void handle_pipeline();
+	bool receive_pipelined_responses();
+	bool dispatch_pipelined_response();
+
+	// Finish the pipelined exchange, reporting the requests left without a response as failed
+	void finish_pipeline(bool success);
+
+	// Start timing the request in flight from its first phase
+	void start_metrics(ServerRequestCodes code, RequestPhase first_phase);
+
+	// Record the phase in progress and start timing the next one
+	void begin_phase(RequestPhase phase);
+
+	// Start the phases over without recording the one in progress - the request is sent again
+	void restart_phases(RequestPhase phase);
+
+	// Record the whole request and stop timing it
+	void finish_metrics(bool success);
+
+	// Finish the request in flight and notify its caller
+	void complete(bool success);
+
+	// Start a request and run the loop until it completes
+	bool wait_for_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, std::vector<uint8_t>* server_payload, PayloadHandler on_payload, PayloadSource* payload_source = nullptr);
+
+public:
+	// Each client gets its own loop unless one is shared between clients
+	PosixClient();
+	explicit PosixClient(std::shared_ptr<EpollLoop> shared_loop);
+	~PosixClient() override;
+
+	void set_keep_alive(bool enable) override;
+
+	using Transport::send_request;
+	bool send_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload) override;
+
+	bool send_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, PayloadSource& payload_source, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload) override;
+
+	bool send_request_streamed(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, const PayloadHandler& on_payload) override;
+
+	bool send_pipelined(const std::vector<PipelinedRequest>& requests, size_t max_in_flight, const PipelinedResponseHandler& on_response) override;
+
+	// Start a request without waiting for it. Only one request may be in flight per client,
+	// the payload buffers and source must stay alive until the callback is called from the event loop.
+	// If on_payload is given the payload is streamed to it and the callback gets an empty payload
+	bool async_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ResponseCallback callback, PayloadHandler on_payload = nullptr, PayloadSource* payload_source = nullptr);
+
+	// True while a request is in flight
+	bool is_busy() const;
+
+	std::shared_ptr<EpollLoop> get_loop() const;
+};
+
+#endif // !_WIN32
@@ -0,0 +1,305 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "ProtocolHeaders.h"
+
+// Typed access to the wire format of the structs in ProtocolHeaders.h.
+// A view reads the fields of a struct straight out of received bytes and a writer serializes them
+// straight into an output buffer, so neither copies nor allocates. Integers are little endian on the
+// wire whatever the host byte order, and need no alignment. Readers only hand out views that fit in
+// their buffer. Every codec is generated from a field list that is checked at compile time against
+// the offsets, sizes and types of its packed struct
+namespace ProtocolCodec
+{
+	// Unsigned integer an integer or enum field is stored as
+	template<typename T, bool = std::is_enum<T>::value>
+	struct WireInteger
+	{
+		typedef typename std::make_unsigned<T>::type type;
+	};
+
+	template<typename T>
+	struct WireInteger<T, true>
+	{
+		typedef typename std::make_unsigned<typename std::underlying_type<T>::type>::type type;
+	};
+
+	// Little endian field at p - compilers turn the byte loops into single moves
+	template<typename T>
+	inline T load(const uint8_t* p)
+	{
+		typedef typename WireInteger<T>::type U;
+		U value = 0;
+		for (size_t i = 0; i < sizeof(U); i++) {
+			value |= static_cast<U>(static_cast<U>(p[i]) << (8 * i));
+		}
+		return static_cast<T>(value);
+	}
+
+	template<typename T>
+	inline void store(uint8_t* p, T value)
+	{
+		typedef typename WireInteger<T>::type U;
+		U bits = static_cast<U>(value);
+		for (size_t i = 0; i < sizeof(U); i++) {
+			p[i] = static_cast<uint8_t>(bits >> (8 * i));
+		}
+	}
+
+	// Where a codec field is, and whether the struct member there has the field's type
+	struct FieldLayout
+	{
+		size_t offset;
+		size_t size;
+		bool matches_member;
+	};
+
+	// Fields follow each other from the start to the end of the struct without gaps
+	template<size_t N>
+	constexpr bool is_matching_layout(const FieldLayout (&fields)[N], size_t struct_size)
+	{
+		size_t end = 0;
+		for (size_t i = 0; i < N; i++) {
+			if (fields[i].offset != end || !fields[i].matches_member) return false;
+			end += fields[i].size;
+		}
+		return end == struct_size;
+	}
+
+	// Cursor over received bytes
+	class Reader
+	{
+		const uint8_t* data;
+		size_t size;
+		size_t offset = 0;
+
+	public:
+		Reader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+		// View of the next struct, false if it doesn't fit in what is left
+		template<typename View>
+		bool read(View& view)
+		{
+			if (size - offset < View::SIZE) return false;
+			view = View(data + offset);
+			offset += View::SIZE;
+			return true;
+		}
+
+		// The next length bytes
+		bool read_bytes(size_t length, const uint8_t*& bytes)
+		{
+			if (size - offset < length) return false;
+			bytes = data + offset;
+			offset += length;
+			return true;
+		}
+
+		const uint8_t* position() const { return data + offset; }
+		size_t remaining() const { return size - offset; }
+		bool at_end() const { return offset == size; }
+	};
+
+	// Structs back to back, e.g. the entries of a client list
+	template<typename View>
+	class ArrayView
+	{
+		const uint8_t* data = nullptr;
+		size_t count = 0;
+
+	public:
+		ArrayView() = default;
+
+		// False unless size is a whole number of structs
+		static bool parse(const uint8_t* data, size_t size, ArrayView& array)
+		{
+			if (size % View::SIZE != 0) return false;
+			array.data = data;
+			array.count = size / View::SIZE;
+			return true;
+		}
+
+		size_t size() const { return count; }
+		View operator[](size_t index) const { return View(data + index * View::SIZE); }
+	};
+
+	// Append a zeroed struct to out and return its writer - valid until out grows again
+	template<typename Writer>
+	Writer append(std::vector<uint8_t>& out)
+	{
+		size_t offset = out.size();
+		out.resize(offset + Writer::SIZE);
+		return Writer(out.data() + offset);
+	}
+}
+
+// Field kinds of the codec field lists - refer to Wire, the struct of the class they expand in
+
+#define PROTOCOL_VIEW_INTEGER(type, name) \
+	type name() const { return ProtocolCodec::load<type>(data + offsetof(Wire, name)); }
+#define PROTOCOL_VIEW_BYTES(name, length) \
+	const uint8_t* name() const { return data + offsetof(Wire, name); }
+#define PROTOCOL_VIEW_TEXT(name, length) \
+	std::string_view name() const { \
+		const char* text = reinterpret_cast<const char*>(data + offsetof(Wire, name)); \
+		return std::string_view(text, strnlen(text, length)); \
+	}
+#define PROTOCOL_VIEW_STRUCT(type, name) \
+	type##View name() const { return type##View(data + offsetof(Wire, name)); }
+
+#define PROTOCOL_WRITER_INTEGER(type, name) \
+	void set_##name(type value) { ProtocolCodec::store<type>(data + offsetof(Wire, name), value); }
+#define PROTOCOL_WRITER_BYTES(name, length) \
+	void set_##name(const void* bytes) { memcpy(data + offsetof(Wire, name), bytes, length); }
+#define PROTOCOL_WRITER_TEXT(name, length) \
+	void set_##name(std::string_view text) { \
+		size_t size = text.size() < length ? text.size() : length; \
+		memcpy(data + offsetof(Wire, name), text.data(), size); \
+		memset(data + offsetof(Wire, name) + size, 0, length - size); \
+	}
+#define PROTOCOL_WRITER_STRUCT(type, name) \
+	type##Writer name() { return type##Writer(data + offsetof(Wire, name)); }
+
+#define PROTOCOL_DECODE_INTEGER(type, name) value.name = name();
+#define PROTOCOL_DECODE_BYTES(name, length) memcpy(value.name, data + offsetof(Wire, name), length);
+#define PROTOCOL_DECODE_TEXT(name, length) memcpy(value.name, data + offsetof(Wire, name), length);
+#define PROTOCOL_DECODE_STRUCT(type, name) value.name = name().to_struct();
+
+#define PROTOCOL_ENCODE_INTEGER(type, name) set_##name(value.name);
+#define PROTOCOL_ENCODE_BYTES(name, length) set_##name(value.name);
+#define PROTOCOL_ENCODE_TEXT(name, length) memcpy(data + offsetof(Wire, name), value.name, length);
+#define PROTOCOL_ENCODE_STRUCT(type, name) name().assign(value.name);
+
+#define PROTOCOL_LAYOUT_INTEGER(type, name) \
+	{ offsetof(Wire, name), sizeof(type), std::is_same<decltype(Wire::name), type>::value },
+#define PROTOCOL_LAYOUT_BYTES(name, length) \
+	{ offsetof(Wire, name), length, std::is_array<decltype(Wire::name)>::value && sizeof(Wire::name) == length },
+#define PROTOCOL_LAYOUT_TEXT(name, length) \
+	{ offsetof(Wire, name), length, std::is_same<decltype(Wire::name), char[length]>::value },
+#define PROTOCOL_LAYOUT_STRUCT(type, name) \
+	{ offsetof(Wire, name), sizeof(type), std::is_same<decltype(Wire::name), type>::value },
+
+// Generates StructView and StructWriter from a field list macro taking the four field kinds
+#define PROTOCOL_CODEC(Struct, FIELDS) \
+	class Struct##View \
+	{ \
+		const uint8_t* data = nullptr; \
+	public: \
+		typedef Struct Wire; \
+		static constexpr size_t SIZE = sizeof(Struct); \
+		static constexpr ProtocolCodec::FieldLayout LAYOUT[] = { \
+			FIELDS(PROTOCOL_LAYOUT_INTEGER, PROTOCOL_LAYOUT_BYTES, PROTOCOL_LAYOUT_TEXT, PROTOCOL_LAYOUT_STRUCT) \
+		}; \
+		Struct##View() = default; \
+		explicit Struct##View(const uint8_t* data) : data(data) {} \
+		const uint8_t* bytes() const { return data; } \
+		FIELDS(PROTOCOL_VIEW_INTEGER, PROTOCOL_VIEW_BYTES, PROTOCOL_VIEW_TEXT, PROTOCOL_VIEW_STRUCT) \
+		/* Copy to a host struct, for a header that has to outlive its buffer */ \
+		Struct to_struct() const { \
+			Struct value{}; \
+			FIELDS(PROTOCOL_DECODE_INTEGER, PROTOCOL_DECODE_BYTES, PROTOCOL_DECODE_TEXT, PROTOCOL_DECODE_STRUCT) \
+			return value; \
+		} \
+	}; \
+	static_assert(ProtocolCodec::is_matching_layout(Struct##View::LAYOUT, sizeof(Struct)), "Codec of " #Struct " doesn't match the struct"); \
+	class Struct##Writer \
+	{ \
+		uint8_t* data; \
+	public: \
+		typedef Struct Wire; \
+		static constexpr size_t SIZE = sizeof(Struct); \
+		explicit Struct##Writer(uint8_t* data) : data(data) {} \
+		uint8_t* bytes() const { return data; } \
+		FIELDS(PROTOCOL_WRITER_INTEGER, PROTOCOL_WRITER_BYTES, PROTOCOL_WRITER_TEXT, PROTOCOL_WRITER_STRUCT) \
+		void assign(const Struct& value) { \
+			FIELDS(PROTOCOL_ENCODE_INTEGER, PROTOCOL_ENCODE_BYTES, PROTOCOL_ENCODE_TEXT, PROTOCOL_ENCODE_STRUCT) \
+		} \
+	};
+
+// Field lists, in the order of the struct members
+
+#define SERVER_REQUEST_HEADER_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	BYTES(client_id, CLIENT_ID_LENGTH) \
+	INTEGER(uint8_t, version) \
+	INTEGER(ServerRequestCodes, code) \
+	INTEGER(uint32_t, payload_size)
+
+#define SERVER_RESPONSE_HEADER_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	INTEGER(uint8_t, version) \
+	INTEGER(ServerResponseCodes, code) \
+	INTEGER(uint32_t, payload_size)
+
+#define PIPELINED_REQUEST_HEADER_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	STRUCT(ServerRequestHeader, header) \
+	INTEGER(uint32_t, request_id)
+
+#define PIPELINED_RESPONSE_HEADER_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	STRUCT(ServerResponseHeader, header) \
+	INTEGER(uint32_t, request_id)
+
+#define REGISTRATION_PAYLOAD_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	TEXT(name, MAX_REGISTRATION_NAME_LENGTH) \
+	BYTES(public_key, PUBLIC_KEY_LENGTH)
+
+#define CLIENT_LIST_ENTRY_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	BYTES(client_id, CLIENT_ID_LENGTH) \
+	TEXT(name, MAX_REGISTRATION_NAME_LENGTH)
+
+#define CLIENT_LIST_DELTA_REQUEST_PAYLOAD_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	INTEGER(uint64_t, directory_id) \
+	INTEGER(uint64_t, cursor)
+
+#define CLIENT_LIST_DELTA_RESPONSE_HEADER_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	INTEGER(uint64_t, directory_id) \
+	INTEGER(uint64_t, cursor) \
+	INTEGER(uint8_t, full_list)
+
+#define RETRIEVE_CLIENT_PUBLIC_KEY_PAYLOAD_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	BYTES(client_id, CLIENT_ID_LENGTH)
+
+#define SEND_MESSAGE_TO_CLIENT_PAYLOAD_HEADER_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	BYTES(client_id, CLIENT_ID_LENGTH) \
+	INTEGER(ClientMessageType, message_type) \
+	INTEGER(uint32_t, content_size)
+
+#define SEND_MESSAGES_BATCH_PAYLOAD_HEADER_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	INTEGER(uint32_t, message_count)
+
+#define BATCH_MESSAGE_RESULT_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	BYTES(client_id, CLIENT_ID_LENGTH) \
+	INTEGER(uint32_t, message_id) \
+	INTEGER(BatchMessageStatus, status)
+
+#define WAITING_MESSAGES_LONG_POLL_PAYLOAD_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	INTEGER(uint32_t, timeout_ms)
+
+#define WAITING_MESSAGE_RESPONSE_HEADER_FIELDS(INTEGER, BYTES, TEXT, STRUCT) \
+	BYTES(client_id, CLIENT_ID_LENGTH) \
+	INTEGER(uint32_t, message_id) \
+	INTEGER(ClientMessageType, message_type) \
+	INTEGER(uint32_t, message_size)
+
+namespace ProtocolCodec
+{
+	PROTOCOL_CODEC(ServerRequestHeader, SERVER_REQUEST_HEADER_FIELDS)
+	PROTOCOL_CODEC(ServerResponseHeader, SERVER_RESPONSE_HEADER_FIELDS)
+	PROTOCOL_CODEC(PipelinedRequestHeader, PIPELINED_REQUEST_HEADER_FIELDS)
+	PROTOCOL_CODEC(PipelinedResponseHeader, PIPELINED_RESPONSE_HEADER_FIELDS)
+	PROTOCOL_CODEC(RegistrationPayload, REGISTRATION_PAYLOAD_FIELDS)
+	PROTOCOL_CODEC(ClientListEntry, CLIENT_LIST_ENTRY_FIELDS)
+	PROTOCOL_CODEC(ClientListDeltaRequestPayload, CLIENT_LIST_DELTA_REQUEST_PAYLOAD_FIELDS)
+	PROTOCOL_CODEC(ClientListDeltaResponseHeader, CLIENT_LIST_DELTA_RESPONSE_HEADER_FIELDS)
+	PROTOCOL_CODEC(RetrieveClientPublicKeyPayload, RETRIEVE_CLIENT_PUBLIC_KEY_PAYLOAD_FIELDS)
+	PROTOCOL_CODEC(SendMessageToClientPayloadHeader, SEND_MESSAGE_TO_CLIENT_PAYLOAD_HEADER_FIELDS)
+	PROTOCOL_CODEC(SendMessagesBatchPayloadHeader, SEND_MESSAGES_BATCH_PAYLOAD_HEADER_FIELDS)
+	PROTOCOL_CODEC(BatchMessageResult, BATCH_MESSAGE_RESULT_FIELDS)
+	PROTOCOL_CODEC(WaitingMessagesLongPollPayload, WAITING_MESSAGES_LONG_POLL_PAYLOAD_FIELDS)
+	PROTOCOL_CODEC(WaitingMessageResponseHeader, WAITING_MESSAGE_RESPONSE_HEADER_FIELDS)
+
+	typedef ArrayView<ClientListEntryView> ClientListEntries;
+}
@@ -9,6 +9,9 @@ constexpr uint32_t CLIENT_ID_LENGTH = 16;
 constexpr uint32_t MAX_REGISTRATION_NAME_LENGTH = 255;
 constexpr uint32_t PUBLIC_KEY_LENGTH = 160;
 
+// Version of the request and response headers that carry a request id
+constexpr uint8_t PIPELINED_PROTOCOL_VERSION = 3;
+
 // Enums
 
 enum class ServerRequestCodes : uint16_t
@@ -18,6 +21,9 @@ enum class ServerRequestCodes : uint16_t
 	PUBLIC_KEY_REQUEST = 1002,
 	SEND_MESSAGE_TO_CLIENT = 1003,
 	WAITING_MESSAGES_REQUEST = 1004,
+	CLIENT_LIST_DELTA_REQUEST = 1005,
+	SEND_MESSAGES_BATCH = 1006,
+	WAITING_MESSAGES_LONG_POLL = 1007,
 };
 
 enum class ClientMessageType : uint8_t
@@ -26,6 +32,8 @@ enum class ClientMessageType : uint8_t
 	SEND_SYMMETRIC_KEY = 2,
 	SEND_TEXT_MESSAGE = 3,
 	SEND_FILE = 4,
+	SEND_COMPRESSED_TEXT_MESSAGE = 5, // Content is an LZCompressor stream, then encrypted
+	SEND_COMPRESSED_FILE = 6,
 };
 
 enum class ServerResponseCodes : uint16_t
@@ -35,6 +43,8 @@ enum class ServerResponseCodes : uint16_t
 	PUBLIC_KEY_RESPONSE = 2002,
 	MESSAGE_TO_CLIENT_SENT_TO_SERVER = 2003,
 	WAITING_MESSAGES_RESPONSE = 2004,
+	CLIENT_LIST_DELTA_RESPONSE = 2005,
+	MESSAGES_BATCH_SENT_TO_SERVER = 2006,
 	GENERAL_FAILURE = 9000
 };
 
@@ -55,12 +65,49 @@ struct ServerResponseHeader
 	uint32_t payload_size;
 };
 
+// Version 3 headers - the header above followed by an id chosen by the client.
+// Every response carries the id of its request, so a connection can have many requests in flight
+struct PipelinedRequestHeader
+{
+	ServerRequestHeader header;
+	uint32_t request_id;
+};
+
+struct PipelinedResponseHeader
+{
+	ServerResponseHeader header;
+	uint32_t request_id;
+};
+
 struct RegistrationPayload
 {
 	char name[MAX_REGISTRATION_NAME_LENGTH] = { 0 };
 	char public_key[PUBLIC_KEY_LENGTH];
 };
 
+// One client in CLIENT_LIST_RESPONSE and CLIENT_LIST_DELTA_RESPONSE
+struct ClientListEntry
+{
+	uint8_t client_id[CLIENT_ID_LENGTH];
+	char name[MAX_REGISTRATION_NAME_LENGTH]; // Null terminated unless it takes the whole field
+};
+
+// Directory the client already has - zeros for none
+struct ClientListDeltaRequestPayload
+{
+	uint64_t directory_id;
+	uint64_t cursor;
+};
+
+// Followed by the clients added since the cursor in the request, or by all of them
+// if full_list is set (e.g. the directory id changed because the server restarted)
+struct ClientListDeltaResponseHeader
+{
+	uint64_t directory_id;
+	uint64_t cursor;
+	uint8_t full_list;
+};
+
 struct RetrieveClientPublicKeyPayload
 {
 	uint8_t client_id[CLIENT_ID_LENGTH];
@@ -73,6 +120,34 @@ struct SendMessageToClientPayloadHeader
 	uint32_t content_size;
 };
 
+// SEND_MESSAGES_BATCH payload starts with this header and then message_count times
+// a SendMessageToClientPayloadHeader followed by its content
+struct SendMessagesBatchPayloadHeader
+{
+	uint32_t message_count;
+};
+
+enum class BatchMessageStatus : uint8_t
+{
+	QUEUED = 0,
+	DESTINATION_NOT_FOUND = 1,
+};
+
+// MESSAGES_BATCH_SENT_TO_SERVER payload is message_count of these, in the order of the request
+struct BatchMessageResult
+{
+	uint8_t client_id[CLIENT_ID_LENGTH];
+	uint32_t message_id;
+	BatchMessageStatus status;
+};
+
+// The server holds WAITING_MESSAGES_LONG_POLL until a message is queued or timeout_ms passed,
+// and then answers with WAITING_MESSAGES_RESPONSE (empty on timeout)
+struct WaitingMessagesLongPollPayload
+{
+	uint32_t timeout_ms;
+};
+
 struct WaitingMessageResponseHeader
 {
 	uint8_t client_id[CLIENT_ID_LENGTH];
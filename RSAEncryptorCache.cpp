@@ -0,0 +1,47 @@
+#include "RSAEncryptorCache.h"
+
+bool RSAEncryptorCache::put(uint32_t key_index, const uint8_t* public_key, unsigned int length)
+{
+    if (key_index >= encryptors.size()) {
+        encryptors.resize(static_cast<size_t>(key_index) + 1);
+    }
+
+    try {
+        encryptors[key_index] = std::make_unique<RSAPublicEncryptor>(reinterpret_cast<const char*>(public_key), length);
+    }
+    catch (const CryptoPP::Exception&) {
+        encryptors[key_index].reset();
+        return false;
+    }
+    return true;
+}
+
+const RSAPublicEncryptor* RSAEncryptorCache::get(uint32_t key_index)
+{
+    if (key_index < encryptors.size() && encryptors[key_index]) {
+        hits++;
+        return encryptors[key_index].get();
+    }
+    misses++;
+    return NULL;
+}
+
+void RSAEncryptorCache::clear()
+{
+    encryptors.clear();
+}
+
+std::string RSAEncryptorCache::encrypt(const RSAPublicEncryptor& encryptor, const char* plain, unsigned int length)
+{
+    return encryptor.encrypt(rng, plain, length);
+}
+
+uint64_t RSAEncryptorCache::get_hits() const
+{
+    return hits;
+}
+
+uint64_t RSAEncryptorCache::get_misses() const
+{
+    return misses;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <osrng.h>
+
+#include "RSAWrapper.h"
+
+// Ready to use RSA encryptors of peers' public keys, indexed by the contact's public key index.
+// Each key is parsed once when it arrives, and all encryptions share one seeded RNG
+class RSAEncryptorCache
+{
+	CryptoPP::AutoSeededRandomPool rng;
+	std::vector<std::unique_ptr<RSAPublicEncryptor>> encryptors;
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+public:
+	// Parse the key and keep its encryptor, replacing an older one. Returns false if the key is invalid
+	bool put(uint32_t key_index, const uint8_t* public_key, unsigned int length);
+
+	// Encryptor of the key or NULL if there is none - counted as a hit or a miss
+	const RSAPublicEncryptor* get(uint32_t key_index);
+
+	// Drop all encryptors - when the key indexes they were put under are reassigned
+	void clear();
+
+	std::string encrypt(const RSAPublicEncryptor& encryptor, const char* plain, unsigned int length);
+
+	uint64_t get_hits() const;
+	uint64_t get_misses() const;
+};
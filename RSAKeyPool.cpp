@@ -0,0 +1,104 @@
+#include "RSAKeyPool.h"
+
+#include <algorithm>
+#include <iostream>
+
+RSAKeyPool::RSAKeyPool(size_t capacity, size_t thread_count, uint64_t limit) : capacity(std::max<size_t>(capacity, 1)), limit(limit)
+{
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // More workers than pairs would only generate pairs that wait for room
+    thread_count = std::min(thread_count, this->capacity);
+    for (size_t i = 0; i < thread_count; i++) {
+        threads.emplace_back(&RSAKeyPool::run, this);
+    }
+}
+
+RSAKeyPool::~RSAKeyPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    space_cv.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void RSAKeyPool::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // Pairs being generated count as ready, so the workers don't overfill the pool
+        space_cv.wait(lock, [this]() { return stopping || pairs.size() + generating < capacity; });
+        if (stopping || (limit != 0 && started == limit)) return;
+        generating++;
+        started++;
+        lock.unlock();
+
+        // The prime search runs without the lock - it is what takes long
+        RSAKeyPair pair;
+        bool generated = false;
+        try {
+            RSAPrivateWrapper key;
+            pair.private_key = key.getPrivateKey();
+            key.getPublicKey(pair.public_key, RSAPublicWrapper::KEYSIZE);
+            generated = true;
+        }
+        catch (const CryptoPP::Exception& e) {
+            std::cerr << "RSA key generation failed: " << e.what() << std::endl;
+        }
+
+        lock.lock();
+        generating--;
+        if (generated) {
+            pairs.push_back(std::move(pair));
+            ready_cv.notify_one();
+        }
+        else {
+            // Try again - a limited pool still owes the pair
+            started--;
+        }
+    }
+}
+
+RSAKeyPair RSAKeyPool::take()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (pairs.empty()) {
+        misses++;
+        ready_cv.wait(lock, [this]() { return !pairs.empty(); });
+    }
+    else {
+        hits++;
+    }
+
+    RSAKeyPair pair = std::move(pairs.front());
+    pairs.pop_front();
+    lock.unlock();
+
+    // Room for the next pair
+    space_cv.notify_one();
+    return pair;
+}
+
+size_t RSAKeyPool::get_ready_count()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pairs.size();
+}
+
+uint64_t RSAKeyPool::get_hits()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+uint64_t RSAKeyPool::get_misses()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
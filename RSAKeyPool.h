@@ -0,0 +1,62 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RSAWrapper.h"
+
+// Generated key pair, in the forms registration uses
+struct RSAKeyPair
+{
+	std::string private_key; // DER, as saved in me.info
+	char public_key[RSAPublicWrapper::KEYSIZE];
+};
+
+// Generates RSA key pairs on background threads and keeps up to capacity of them ready,
+// so registering doesn't wait on the prime search. Workers sleep while the pool is full
+// and start the next pair as soon as one is taken
+class RSAKeyPool
+{
+	const size_t capacity;
+	const uint64_t limit;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable ready_cv;    // A pair was added
+	std::condition_variable space_cv;    // A pair was taken, or the pool is stopping
+	std::deque<RSAKeyPair> pairs;
+	size_t generating = 0;               // Pairs the workers are generating now
+	uint64_t started = 0;                // Pairs the workers started in all
+	bool stopping = false;
+
+	// Counters - updated under mutex
+	uint64_t hits = 0;     // Pairs that were ready when taken
+	uint64_t misses = 0;   // Takes that had to wait
+
+	RSAKeyPool(const RSAKeyPool&) = delete;
+	RSAKeyPool& operator=(const RSAKeyPool&) = delete;
+
+	// Worker thread main loop
+	void run();
+
+public:
+	// thread_count of 0 uses a thread per core, but no more than capacity.
+	// A limit stops the workers after that many pairs, e.g. when a known number of pairs is needed
+	explicit RSAKeyPool(size_t capacity, size_t thread_count = 1, uint64_t limit = 0);
+
+	// Waits for the pairs being generated
+	~RSAKeyPool();
+
+	// Take a ready pair, or wait for the next one if there is none. Must not be called
+	// for more pairs than the limit
+	RSAKeyPair take();
+
+	size_t get_ready_count();
+	uint64_t get_hits();
+	uint64_t get_misses();
+};
@@ -1,5 +1,7 @@
 #include "RSAWrapper.h"
 
+#include <stdexcept>
+
 
 RSAPublicWrapper::RSAPublicWrapper(const char* key, unsigned int length)
 {
@@ -50,6 +52,28 @@ std::string RSAPublicWrapper::encrypt(const char* plain, unsigned int length)
 
 
 
+RSAPublicEncryptor::RSAPublicEncryptor(const char* key, unsigned int length)
+{
+	CryptoPP::StringSource ss(reinterpret_cast<const CryptoPP::byte*>(key), length, true);
+	_encryptor.AccessKey().Load(ss);
+}
+
+RSAPublicEncryptor::~RSAPublicEncryptor()
+{
+}
+
+std::string RSAPublicEncryptor::encrypt(CryptoPP::RandomNumberGenerator& rng, const char* plain, unsigned int length) const
+{
+	if (length > _encryptor.FixedMaxPlaintextLength())
+		throw std::invalid_argument("plaintext is too long for RSA");
+
+	std::string cipher(_encryptor.CiphertextLength(length), '\0');
+	_encryptor.Encrypt(rng, reinterpret_cast<const CryptoPP::byte*>(plain), length, reinterpret_cast<CryptoPP::byte*>(&cipher[0]));
+	return cipher;
+}
+
+
+
 RSAPrivateWrapper::RSAPrivateWrapper()
 {
 	_privateKey.Initialize(_rng, BITS);
@@ -118,3 +142,38 @@ std::string RSAPrivateWrapper::decrypt(const char* cipher, unsigned int length)
 	CryptoPP::StringSource ss_cipher(reinterpret_cast<const CryptoPP::byte*>(cipher), length, true, new CryptoPP::PK_DecryptorFilter(_rng, d, new CryptoPP::StringSink(decrypted)));
 	return decrypted;
 }
+
+
+
+RSAPrivateDecryptor::RSAPrivateDecryptor(const std::string& key)
+{
+	CryptoPP::StringSource ss(key, true);
+	_decryptor.AccessKey().Load(ss);
+}
+
+RSAPrivateDecryptor::~RSAPrivateDecryptor()
+{
+}
+
+bool RSAPrivateDecryptor::decrypt(CryptoPP::RandomNumberGenerator& rng, const char* cipher, unsigned int length, std::string& plain) const
+{
+	plain.clear();
+	if (length != _decryptor.FixedCiphertextLength())
+		return false;
+
+	std::string decrypted(_decryptor.MaxPlaintextLength(length), '\0');
+	try
+	{
+		CryptoPP::DecodingResult result = _decryptor.Decrypt(rng, reinterpret_cast<const CryptoPP::byte*>(cipher), length, reinterpret_cast<CryptoPP::byte*>(&decrypted[0]));
+		if (!result.isValidCoding)
+			return false;
+		decrypted.resize(result.messageLength);
+	}
+	catch (const CryptoPP::Exception&)
+	{
+		return false;
+	}
+
+	plain.swap(decrypted);
+	return true;
+}
@@ -33,6 +33,22 @@ public:
 };
 
 
+// Public key parsed once into a ready OAEP encryptor - the RNG is supplied per call so it can be shared
+class RSAPublicEncryptor
+{
+private:
+	CryptoPP::RSAES_OAEP_SHA_Encryptor _encryptor;
+
+	RSAPublicEncryptor(const RSAPublicEncryptor& rsapublic);
+	RSAPublicEncryptor& operator=(const RSAPublicEncryptor& rsapublic);
+public:
+	RSAPublicEncryptor(const char* key, unsigned int length);
+	~RSAPublicEncryptor();
+
+	std::string encrypt(CryptoPP::RandomNumberGenerator& rng, const char* plain, unsigned int length) const;
+};
+
+
 class RSAPrivateWrapper
 {
 public:
@@ -59,3 +75,21 @@ public:
 	std::string decrypt(const std::string& cipher);
 	std::string decrypt(const char* cipher, unsigned int length);
 };
+
+
+// Private key parsed once into a ready OAEP decryptor. Decryption doesn't change it,
+// so threads with their own RNG can decrypt with it at the same time
+class RSAPrivateDecryptor
+{
+private:
+	CryptoPP::RSAES_OAEP_SHA_Decryptor _decryptor;
+
+	RSAPrivateDecryptor(const RSAPrivateDecryptor& rsaprivate);
+	RSAPrivateDecryptor& operator=(const RSAPrivateDecryptor& rsaprivate);
+public:
+	RSAPrivateDecryptor(const std::string& key);
+	~RSAPrivateDecryptor();
+
+	// Returns false if the ciphertext wasn't encrypted with this key
+	bool decrypt(CryptoPP::RandomNumberGenerator& rng, const char* cipher, unsigned int length, std::string& plain) const;
+};
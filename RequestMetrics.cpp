@@ -0,0 +1,250 @@
+#include "RequestMetrics.h"
+
+#include <fstream>
+#include <iomanip>
+
+const uint64_t LatencyHistogram::BUCKET_BOUNDS_NS[BUCKET_COUNT] = {
+    10000, 25000, 50000,                // 10us - 50us
+    100000, 250000, 500000,             // 100us - 500us
+    1000000, 2500000, 5000000,          // 1ms - 5ms
+    10000000, 25000000, 50000000,       // 10ms - 50ms
+    100000000, 250000000, 500000000,    // 100ms - 500ms
+    1000000000, 2500000000, 5000000000, // 1s - 5s
+    10000000000, 30000000000,           // 10s - 30s
+};
+
+void LatencyHistogram::record(uint64_t duration_ns)
+{
+    size_t bucket = 0;
+    while (bucket < BUCKET_COUNT && duration_ns > BUCKET_BOUNDS_NS[bucket]) {
+        bucket++;
+    }
+    buckets[bucket]++;
+    count++;
+    sum_ns += duration_ns;
+}
+
+uint64_t LatencyHistogram::estimate_percentile_ns(double fraction) const
+{
+    if (count == 0) return 0;
+
+    uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(count) + 0.5);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+        seen += buckets[bucket];
+        if (seen >= rank && seen > 0) return BUCKET_BOUNDS_NS[bucket];
+    }
+    return UINT64_MAX;
+}
+
+uint64_t LatencyHistogram::get_count() const
+{
+    return count;
+}
+
+uint64_t LatencyHistogram::get_sum_ns() const
+{
+    return sum_ns;
+}
+
+uint64_t LatencyHistogram::get_bucket(size_t index) const
+{
+    return buckets[index];
+}
+
+const char* RequestMetrics::get_phase_name(RequestPhase phase)
+{
+    switch (phase)
+    {
+    case RequestPhase::SERVER_INFO: return "server_info";
+    case RequestPhase::RESOLVE: return "resolve";
+    case RequestPhase::CONNECT: return "connect";
+    case RequestPhase::HEADER_SEND: return "header_send";
+    case RequestPhase::PAYLOAD_SEND: return "payload_send";
+    case RequestPhase::FIRST_BYTE: return "first_byte";
+    case RequestPhase::PAYLOAD_RECEIVE: return "payload_receive";
+    case RequestPhase::CRYPTO: return "crypto";
+    default: return "unknown";
+    }
+}
+
+const char* RequestMetrics::get_code_name(uint16_t code)
+{
+    switch (static_cast<ServerRequestCodes>(code))
+    {
+    case ServerRequestCodes::REGISTRATION_CLIENT_REQUEST: return "registration";
+    case ServerRequestCodes::CLIENT_LIST_REQUEST: return "client_list";
+    case ServerRequestCodes::PUBLIC_KEY_REQUEST: return "public_key";
+    case ServerRequestCodes::SEND_MESSAGE_TO_CLIENT: return "send_message";
+    case ServerRequestCodes::WAITING_MESSAGES_REQUEST: return "waiting_messages";
+    case ServerRequestCodes::CLIENT_LIST_DELTA_REQUEST: return "client_list_delta";
+    case ServerRequestCodes::SEND_MESSAGES_BATCH: return "send_messages_batch";
+    case ServerRequestCodes::WAITING_MESSAGES_LONG_POLL: return "waiting_messages_long_poll";
+    default: return "unknown";
+    }
+}
+
+void RequestMetrics::set_enabled(bool enable)
+{
+    enabled = enable;
+}
+
+bool RequestMetrics::is_enabled() const
+{
+    return enabled;
+}
+
+void RequestMetrics::record_phase(ServerRequestCodes code, RequestPhase phase, uint64_t duration_ns)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    codes[static_cast<uint16_t>(code)].phases[static_cast<size_t>(phase)].record(duration_ns);
+}
+
+void RequestMetrics::record_request(ServerRequestCodes code, bool success, uint64_t duration_ns, uint64_t bytes_sent, uint64_t bytes_received)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    CodeMetrics& code_metrics = codes[static_cast<uint16_t>(code)];
+    code_metrics.total.record(duration_ns);
+    if (success) {
+        code_metrics.succeeded++;
+    }
+    else {
+        code_metrics.failed++;
+    }
+    code_metrics.bytes_sent += bytes_sent;
+    code_metrics.bytes_received += bytes_received;
+}
+
+void RequestMetrics::set_gauge(const std::string& name, const std::string& help, double value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    gauges[name] = { help, value };
+}
+
+void RequestMetrics::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    codes.clear();
+}
+
+void RequestMetrics::print(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (codes.empty()) {
+        out << "No requests recorded" << (enabled ? "" : " (metrics are disabled)") << std::endl;
+    }
+
+    // Percentiles are bucket upper bounds, so they are an upper estimate
+    auto print_row = [&out](const char* name, const LatencyHistogram& histogram) {
+        out << "  " << std::left << std::setw(18) << name << std::right
+            << std::setw(8) << histogram.get_count()
+            << std::setw(12) << static_cast<double>(histogram.get_sum_ns()) / static_cast<double>(histogram.get_count()) / 1e6;
+        for (double fraction : { 0.5, 0.99 }) {
+            uint64_t bound = histogram.estimate_percentile_ns(fraction);
+            if (bound == UINT64_MAX) {
+                out << std::setw(12) << "> 30000";
+            }
+            else {
+                out << std::setw(12) << static_cast<double>(bound) / 1e6;
+            }
+        }
+        out << "\n";
+    };
+
+    out << std::fixed << std::setprecision(3);
+    for (const auto& entry : codes)
+    {
+        const CodeMetrics& code_metrics = entry.second;
+        out << get_code_name(entry.first) << " (" << entry.first << "): " << code_metrics.succeeded << " succeeded, "
+            << code_metrics.failed << " failed, " << code_metrics.bytes_sent << " bytes sent, " << code_metrics.bytes_received << " bytes received\n";
+        out << "  " << std::left << std::setw(18) << "phase" << std::right << std::setw(8) << "count"
+            << std::setw(12) << "mean ms" << std::setw(12) << "p50 <= ms" << std::setw(12) << "p99 <= ms" << "\n";
+
+        for (size_t phase = 0; phase < static_cast<size_t>(RequestPhase::COUNT); phase++) {
+            if (code_metrics.phases[phase].get_count() > 0) {
+                print_row(get_phase_name(static_cast<RequestPhase>(phase)), code_metrics.phases[phase]);
+            }
+        }
+        if (code_metrics.total.get_count() > 0) {
+            print_row("total", code_metrics.total);
+        }
+    }
+
+    for (const auto& gauge : gauges) {
+        out << gauge.first << " = " << gauge.second.second << "\n";
+    }
+    out << std::defaultfloat << std::flush;
+}
+
+void RequestMetrics::write_prometheus(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto write_histogram = [&out](const std::string& name, const std::string& labels, const LatencyHistogram& histogram) {
+        uint64_t cumulative = 0;
+        for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; bucket++) {
+            cumulative += histogram.get_bucket(bucket);
+            out << name << "_bucket{" << labels << ",le=\"" << static_cast<double>(LatencyHistogram::BUCKET_BOUNDS_NS[bucket]) / 1e9 << "\"} " << cumulative << "\n";
+        }
+        out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << histogram.get_count() << "\n";
+        out << name << "_sum{" << labels << "} " << static_cast<double>(histogram.get_sum_ns()) / 1e9 << "\n";
+        out << name << "_count{" << labels << "} " << histogram.get_count() << "\n";
+    };
+
+    auto code_labels = [](uint16_t code) {
+        return std::string("code=\"") + std::to_string(code) + "\",request=\"" + get_code_name(code) + "\"";
+    };
+
+    out << std::setprecision(9);
+
+    out << "# HELP messageu_request_phase_seconds Time spent in each phase of a request.\n";
+    out << "# TYPE messageu_request_phase_seconds histogram\n";
+    for (const auto& entry : codes) {
+        for (size_t phase = 0; phase < static_cast<size_t>(RequestPhase::COUNT); phase++) {
+            if (entry.second.phases[phase].get_count() > 0) {
+                write_histogram("messageu_request_phase_seconds", code_labels(entry.first) + ",phase=\"" + get_phase_name(static_cast<RequestPhase>(phase)) + "\"", entry.second.phases[phase]);
+            }
+        }
+    }
+
+    out << "# HELP messageu_request_duration_seconds Time from sending a request to receiving its whole response.\n";
+    out << "# TYPE messageu_request_duration_seconds histogram\n";
+    for (const auto& entry : codes) {
+        write_histogram("messageu_request_duration_seconds", code_labels(entry.first), entry.second.total);
+    }
+
+    out << "# HELP messageu_requests_total Completed requests by result.\n";
+    out << "# TYPE messageu_requests_total counter\n";
+    for (const auto& entry : codes) {
+        out << "messageu_requests_total{" << code_labels(entry.first) << ",result=\"success\"} " << entry.second.succeeded << "\n";
+        out << "messageu_requests_total{" << code_labels(entry.first) << ",result=\"failure\"} " << entry.second.failed << "\n";
+    }
+
+    out << "# HELP messageu_request_bytes_sent_total Bytes sent for requests, including headers.\n";
+    out << "# TYPE messageu_request_bytes_sent_total counter\n";
+    for (const auto& entry : codes) {
+        out << "messageu_request_bytes_sent_total{" << code_labels(entry.first) << "} " << entry.second.bytes_sent << "\n";
+    }
+
+    out << "# HELP messageu_request_bytes_received_total Bytes received in responses, including headers.\n";
+    out << "# TYPE messageu_request_bytes_received_total counter\n";
+    for (const auto& entry : codes) {
+        out << "messageu_request_bytes_received_total{" << code_labels(entry.first) << "} " << entry.second.bytes_received << "\n";
+    }
+
+    for (const auto& gauge : gauges) {
+        out << "# HELP " << gauge.first << " " << gauge.second.first << "\n";
+        out << "# TYPE " << gauge.first << " gauge\n";
+        out << gauge.first << " " << gauge.second.second << "\n";
+    }
+    out << std::flush;
+}
+
+bool RequestMetrics::write_prometheus(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) return false;
+    write_prometheus(file);
+    return file.good();
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "ProtocolHeaders.h"
+
+// Phases of a request, in the order they happen
+enum class RequestPhase
+{
+	SERVER_INFO,     // Reading server.info
+	RESOLVE,         // getaddrinfo
+	CONNECT,
+	HEADER_SEND,
+	PAYLOAD_SEND,
+	FIRST_BYTE,      // From the end of the request to the first byte of the response
+	PAYLOAD_RECEIVE, // From the first byte to the end of the response
+	CRYPTO,          // Encryption or decryption done by the caller for the request
+	COUNT
+};
+
+// Counts of durations in fixed buckets, cumulative like a Prometheus histogram when exported
+class LatencyHistogram
+{
+public:
+	// Upper bounds of the buckets in nanoseconds, the last bucket has no bound
+	static constexpr size_t BUCKET_COUNT = 20;
+	static const uint64_t BUCKET_BOUNDS_NS[BUCKET_COUNT];
+
+private:
+	uint64_t buckets[BUCKET_COUNT + 1] = {};
+	uint64_t count = 0;
+	uint64_t sum_ns = 0;
+
+public:
+	void record(uint64_t duration_ns);
+
+	// Upper bound of the bucket holding the given fraction of the samples (0 when empty, UINT64_MAX in the last bucket)
+	uint64_t estimate_percentile_ns(double fraction) const;
+
+	uint64_t get_count() const;
+	uint64_t get_sum_ns() const;
+	uint64_t get_bucket(size_t index) const;
+};
+
+// Phase timings, latency and bytes of the requests, by request code.
+// Recording is thread safe. While disabled, timing a phase costs one atomic load
+class RequestMetrics
+{
+	struct CodeMetrics
+	{
+		LatencyHistogram phases[static_cast<size_t>(RequestPhase::COUNT)];
+		LatencyHistogram total;
+		uint64_t succeeded = 0;
+		uint64_t failed = 0;
+		uint64_t bytes_sent = 0;
+		uint64_t bytes_received = 0;
+	};
+
+	std::atomic<bool> enabled{ true };
+	mutable std::mutex mutex;
+	std::map<uint16_t, CodeMetrics> codes;
+
+	// Values from outside the transport, e.g. cache counters - exported as they are
+	std::map<std::string, std::pair<std::string, double>> gauges;
+
+public:
+	static uint64_t now_ns()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	// Start time of a phase, or 0 if nothing is recorded
+	static uint64_t start(const RequestMetrics* metrics)
+	{
+		return metrics != nullptr && metrics->enabled.load(std::memory_order_relaxed) ? now_ns() : 0;
+	}
+
+	// Record the phase that began at start - does nothing if start is 0
+	static void finish(RequestMetrics* metrics, ServerRequestCodes code, RequestPhase phase, uint64_t start)
+	{
+		if (start != 0) metrics->record_phase(code, phase, now_ns() - start);
+	}
+
+	static const char* get_phase_name(RequestPhase phase);
+	static const char* get_code_name(uint16_t code);
+
+	void set_enabled(bool enable);
+	bool is_enabled() const;
+
+	void record_phase(ServerRequestCodes code, RequestPhase phase, uint64_t duration_ns);
+
+	// A request completed - its whole duration and the bytes it moved including headers
+	void record_request(ServerRequestCodes code, bool success, uint64_t duration_ns, uint64_t bytes_sent, uint64_t bytes_received);
+
+	void set_gauge(const std::string& name, const std::string& help, double value);
+
+	// Forget everything recorded so far
+	void reset();
+
+	// Table of the requests and phases for the console
+	void print(std::ostream& out) const;
+
+	// Prometheus text exposition format
+	void write_prometheus(std::ostream& out) const;
+	bool write_prometheus(const std::string& path) const;
+};
+
+// Times its scope as one phase of a request - does nothing when metrics are disabled or NULL
+class PhaseTimer
+{
+	RequestMetrics* metrics;
+	ServerRequestCodes code;
+	RequestPhase phase;
+	uint64_t start;
+
+	PhaseTimer(const PhaseTimer&) = delete;
+	PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+public:
+	PhaseTimer(RequestMetrics* metrics, ServerRequestCodes code, RequestPhase phase) :
+		metrics(metrics), code(code), phase(phase), start(RequestMetrics::start(metrics))
+	{
+	}
+
+	~PhaseTimer()
+	{
+		RequestMetrics::finish(metrics, code, phase, start);
+	}
+};
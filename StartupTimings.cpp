@@ -0,0 +1,48 @@
+#include "StartupTimings.h"
+
+#include <chrono>
+#include <iomanip>
+
+uint64_t StartupTimings::now_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+StartupTimings::StartupTimings() : start_ns(now_ns()), last_ns(start_ns)
+{
+}
+
+void StartupTimings::record(const std::string& name)
+{
+    uint64_t now = now_ns();
+    steps.push_back({ name, now - last_ns, false });
+    last_ns = now;
+}
+
+void StartupTimings::finish()
+{
+    ready_ns = now_ns();
+}
+
+void StartupTimings::record_deferred(const std::string& name, uint64_t duration_ns)
+{
+    steps.push_back({ name, duration_ns, true });
+}
+
+void StartupTimings::print(std::ostream& out) const
+{
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+
+    out << std::left << std::setw(32) << "Startup step" << std::right << std::setw(12) << "ms" << "\n";
+    for (const Step& step : steps) {
+        std::string name = step.deferred ? step.name + " (first use)" : step.name;
+        out << std::left << std::setw(32) << name << std::right << std::setw(12) << step.duration_ns / 1e6 << "\n";
+    }
+    if (ready_ns != 0) {
+        out << std::left << std::setw(32) << "total" << std::right << std::setw(12) << (ready_ns - start_ns) / 1e6 << "\n";
+    }
+
+    out.flags(flags);
+    out << std::flush;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Time spent in each step of starting the client, for finding what slows a cold start.
+// Steps are recorded as they finish - work deferred to its first use is recorded when it happens
+class StartupTimings
+{
+	struct Step
+	{
+		std::string name;
+		uint64_t duration_ns;
+		bool deferred;
+	};
+
+	uint64_t start_ns;
+	uint64_t last_ns;
+	uint64_t ready_ns = 0;
+	std::vector<Step> steps;
+
+public:
+	static uint64_t now_ns();
+
+	// Startup begins now
+	StartupTimings();
+
+	// A step ran since the previous one
+	void record(const std::string& name);
+
+	// Startup is done - the time from construction to here is the total
+	void finish();
+
+	// Work deferred past startup, that took duration_ns on its first use
+	void record_deferred(const std::string& name, uint64_t duration_ns);
+
+	void print(std::ostream& out) const;
+};
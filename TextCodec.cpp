@@ -0,0 +1,539 @@
+#include "TextCodec.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TEXT_CODEC_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC compiles any intrinsic without target flags
+#define TARGET_SSE4
+#define TARGET_AVX2
+#else
+// The vector paths are compiled for their instruction set only, the rest of the build stays generic
+#define TARGET_SSE4 __attribute__((target("ssse3,sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+    const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const char HEX_DIGITS[] = "0123456789abcdef";
+
+    // Values of chars outside the alphabets
+    constexpr uint8_t INVALID = 0xFF;
+    constexpr uint8_t WHITESPACE = 0xFE;
+    constexpr uint8_t PADDING = 0xFD;
+
+    constexpr std::array<uint8_t, 256> make_base64_table()
+    {
+        std::array<uint8_t, 256> table{};
+        for (size_t i = 0; i < table.size(); i++) {
+            table[i] = INVALID;
+        }
+        for (uint8_t i = 0; i < 64; i++) {
+            table[static_cast<uint8_t>(BASE64_ALPHABET[i])] = i;
+        }
+        table[' '] = table['\t'] = table['\r'] = table['\n'] = WHITESPACE;
+        table['='] = PADDING;
+        return table;
+    }
+
+    constexpr std::array<uint8_t, 256> make_hex_table()
+    {
+        std::array<uint8_t, 256> table{};
+        for (size_t i = 0; i < table.size(); i++) {
+            table[i] = INVALID;
+        }
+        for (uint8_t i = 0; i < 10; i++) {
+            table['0' + i] = i;
+        }
+        for (uint8_t i = 0; i < 6; i++) {
+            table['a' + i] = table['A' + i] = 10 + i;
+        }
+        return table;
+    }
+
+    constexpr std::array<uint8_t, 256> BASE64_TABLE = make_base64_table();
+    constexpr std::array<uint8_t, 256> HEX_TABLE = make_hex_table();
+
+    TextCodecIsa detect_isa()
+    {
+#if defined(TEXT_CODEC_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        int max_leaf = info[0];
+        __cpuid(info, 1);
+        bool ssse3 = (info[2] & (1 << 9)) != 0;
+        bool sse41 = (info[2] & (1 << 19)) != 0;
+
+        // AVX registers have to be saved by the OS too
+        bool avx2 = false;
+        if (max_leaf >= 7 && (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        bool ssse3 = __builtin_cpu_supports("ssse3");
+        bool sse41 = __builtin_cpu_supports("sse4.1");
+        bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+        if (ssse3 && sse41) {
+            return avx2 ? TextCodecIsa::AVX2 : TextCodecIsa::SSE4;
+        }
+#endif
+        return TextCodecIsa::SCALAR;
+    }
+
+    TextCodecIsa& active_isa()
+    {
+        static TextCodecIsa isa = TextCodec::get_supported_isa();
+        return isa;
+    }
+
+    // Encode whole groups of 3 bytes and the padded tail
+    void encode_base64_scalar(const uint8_t* data, size_t length, char* out)
+    {
+        size_t i = 0;
+        for (; i + 3 <= length; i += 3) {
+            uint32_t group = static_cast<uint32_t>(data[i]) << 16 | static_cast<uint32_t>(data[i + 1]) << 8 | data[i + 2];
+            *out++ = BASE64_ALPHABET[group >> 18];
+            *out++ = BASE64_ALPHABET[(group >> 12) & 0x3f];
+            *out++ = BASE64_ALPHABET[(group >> 6) & 0x3f];
+            *out++ = BASE64_ALPHABET[group & 0x3f];
+        }
+
+        size_t left = length - i;
+        if (left > 0) {
+            uint32_t group = static_cast<uint32_t>(data[i]) << 16 | (left == 2 ? static_cast<uint32_t>(data[i + 1]) << 8 : 0);
+            out[0] = BASE64_ALPHABET[group >> 18];
+            out[1] = BASE64_ALPHABET[(group >> 12) & 0x3f];
+            out[2] = left == 2 ? BASE64_ALPHABET[(group >> 6) & 0x3f] : '=';
+            out[3] = '=';
+        }
+    }
+
+#if defined(TEXT_CODEC_X86)
+    // Base64 encoding after W. Mula and D. Lemire: the bytes of each 3 byte group are spread over
+    // a 32 bit lane, the four 6 bit values are moved into its bytes with multiplies, and a shuffle
+    // looks up the offset from each value to its char
+
+    TARGET_SSE4 __m128i base64_split_sse4(__m128i in)
+    {
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        __m128i high = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i low = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        return _mm_or_si128(high, low);
+    }
+
+    TARGET_SSE4 __m128i base64_chars_sse4(__m128i values)
+    {
+        // 0 for a-z, 1-10 for 0-9, 11 and 12 for + and /, 13 for A-Z
+        __m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+        range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), values), _mm_set1_epi8(13)));
+        const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        return _mm_add_epi8(values, _mm_shuffle_epi8(offsets, range));
+    }
+
+    // Encode blocks of 12 bytes, returns the bytes encoded. Each block reads 16 bytes
+    TARGET_SSE4 size_t encode_base64_sse4(const uint8_t* data, size_t length, char* out)
+    {
+        size_t i = 0;
+        for (; i + 16 <= length; i += 12) {
+            __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), base64_chars_sse4(base64_split_sse4(in)));
+            out += 16;
+        }
+        return i;
+    }
+
+    // Encode blocks of 24 bytes, returns the bytes encoded. Each lane gets 12 of them, and reads 16
+    TARGET_AVX2 size_t encode_base64_avx2(const uint8_t* data, size_t length, char* out)
+    {
+        const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+        size_t i = 0;
+        for (; i + 28 <= length; i += 24) {
+            __m128i low_lane = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i high_lane = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 12));
+            __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(low_lane), high_lane, 1);
+
+            in = _mm256_shuffle_epi8(in, spread);
+            __m256i high = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+            __m256i low = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+            __m256i values = _mm256_or_si256(high, low);
+
+            __m256i range = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+            range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), values), _mm256_set1_epi8(13)));
+            __m256i chars = _mm256_add_epi8(values, _mm256_shuffle_epi8(offsets, range));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), chars);
+            out += 32;
+        }
+        return i;
+    }
+
+    // Decoding classifies each char by its nibbles: a shuffle of the low nibble gives the high
+    // nibbles it is invalid with, one of the high nibble gives its bit. The high nibble also
+    // picks the offset from the char to its 6 bit value, with / moved to an index of its own.
+    // Every four values are then packed into 3 bytes with multiply-adds
+
+    // Bits of the high nibbles 2, 3, 4 and 6, 5 and 7, and of all the others
+    alignas(16) const int8_t BASE64_HIGH_NIBBLE_BITS[16] = { 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 };
+
+    // Bits of the high nibbles each low nibble is invalid with
+    alignas(16) const int8_t BASE64_INVALID_HIGH_NIBBLES[16] = { 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A };
+
+    // Offset to the value by high nibble - / is at 1
+    alignas(16) const int8_t BASE64_OFFSETS[16] = { 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    // Shuffle table in each lane
+    TARGET_SSE4 __m128i load_table_sse4(const int8_t* table)
+    {
+        return _mm_load_si128(reinterpret_cast<const __m128i*>(table));
+    }
+
+    TARGET_AVX2 __m256i load_table_avx2(const int8_t* table)
+    {
+        return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+    }
+
+    // Returns false if any of the chars is outside the alphabet
+    TARGET_SSE4 bool base64_values_sse4(__m128i chars, __m128i& values)
+    {
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+        __m128i high = _mm_and_si128(_mm_srli_epi32(chars, 4), nibble);
+        __m128i invalid = _mm_shuffle_epi8(load_table_sse4(BASE64_INVALID_HIGH_NIBBLES), _mm_and_si128(chars, nibble));
+        if (!_mm_testz_si128(invalid, _mm_shuffle_epi8(load_table_sse4(BASE64_HIGH_NIBBLE_BITS), high))) return false;
+
+        __m128i slash = _mm_cmpeq_epi8(chars, _mm_set1_epi8('/'));
+        values = _mm_add_epi8(chars, _mm_shuffle_epi8(load_table_sse4(BASE64_OFFSETS), _mm_add_epi8(high, slash)));
+        return true;
+    }
+
+    // Decode blocks of 16 chars, returns the chars decoded. Stops at a block with whitespace,
+    // padding or an invalid char - the scalar loop takes it from there
+    TARGET_SSE4 size_t decode_base64_sse4(const char* text, size_t length, uint8_t* out)
+    {
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            __m128i values;
+            if (!base64_values_sse4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)), values)) break;
+
+            // a << 6 | b in each 16 bits, then ab << 12 | cd in each 32 bits, then its 3 bytes big endian
+            __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+            __m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+            __m128i bytes = _mm_shuffle_epi8(groups, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out), bytes);
+            uint32_t last = static_cast<uint32_t>(_mm_extract_epi32(bytes, 2));
+            memcpy(out + 8, &last, sizeof(last));
+            out += 12;
+        }
+        return i;
+    }
+
+    // Decode blocks of 32 chars, returns the chars decoded
+    TARGET_AVX2 size_t decode_base64_avx2(const char* text, size_t length, uint8_t* out)
+    {
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+
+            const __m256i nibble = _mm256_set1_epi8(0x0f);
+            __m256i high = _mm256_and_si256(_mm256_srli_epi32(chars, 4), nibble);
+            __m256i invalid = _mm256_shuffle_epi8(load_table_avx2(BASE64_INVALID_HIGH_NIBBLES), _mm256_and_si256(chars, nibble));
+            if (!_mm256_testz_si256(invalid, _mm256_shuffle_epi8(load_table_avx2(BASE64_HIGH_NIBBLE_BITS), high))) break;
+
+            __m256i slash = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('/'));
+            __m256i values = _mm256_add_epi8(chars, _mm256_shuffle_epi8(load_table_avx2(BASE64_OFFSETS), _mm256_add_epi8(high, slash)));
+
+            // Each lane packs its 12 bytes first, then they are moved together
+            __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+            __m256i groups = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+            __m256i bytes = _mm256_shuffle_epi8(groups, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(bytes));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 16), _mm256_extracti128_si256(bytes, 1));
+            out += 24;
+        }
+        return i;
+    }
+
+    size_t decode_base64_blocks(TextCodecIsa isa, const char* text, size_t length, uint8_t* out)
+    {
+        size_t consumed = 0;
+        if (isa == TextCodecIsa::AVX2) {
+            consumed = decode_base64_avx2(text, length, out);
+        }
+        if (isa >= TextCodecIsa::SSE4) {
+            consumed += decode_base64_sse4(text + consumed, length - consumed, out + consumed / 4 * 3);
+        }
+        return consumed;
+    }
+
+    // Hex splits each byte into its nibbles and looks up their digits with a shuffle
+
+    // Encode blocks of 16 bytes, returns the bytes encoded
+    TARGET_SSE4 size_t encode_hex_sse4(const uint8_t* data, size_t length, char* out)
+    {
+        const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(HEX_DIGITS));
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i high = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(in, 4), nibble));
+            __m128i low = _mm_shuffle_epi8(digits, _mm_and_si128(in, nibble));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(high, low));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+        }
+        return i;
+    }
+
+    // Encode blocks of 32 bytes, returns the bytes encoded
+    TARGET_AVX2 size_t encode_hex_avx2(const uint8_t* data, size_t length, char* out)
+    {
+        const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(HEX_DIGITS)));
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            __m256i high = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble));
+            __m256i low = _mm256_shuffle_epi8(digits, _mm256_and_si256(in, nibble));
+
+            // Unpacking works within lanes - put the halves back in order
+            __m256i first = _mm256_unpacklo_epi8(high, low);
+            __m256i second = _mm256_unpackhi_epi8(high, low);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+        }
+        return i;
+    }
+
+    // Returns false if any of the chars is not a hex digit
+    TARGET_SSE4 bool hex_values_sse4(__m128i chars, __m128i& values)
+    {
+        // Unsigned x <= max is min(x, max) == x
+        __m128i digit_value = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+        __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(digit_value, _mm_set1_epi8(9)), digit_value);
+        __m128i letter_value = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        __m128i letter = _mm_cmpeq_epi8(_mm_min_epu8(letter_value, _mm_set1_epi8(5)), letter_value);
+
+        if (_mm_movemask_epi8(_mm_or_si128(digit, letter)) != 0xFFFF) return false;
+        values = _mm_or_si128(_mm_and_si128(digit, digit_value), _mm_and_si128(letter, _mm_add_epi8(letter_value, _mm_set1_epi8(10))));
+        return true;
+    }
+
+    // Decode blocks of 16 bytes, returns the bytes decoded. Stops at a block with a non hex char
+    TARGET_SSE4 size_t decode_hex_sse4(const char* text, size_t count, uint8_t* out)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m128i first, second;
+            if (!hex_values_sse4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + 2 * i)), first) ||
+                !hex_values_sse4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + 2 * i + 16)), second)) break;
+
+            // high << 4 | low of each pair
+            const __m128i weights = _mm_set1_epi16(0x0110);
+            __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(first, weights), _mm_maddubs_epi16(second, weights));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), bytes);
+        }
+        return i;
+    }
+
+    // Decode blocks of 32 bytes, returns the bytes decoded
+    TARGET_AVX2 size_t decode_hex_avx2(const char* text, size_t count, uint8_t* out)
+    {
+        const __m256i weights = _mm256_set1_epi16(0x0110);
+
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32) {
+            __m256i values[2];
+            for (int half = 0; half < 2; half++) {
+                __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + 2 * i + 32 * half));
+                __m256i digit_value = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+                __m256i digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit_value, _mm256_set1_epi8(9)), digit_value);
+                __m256i letter_value = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+                __m256i letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter_value, _mm256_set1_epi8(5)), letter_value);
+
+                if (_mm256_movemask_epi8(_mm256_or_si256(digit, letter)) != -1) return i;
+                values[half] = _mm256_or_si256(_mm256_and_si256(digit, digit_value),
+                    _mm256_and_si256(letter, _mm256_add_epi8(letter_value, _mm256_set1_epi8(10))));
+            }
+
+            // Packing works within lanes - put the quarters back in order
+            __m256i bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(values[0], weights), _mm256_maddubs_epi16(values[1], weights));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute4x64_epi64(bytes, 0xD8));
+        }
+        return i;
+    }
+#endif
+}
+
+TextCodecIsa TextCodec::get_supported_isa()
+{
+    static const TextCodecIsa isa = detect_isa();
+    return isa;
+}
+
+TextCodecIsa TextCodec::get_isa()
+{
+    return active_isa();
+}
+
+void TextCodec::set_isa(TextCodecIsa isa)
+{
+    active_isa() = isa < get_supported_isa() ? isa : get_supported_isa();
+}
+
+const char* TextCodec::get_isa_name(TextCodecIsa isa)
+{
+    switch (isa)
+    {
+    case TextCodecIsa::SSE4:
+        return "sse4";
+    case TextCodecIsa::AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+size_t Base64Codec::encode(const uint8_t* data, size_t length, char* out)
+{
+    size_t consumed = 0;
+#if defined(TEXT_CODEC_X86)
+    TextCodecIsa isa = TextCodec::get_isa();
+    if (isa == TextCodecIsa::AVX2) {
+        consumed = encode_base64_avx2(data, length, out);
+    }
+    if (isa >= TextCodecIsa::SSE4) {
+        consumed += encode_base64_sse4(data + consumed, length - consumed, out + consumed / 3 * 4);
+    }
+#endif
+    encode_base64_scalar(data + consumed, length - consumed, out + consumed / 3 * 4);
+    return encoded_size(length);
+}
+
+bool Base64Codec::decode(const char* text, size_t length, uint8_t* out, size_t& decoded_size)
+{
+#if defined(TEXT_CODEC_X86)
+    TextCodecIsa isa = TextCodec::get_isa();
+#endif
+    size_t position = 0;
+    size_t written = 0;
+
+    // Values of the group being decoded
+    uint32_t group = 0;
+    int group_values = 0;
+    bool padded = false;
+
+    while (position < length) {
+#if defined(TEXT_CODEC_X86)
+        // Runs of whole groups go through the vector path - line breaks and the tail are left to this loop
+        if (group_values == 0 && isa != TextCodecIsa::SCALAR) {
+            size_t consumed = decode_base64_blocks(isa, text + position, length - position, out + written);
+            position += consumed;
+            written += consumed / 4 * 3;
+            if (position == length) break;
+        }
+#endif
+        uint8_t value = BASE64_TABLE[static_cast<uint8_t>(text[position++])];
+        if (value < 64) {
+            group = group << 6 | value;
+            if (++group_values == 4) {
+                out[written++] = static_cast<uint8_t>(group >> 16);
+                out[written++] = static_cast<uint8_t>(group >> 8);
+                out[written++] = static_cast<uint8_t>(group);
+                group = 0;
+                group_values = 0;
+            }
+        }
+        else if (value == PADDING) {
+            padded = true;
+            break;
+        }
+        else if (value != WHITESPACE) {
+            return false;
+        }
+    }
+
+    // Padding ends a group of 2 or 3 values, only padding and whitespace may follow it
+    if (padded) {
+        if (group_values < 2) return false;
+        for (; position < length; position++) {
+            uint8_t value = BASE64_TABLE[static_cast<uint8_t>(text[position])];
+            if (value != PADDING && value != WHITESPACE) return false;
+        }
+    }
+
+    if (group_values == 1) return false;
+    if (group_values == 2) {
+        out[written++] = static_cast<uint8_t>(group >> 4);
+    }
+    else if (group_values == 3) {
+        out[written++] = static_cast<uint8_t>(group >> 10);
+        out[written++] = static_cast<uint8_t>(group >> 2);
+    }
+
+    decoded_size = written;
+    return true;
+}
+
+void HexCodec::encode(const uint8_t* data, size_t length, char* out)
+{
+    size_t consumed = 0;
+#if defined(TEXT_CODEC_X86)
+    TextCodecIsa isa = TextCodec::get_isa();
+    if (isa == TextCodecIsa::AVX2) {
+        consumed = encode_hex_avx2(data, length, out);
+    }
+    if (isa >= TextCodecIsa::SSE4) {
+        consumed += encode_hex_sse4(data + consumed, length - consumed, out + 2 * consumed);
+    }
+#endif
+    for (size_t i = consumed; i < length; i++) {
+        out[2 * i] = HEX_DIGITS[data[i] >> 4];
+        out[2 * i + 1] = HEX_DIGITS[data[i] & 0x0f];
+    }
+}
+
+bool HexCodec::decode(const char* text, size_t length, uint8_t* out)
+{
+    if (length % 2 != 0) return false;
+
+    size_t count = length / 2;
+    size_t decoded = 0;
+#if defined(TEXT_CODEC_X86)
+    TextCodecIsa isa = TextCodec::get_isa();
+    if (isa == TextCodecIsa::AVX2) {
+        decoded = decode_hex_avx2(text, count, out);
+    }
+    if (isa >= TextCodecIsa::SSE4) {
+        decoded += decode_hex_sse4(text + 2 * decoded, count - decoded, out + decoded);
+    }
+#endif
+    // The rest, or the block a vector path stopped at
+    for (size_t i = decoded; i < count; i++) {
+        uint8_t high = HEX_TABLE[static_cast<uint8_t>(text[2 * i])];
+        uint8_t low = HEX_TABLE[static_cast<uint8_t>(text[2 * i + 1])];
+        if ((high | low) > 0x0f) return false;
+        out[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+    return true;
+}
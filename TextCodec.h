@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Base64 and hex codecs for keys and client ids, with SSE4 and AVX2 paths picked at run time.
+// They work on caller buffers and never allocate - size the output with encoded_size/max_decoded_size
+
+// Instruction sets the codecs have a path for
+enum class TextCodecIsa : uint8_t
+{
+	SCALAR = 0,
+	SSE4 = 1,
+	AVX2 = 2,
+};
+
+class TextCodec
+{
+public:
+	// Best instruction set of this CPU
+	static TextCodecIsa get_supported_isa();
+
+	// Instruction set in use - the supported one unless lowered with set_isa
+	static TextCodecIsa get_isa();
+
+	// Use another path, e.g. to compare them in the benchmark. Clamped to the supported one
+	static void set_isa(TextCodecIsa isa);
+
+	static const char* get_isa_name(TextCodecIsa isa);
+};
+
+// Standard alphabet with padding, no line breaks
+class Base64Codec
+{
+public:
+	static constexpr size_t encoded_size(size_t length) { return (length + 2) / 3 * 4; }
+
+	// Upper bound of the decoded size of length chars
+	static constexpr size_t max_decoded_size(size_t length) { return (length + 3) / 4 * 3; }
+
+	// Write encoded_size(length) chars to out, returns their count
+	static size_t encode(const uint8_t* data, size_t length, char* out);
+
+	// Decode to out, skipping whitespace. Returns false on any other char outside the alphabet
+	// or misplaced padding
+	static bool decode(const char* text, size_t length, uint8_t* out, size_t& decoded_size);
+};
+
+// Lower case hex, two chars per byte
+class HexCodec
+{
+public:
+	static constexpr size_t encoded_size(size_t length) { return length * 2; }
+
+	// Write encoded_size(length) chars to out
+	static void encode(const uint8_t* data, size_t length, char* out);
+
+	// Decode length / 2 bytes to out, either case. Returns false on an odd length or a non hex char
+	static bool decode(const char* text, size_t length, uint8_t* out);
+};
@@ -0,0 +1,84 @@
+#include "Transport.h"
+
+#ifdef _WIN32
+#include "WinsockClient.h"
+#else
+#include "PosixClient.h"
+#endif
+
+bool Transport::send_request(const ServerRequestHeader& request_header, const std::vector<uint8_t>& client_payload, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload)
+{
+    std::vector<ConstBuffer> payload_buffers;
+    if (!client_payload.empty()) {
+        payload_buffers.push_back({ client_payload.data(), client_payload.size() });
+    }
+    return send_request(request_header, payload_buffers, response_header, server_payload);
+}
+
+bool Transport::send_sequential(const std::vector<PipelinedRequest>& requests, const PipelinedResponseHandler& on_response, const std::vector<bool>* answered)
+{
+    bool all_succeeded = true;
+    ServerResponseHeader response_header{};
+    std::vector<uint8_t> server_payload;
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (answered != nullptr && (*answered)[i]) continue;
+
+        bool success = send_request(requests[i].header, requests[i].payload_buffers, response_header, server_payload);
+        if (!success) {
+            response_header = ServerResponseHeader{};
+            server_payload.clear();
+            all_succeeded = false;
+        }
+        on_response(i, success, response_header, server_payload);
+    }
+    return all_succeeded;
+}
+
+uint32_t Transport::make_pipelined_headers(const std::vector<PipelinedRequest>& requests, std::vector<PipelinedRequestHeader>& headers)
+{
+    uint32_t first_request_id = next_request_id;
+
+    headers.resize(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        headers[i].header = requests[i].header;
+        headers[i].header.version = PIPELINED_PROTOCOL_VERSION;
+        headers[i].request_id = next_request_id++;
+    }
+    return first_request_id;
+}
+
+bool Transport::fits_pipeline_budget(const PipelinedRequestHeader& request_header, size_t bytes_in_flight)
+{
+    // A request is always sent when nothing else is in flight, however large it is
+    return bytes_in_flight == 0 || bytes_in_flight + sizeof(request_header) + request_header.header.payload_size <= PIPELINE_SEND_BUDGET;
+}
+
+const TransportStats& Transport::get_stats() const
+{
+    return stats;
+}
+
+RequestOutcome Transport::get_last_outcome() const
+{
+    return last_outcome;
+}
+
+const EndpointCache& Transport::get_endpoint_cache() const
+{
+    return endpoints;
+}
+
+void Transport::set_metrics(RequestMetrics* request_metrics)
+{
+    metrics = request_metrics;
+}
+
+std::unique_ptr<Transport> Transport::create()
+{
+#ifdef _WIN32
+    return std::make_unique<WinsockClient>();
+#else
+    return std::make_unique<PosixClient>();
+#endif
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "EndpointCache.h"
+#include "ProtocolHeaders.h"
+#include "RequestMetrics.h"
+
+// View over bytes owned by the caller - a request payload is sent as a list of views
+// so headers and contents never have to be concatenated into one buffer
+struct ConstBuffer
+{
+	const void* data;
+	size_t size;
+};
+
+// Request payload that is produced part by part while it is being sent
+class PayloadSource
+{
+public:
+	virtual ~PayloadSource() = default;
+
+	// Get the next part of the payload, valid until the next call. An empty buffer ends the payload.
+	// Returns false on failure
+	virtual bool next(ConstBuffer& buffer) = 0;
+
+	// Start over from the first part - used when the request has to be sent again
+	virtual bool rewind() = 0;
+};
+
+// One request of a pipelined exchange - the payload buffers are owned by the caller
+struct PipelinedRequest
+{
+	ServerRequestHeader header;
+	std::vector<ConstBuffer> payload_buffers;
+};
+
+// Byte counters of a transport
+struct TransportStats
+{
+	uint64_t requests = 0;
+	uint64_t bytes_sent = 0;
+	uint64_t bytes_received = 0;
+	uint64_t bytes_copied = 0; // Bytes copied between user space buffers by the transport itself
+};
+
+// How the last request of send_request or send_request_streamed ended
+enum class RequestOutcome : uint8_t
+{
+	SUCCESS,
+	FAILED,   // Could not connect, send or receive - the server may not have seen the request
+	REJECTED, // The server closed a fresh connection without a response - it doesn't handle the request
+};
+
+// Connection to the MessageU server - implemented by a backend per platform
+class Transport
+{
+public:
+	// Called with each part of a streamed response payload as it arrives, returns false to abort the request
+	typedef std::function<bool(const uint8_t* data, size_t size)> PayloadHandler;
+
+	// Called once for every request of send_pipelined, in the order the responses arrive.
+	// index is the position of the request. On failure the header and payload are empty
+	typedef std::function<void(size_t index, bool success, const ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload)> PipelinedResponseHandler;
+
+	// Requests in flight at a time when the caller has no preference
+	static constexpr size_t DEFAULT_PIPELINE_DEPTH = 16;
+
+	// Most bytes of pipelined requests waiting for a response. A request that doesn't fit is sent once
+	// the ones before it were answered, so the requests in flight always fit in the socket buffers and
+	// neither side blocks on a write while the other one does too
+	static constexpr size_t PIPELINE_SEND_BUDGET = 32 * 1024;
+
+protected:
+	static constexpr const char SERVER_INFO_PATH[] = "server.info";
+
+	// Size of the receive buffer used for streamed responses
+	static constexpr size_t RECEIVE_CHUNK_SIZE = 64 * 1024;
+
+	TransportStats stats;
+
+	RequestOutcome last_outcome = RequestOutcome::SUCCESS;
+
+	// Phase timings of the requests - optional, owned by the caller
+	RequestMetrics* metrics = nullptr;
+
+	// Id of the next pipelined request
+	uint32_t next_request_id = 1;
+
+	// Cleared once the server answered a pipelined request without a request id (version 2 server)
+	bool server_supports_pipelining = true;
+
+	// Server from server.info and its resolved addresses - looked up again only when they change
+	EndpointCache endpoints{ SERVER_INFO_PATH };
+
+	// Send the requests one after the other - used when the connection can't be kept open for a pipeline
+	// or the server doesn't support pipelining. Requests marked in answered are skipped
+	bool send_sequential(const std::vector<PipelinedRequest>& requests, const PipelinedResponseHandler& on_response, const std::vector<bool>* answered = nullptr);
+
+	// Fill the version 3 headers of the requests with consecutive ids, returns the id of the first one
+	uint32_t make_pipelined_headers(const std::vector<PipelinedRequest>& requests, std::vector<PipelinedRequestHeader>& headers);
+
+	// The request may join the pipeline with bytes_in_flight bytes of requests waiting for a response
+	static bool fits_pipeline_budget(const PipelinedRequestHeader& request_header, size_t bytes_in_flight);
+
+public:
+	virtual ~Transport() = default;
+
+	// Enable or disable session mode. When disabled every request uses a connection of its own
+	virtual void set_keep_alive(bool enable) = 0;
+
+	// Send request to server and return back the response.
+	// The payload buffers are sent in order with a single vectored write and the
+	// response payload is received straight into server_payload, sized once
+	virtual bool send_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload) = 0;
+
+	// Send request to server and hand the response payload to on_payload in chunks as it arrives,
+	// so memory use doesn't depend on the response size
+	virtual bool send_request_streamed(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, const PayloadHandler& on_payload) = 0;
+
+	// Send request whose payload is payload_buffers followed by everything payload_source produces.
+	// Each part is sent as soon as it is produced, so the payload never has to be held in memory at once
+	virtual bool send_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, PayloadSource& payload_source, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload) = 0;
+
+	// Send all requests over one connection with up to max_in_flight of them waiting for a response,
+	// so their round trips overlap (protocol version 3). Responses are matched to requests by id
+	// and may complete out of order. A server without pipelining gets the requests one by one.
+	// Requests in flight are also limited to PIPELINE_SEND_BUDGET bytes,
+	// a larger request is sent alone. on_response must not start other requests on this transport.
+	// Returns false if any request failed - requests left without a response are reported as failed
+	virtual bool send_pipelined(const std::vector<PipelinedRequest>& requests, size_t max_in_flight, const PipelinedResponseHandler& on_response) = 0;
+
+	// Send request with a payload held in one buffer
+	bool send_request(const ServerRequestHeader& request_header, const std::vector<uint8_t>& client_payload, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload);
+
+	const TransportStats& get_stats() const;
+
+	RequestOutcome get_last_outcome() const;
+
+	const EndpointCache& get_endpoint_cache() const;
+
+	// Record the phases of every request into metrics from now on, NULL to stop.
+	// The metrics must outlive the transport
+	void set_metrics(RequestMetrics* request_metrics);
+
+	// Create the default transport backend for the current platform
+	static std::unique_ptr<Transport> create();
+};
@@ -1,4 +1,5 @@
 #include "Util.h"
+#include "TextCodec.h"
 
 bool Util::read_file(const std::string& filepath, std::string& file_content)
 {
@@ -18,11 +19,13 @@ bool Util::read_file(const std::string& filepath, std::string& file_content)
     return false;
 }
 
-void Util::convert_hex_str_to_bytes(const std::string& hex_str, std::vector<uint8_t>& bytes)
+bool Util::convert_hex_str_to_bytes(const std::string& hex_str, std::vector<uint8_t>& bytes)
 {
-    for (uint32_t i = 0; i < hex_str.length(); i += 2) {
-        std::string byte = hex_str.substr(i, 2);
-        uint8_t byte_as_ascii = static_cast<uint8_t>(std::strtoul(byte.c_str(), NULL, 16));
-        bytes.push_back(byte_as_ascii);
+    size_t offset = bytes.size();
+    bytes.resize(offset + hex_str.length() / 2);
+    if (!HexCodec::decode(hex_str.data(), hex_str.length(), bytes.data() + offset)) {
+        bytes.resize(offset);
+        return false;
     }
+    return true;
 }
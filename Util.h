@@ -10,7 +10,7 @@ namespace Util
 	// Read file into string
 	bool read_file(const std::string& filepath, std::string& file_content);
 
-	// Convert string of hex chars to ASCII bytes
-	void convert_hex_str_to_bytes(const std::string& hex_str, std::vector<uint8_t>& bytes);
+	// Convert string of hex chars to bytes, appended to bytes. False if it is not hex
+	bool convert_hex_str_to_bytes(const std::string& hex_str, std::vector<uint8_t>& bytes);
 };
 
@@ -0,0 +1,115 @@
+#include "WaitingMessagesParser.h"
+
+#include <algorithm>
+#include <cstring>
+
+WaitingMessagesParser::WaitingMessagesParser(MessageHandler handler) : handler(std::move(handler))
+{
+}
+
+void WaitingMessagesParser::set_part_handler(StreamPredicate stream_predicate, PartHandler part_handler)
+{
+    this->stream_predicate = std::move(stream_predicate);
+    this->part_handler = std::move(part_handler);
+}
+
+void WaitingMessagesParser::deliver(const uint8_t* message_content)
+{
+    handler(header, message_content);
+
+    // Ready for the next message - the content buffer keeps its capacity
+    has_header = false;
+    content.clear();
+}
+
+void WaitingMessagesParser::feed(const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        // Get the message header - in place when it is whole in this chunk
+        if (!has_header)
+        {
+            if (header_bytes == 0 && size >= HeaderView::SIZE)
+            {
+                header = HeaderView(data);
+                data += HeaderView::SIZE;
+                size -= HeaderView::SIZE;
+            }
+            else
+            {
+                size_t header_part = std::min(size, HeaderView::SIZE - header_bytes);
+                memcpy(header_buffer + header_bytes, data, header_part);
+                header_bytes += header_part;
+                data += header_part;
+                size -= header_part;
+
+                if (header_bytes < HeaderView::SIZE) return;
+                header = HeaderView(header_buffer);
+                header_bytes = 0;
+            }
+            has_header = true;
+            message_size = header.message_size();
+
+            // The message continues past this chunk - keep its header
+            if (size < message_size && header.bytes() != header_buffer) {
+                memcpy(header_buffer, header.bytes(), HeaderView::SIZE);
+                header = HeaderView(header_buffer);
+            }
+
+            streaming = part_handler && stream_predicate(header);
+            streamed_bytes = 0;
+            if (message_size == 0) {
+                if (streaming) {
+                    part_handler(header, NULL, 0, true);
+                    has_header = false;
+                }
+                else {
+                    deliver(NULL);
+                }
+                continue;
+            }
+        }
+
+        // Streamed message - pass on whatever part of its content is in this chunk
+        if (streaming)
+        {
+            size_t part_size = std::min(size, message_size - streamed_bytes);
+            streamed_bytes += part_size;
+            bool last = streamed_bytes == message_size;
+            part_handler(header, data, part_size, last);
+            data += part_size;
+            size -= part_size;
+
+            if (last) has_header = false;
+            continue;
+        }
+
+        // Whole message content is in this chunk - deliver it in place without copying
+        if (content.empty() && size >= message_size)
+        {
+            size_t delivered_size = message_size;
+            deliver(data);
+            data += delivered_size;
+            size -= delivered_size;
+            continue;
+        }
+
+        // Message continues in the next chunk - buffer its content
+        if (content.empty()) {
+            content.reserve(message_size);
+        }
+        size_t content_part = std::min(size, message_size - content.size());
+        content.insert(content.end(), data, data + content_part);
+        data += content_part;
+        size -= content_part;
+
+        if (content.size() == message_size) {
+            deliver(content.data());
+        }
+    }
+}
+
+bool WaitingMessagesParser::is_complete() const
+{
+    return !has_header && header_bytes == 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "ProtocolCodec.h"
+
+// Push parser for the payload of WAITING_MESSAGES_RESPONSE.
+// The payload is fed in chunks as it arrives and every message is delivered as soon as
+// its message_size bytes are in, so memory is bounded by the largest single message
+// that is not streamed. Headers and contents that arrive whole are viewed in place
+class WaitingMessagesParser
+{
+public:
+	typedef ProtocolCodec::WaitingMessageResponseHeaderView HeaderView;
+
+	// Called once per message, the header and content (header.message_size() bytes) are valid only during the call
+	typedef std::function<void(const HeaderView& header, const uint8_t* content)> MessageHandler;
+
+	// Decides which messages are streamed in parts instead of being delivered whole
+	typedef std::function<bool(const HeaderView& header)> StreamPredicate;
+
+	// Called with each part of a streamed message as it arrives, last is set on its final part
+	typedef std::function<void(const HeaderView& header, const uint8_t* data, size_t size, bool last)> PartHandler;
+
+private:
+	MessageHandler handler;
+	StreamPredicate stream_predicate;
+	PartHandler part_handler;
+
+	// Current message is streamed, and how many of its content bytes were delivered
+	bool streaming = false;
+	size_t streamed_bytes = 0;
+
+	// Header of the message being parsed - viewed in the fed chunk, or in header_buffer
+	// when it is split between chunks or the message continues past its chunk
+	HeaderView header;
+	bool has_header = false;
+	uint32_t message_size = 0;
+	uint8_t header_buffer[HeaderView::SIZE];
+	size_t header_bytes = 0;
+
+	// Content of the current message when it spans more than one chunk
+	std::vector<uint8_t> content;
+
+	// Deliver the current message and get ready for the next header
+	void deliver(const uint8_t* message_content);
+
+public:
+	explicit WaitingMessagesParser(MessageHandler handler);
+
+	// Stream the content of messages matching the predicate to part_handler, so memory
+	// doesn't grow with their size (e.g. files)
+	void set_part_handler(StreamPredicate stream_predicate, PartHandler part_handler);
+
+	// Feed the next bytes of the payload
+	void feed(const uint8_t* data, size_t size);
+
+	// True if the fed payload ended on a message boundary
+	bool is_complete() const;
+};
@@ -1,101 +1,109 @@
 #include "WinsockClient.h"
 
+#ifdef _WIN32
+
 #ifdef _DEBUG
 #define PRINT_ERROR {std::cerr << "Error in " << __FUNCTION__ << " at line " << __LINE__ << std::endl;}
 #else
 #define PRINT_ERROR
 #endif
 
-bool WinsockClient::parse_address_and_port(std::string& servername, std::string& port)
+WinsockClient::WinsockClient()
 {
-    std::string file_content;
-
-    // read file
-    if (Util::read_file(SERVER_INFO_PATH, file_content))
-    {
-        // find the colon seperator index
-        size_t colon_index = file_content.find(":");
-
-        // copy the servername
-        servername = file_content.substr(0, colon_index);
+    WSADATA wsa_data;
 
-        // copy port section
-        port = file_content.substr(colon_index + 1);
+    // Initialize Winsock once for the lifetime of the client
+    int iResult = WSAStartup(MAKEWORD(2, 2), &wsa_data);
+    if (iResult != 0) {
+        std::cerr << "WSAStartup failed with error: " << iResult << std::endl;
+        return;
+    }
+    wsa_initialized = true;
+}
 
-        return true;
+WinsockClient::~WinsockClient()
+{
+    close_connection();
+    if (wsa_initialized) {
+        WSACleanup();
     }
+}
 
-    // File not found
-    std::cerr << "File " << SERVER_INFO_PATH << " Not found" << std::endl;
-    return false;
+void WinsockClient::set_keep_alive(bool enable)
+{
+    keep_alive = enable;
+    server_supports_sessions = true;
+    single_request_sessions = 0;
+    close_connection();
 }
 
 bool WinsockClient::connect_server()
 {
-    WSADATA wsa_data;
-    struct addrinfo* result = NULL;
-    struct addrinfo* ptr = NULL;
-    struct addrinfo hints{};
-    int iResult = 0;
-    std::string servername;
-    std::string port;
+    uint64_t phase_start = 0;
 
-    // Get server address and port from server.info
-    if (!parse_address_and_port(servername, port)) {
-        std::cerr << "Was not able to parse server address and port" << std::endl;
+    if (!wsa_initialized) {
+        std::cerr << "Winsock is not initialized" << std::endl;
         return false;
     }
 
-    // Initialize Winsock
-    iResult = WSAStartup(MAKEWORD(2, 2), &wsa_data);
-    if (iResult != 0) {
-        std::cerr << "WSAStartup failed with error: " << iResult << std::endl;
+    // Get server address and port from server.info - read again only if it changed
+    phase_start = RequestMetrics::start(metrics);
+    if (!endpoints.load_server_info()) {
+        std::cerr << "Was not able to parse server address and port" << std::endl;
         return false;
     }
+    RequestMetrics::finish(metrics, metrics_code, RequestPhase::SERVER_INFO, phase_start);
 
-    ZeroMemory(&hints, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
+    // Resolve the server address and port - unless they are cached
+    phase_start = RequestMetrics::start(metrics);
+    bool cached = endpoints.is_resolved();
+    if (!endpoints.resolve()) return false;
+    RequestMetrics::finish(metrics, metrics_code, RequestPhase::RESOLVE, phase_start);
 
-    // Resolve the server address and port
-    iResult = getaddrinfo(servername.c_str(), port.c_str(), &hints, &result);
-    if (iResult != 0) {
-        std::cerr << "getaddrinfo failed with error: " << iResult << std::endl;
-        WSACleanup();
+    phase_start = RequestMetrics::start(metrics);
+    bool connected = connect_addresses();
+    if (!connected && cached) {
+        // Every cached address failed - the server may have moved, so resolve it again
+        endpoints.invalidate();
+        connected = endpoints.resolve() && connect_addresses();
+    }
+    if (!connected) {
+        std::cerr << "Unable to connect to server!" << std::endl;
         return false;
     }
+    RequestMetrics::finish(metrics, metrics_code, RequestPhase::CONNECT, phase_start);
 
+    // Header and payload are sent separately - don't let Nagle hold the payload
+    // back while waiting for the header to be acknowledged on a reused connection
+    BOOL no_delay = TRUE;
+    setsockopt(connect_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+
+    requests_on_connection = 0;
+    return true;
+}
+
+bool WinsockClient::connect_addresses()
+{
     // Attempt to connect to an address until one succeeds
-    for (ptr = result; ptr != NULL; ptr = ptr->ai_next) {
+    for (const Endpoint& endpoint : endpoints.get_addresses()) {
 
         // Create a SOCKET for connecting to server
-        connect_socket = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+        connect_socket = socket(endpoint.family, endpoint.socktype, endpoint.protocol);
         if (connect_socket == INVALID_SOCKET) {
             std::cerr << "socket failed with error: " << WSAGetLastError() << std::endl;
-            WSACleanup();
             return false;
         }
 
         // Connect to server.
-        iResult = connect(connect_socket, ptr->ai_addr, (int)ptr->ai_addrlen);
-        if (iResult == SOCKET_ERROR) {
+        if (connect(connect_socket, (const sockaddr*)&endpoint.address, endpoint.address_length) == SOCKET_ERROR) {
             closesocket(connect_socket);
             connect_socket = INVALID_SOCKET;
             continue;
         }
-        break;
-    }
-
-    freeaddrinfo(result);
-
-    if (connect_socket == INVALID_SOCKET) {
-        std::cerr << "Unable to connect to server!" << std::endl;
-        WSACleanup();
-        return false;
+        return true;
     }
 
-    return true;
+    return false;
 }
 
 bool WinsockClient::disconnect_server()
@@ -106,77 +114,381 @@ bool WinsockClient::disconnect_server()
     iResult = shutdown(connect_socket, SD_SEND);
     if (iResult == SOCKET_ERROR) {
         std::cerr << "shutdown failed: " << WSAGetLastError() << std::endl;
-        closesocket(connect_socket);
-        WSACleanup();
         return false;
     }
 
     return true;
 }
 
-bool WinsockClient::send_request(const ServerRequestHeader& request_header, const std::vector<uint8_t>& client_payload, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload)
+void WinsockClient::close_connection()
 {
-    int iBytesReceived = 0;
-    int iBytesSent = 0;
-    server_payload.clear();
-    uint8_t recvbuf[DEFAULT_BUFLEN] = { 0 };
-
-    // First connect to server
-    if (!connect_server()) return false;
-
-    // Send the request header
-    iBytesSent = send(connect_socket, (char*)&request_header, sizeof(request_header), 0);
-    if (iBytesSent == SOCKET_ERROR) {
-        std::cerr << "send failed with error: " << WSAGetLastError() << std::endl;
+    if (connect_socket != INVALID_SOCKET) {
         closesocket(connect_socket);
-        WSACleanup();
-        return false;
+        connect_socket = INVALID_SOCKET;
     }
+    requests_on_connection = 0;
+}
+
+bool WinsockClient::send_all(std::vector<WSABUF>& send_buffers)
+{
+    DWORD dwBytesSent = 0;
 
-    // Send the payload - if needed
-    if (client_payload.size() > 0)
+    // Send until every buffer is fully written
+    size_t first_buffer = 0;
+    while (first_buffer < send_buffers.size())
     {
-        iBytesSent = send(connect_socket, (char*)&client_payload[0], static_cast<uint32_t>(client_payload.size()), 0);
-        if (iBytesSent == SOCKET_ERROR) {
+        if (WSASend(connect_socket, &send_buffers[first_buffer], static_cast<DWORD>(send_buffers.size() - first_buffer), &dwBytesSent, 0, NULL, NULL) == SOCKET_ERROR) {
             std::cerr << "send failed with error: " << WSAGetLastError() << std::endl;
-            closesocket(connect_socket);
-            WSACleanup();
             return false;
         }
+        stats.bytes_sent += dwBytesSent;
+
+        // Skip the buffers that were sent and advance into a partially sent one
+        while (first_buffer < send_buffers.size() && dwBytesSent >= send_buffers[first_buffer].len) {
+            dwBytesSent -= send_buffers[first_buffer].len;
+            first_buffer++;
+        }
+        if (first_buffer < send_buffers.size()) {
+            send_buffers[first_buffer].buf += dwBytesSent;
+            send_buffers[first_buffer].len -= dwBytesSent;
+        }
     }
 
-    // Shut down the server connection because no more data will be sent
-    if (!disconnect_server()) return false;
+    return true;
+}
+
+WinsockClient::ExchangeResult WinsockClient::exchange(const Request& request, ServerResponseHeader& response_header, bool one_shot)
+{
+    int iBytesReceived = 0;
+    ServerRequestCodes code = request.header->code;
 
-    // Retrieve the response header
+    // Gather the request header and the payload buffers - sent with a single call,
+    // so the in-memory payload is timed with the header and only the streamed rest as the payload
+    uint64_t phase_start = RequestMetrics::start(metrics);
+    std::vector<WSABUF> send_buffers;
+    send_buffers.reserve(request.payload_buffers->size() + 1);
+    send_buffers.push_back({ sizeof(ServerRequestHeader), (char*)request.header });
+    for (const ConstBuffer& buffer : *request.payload_buffers) {
+        if (buffer.size > 0) {
+            send_buffers.push_back({ static_cast<ULONG>(buffer.size), (char*)buffer.data });
+        }
+    }
+    if (!send_all(send_buffers)) return ExchangeResult::CONNECTION_DROPPED;
+    RequestMetrics::finish(metrics, code, RequestPhase::HEADER_SEND, phase_start);
+
+    // Send the streamed part of the payload as it is produced
+    if (request.payload_source != NULL)
+    {
+        phase_start = RequestMetrics::start(metrics);
+        ConstBuffer part{};
+        while (true)
+        {
+            if (!request.payload_source->next(part)) {
+                std::cerr << "Failed to produce request payload" << std::endl;
+                return ExchangeResult::FAILED;
+            }
+            if (part.size == 0) break;
+
+            send_buffers.assign(1, { static_cast<ULONG>(part.size), (char*)part.data });
+            if (!send_all(send_buffers)) return ExchangeResult::CONNECTION_DROPPED;
+        }
+        RequestMetrics::finish(metrics, code, RequestPhase::PAYLOAD_SEND, phase_start);
+    }
+
+    // One-shot: shut down the server connection because no more data will be sent
+    if (one_shot && !disconnect_server()) return ExchangeResult::FAILED;
+
+    // Retrieve the response header - the header is small enough to arrive with the first byte
+    phase_start = RequestMetrics::start(metrics);
     iBytesReceived = recv(connect_socket, (char*)&response_header, sizeof(response_header), MSG_WAITALL);
-    if (iBytesReceived <= 0)
+    if (iBytesReceived == 0 || iBytesReceived == SOCKET_ERROR)
+    {
+        // Nothing was received - the server closed the connection without handling the request
+        return ExchangeResult::CONNECTION_DROPPED;
+    }
+    if (iBytesReceived != sizeof(response_header))
     {
         std::cerr << "recv failed or connection closed" << std::endl;
-        closesocket(connect_socket);
-        WSACleanup();
+        return ExchangeResult::FAILED;
+    }
+    stats.bytes_received += iBytesReceived;
+    RequestMetrics::finish(metrics, code, RequestPhase::FIRST_BYTE, phase_start);
+
+    // Retrieve the payload - framed by the payload size so the connection can be reused
+    phase_start = RequestMetrics::start(metrics);
+    size_t bytes_received = 0;
+    if (request.on_payload != NULL)
+    {
+        // Hand the payload over in chunks as it arrives
+        receive_chunk.resize(RECEIVE_CHUNK_SIZE);
+        while (bytes_received < response_header.payload_size)
+        {
+            size_t bytes_left = response_header.payload_size - bytes_received;
+            iBytesReceived = recv(connect_socket, (char*)&receive_chunk[0], static_cast<int>(bytes_left < RECEIVE_CHUNK_SIZE ? bytes_left : RECEIVE_CHUNK_SIZE), 0);
+            if (iBytesReceived <= 0) {
+                std::cerr << "recv failed or connection closed" << std::endl;
+                return ExchangeResult::FAILED;
+            }
+            bytes_received += iBytesReceived;
+            stats.bytes_received += iBytesReceived;
+            if (!(*request.on_payload)(&receive_chunk[0], iBytesReceived)) {
+                std::cerr << "Response payload rejected" << std::endl;
+                return ExchangeResult::FAILED;
+            }
+        }
+    }
+    else
+    {
+        // Receive straight into a buffer sized once from the header
+        std::vector<uint8_t>& server_payload = *request.server_payload;
+        server_payload.resize(response_header.payload_size);
+        while (bytes_received < server_payload.size())
+        {
+            size_t bytes_left = server_payload.size() - bytes_received;
+            iBytesReceived = recv(connect_socket, (char*)&server_payload[bytes_received], bytes_left < INT_MAX ? static_cast<int>(bytes_left) : INT_MAX, MSG_WAITALL);
+            if (iBytesReceived <= 0) {
+                std::cerr << "recv failed or connection closed" << std::endl;
+                return ExchangeResult::FAILED;
+            }
+            bytes_received += iBytesReceived;
+            stats.bytes_received += iBytesReceived;
+        }
+    }
+
+    RequestMetrics::finish(metrics, code, RequestPhase::PAYLOAD_RECEIVE, phase_start);
+
+    requests_on_connection++;
+    stats.requests++;
+    return ExchangeResult::SUCCESS;
+}
+
+bool WinsockClient::send_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload)
+{
+    server_payload.clear();
+    return perform_request({ &request_header, &payload_buffers, NULL, &server_payload, NULL }, response_header);
+}
+
+bool WinsockClient::send_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, PayloadSource& payload_source, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload)
+{
+    server_payload.clear();
+    return perform_request({ &request_header, &payload_buffers, &payload_source, &server_payload, NULL }, response_header);
+}
+
+bool WinsockClient::send_request_streamed(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, const PayloadHandler& on_payload)
+{
+    return perform_request({ &request_header, &payload_buffers, NULL, NULL, &on_payload }, response_header);
+}
+
+bool WinsockClient::perform_request(const Request& request, ServerResponseHeader& response_header)
+{
+    bool session = keep_alive && server_supports_sessions;
+    bool reused_connection = session && connect_socket != INVALID_SOCKET;
+    uint64_t request_start = RequestMetrics::start(metrics);
+    TransportStats request_stats = stats;
+    metrics_code = request.header->code;
+
+    // First connect to server - if there is no open session
+    if (!reused_connection && !connect_server()) {
+        if (request_start != 0) metrics->record_request(metrics_code, false, RequestMetrics::now_ns() - request_start, 0, 0);
+        last_outcome = RequestOutcome::FAILED;
         return false;
     }
 
-    // Retrieve the payload
-    while (response_header.payload_size > server_payload.size())
+    ExchangeResult result = exchange(request, response_header, !session);
+
+    if (result == ExchangeResult::CONNECTION_DROPPED && reused_connection)
     {
-        iBytesReceived = recv(connect_socket, (char*)recvbuf, DEFAULT_BUFLEN, 0);
-        if (iBytesReceived > 0) {
-            server_payload.insert(server_payload.end(), recvbuf, recvbuf + iBytesReceived);
+        // The server closed the idle session. Count sessions that only served a single request,
+        // a server that does this repeatedly is closing the connection after every response
+        if (requests_on_connection == 1 && ++single_request_sessions >= MAX_SINGLE_REQUEST_SESSIONS) {
+            server_supports_sessions = false;
+            session = false;
         }
-        else if (iBytesReceived <= 0) {
-            std::cerr << "recv failed or connection closed" << std::endl;
-            closesocket(connect_socket);
-            WSACleanup();
-            return false;
+
+        // Reconnect transparently and send the request again
+        close_connection();
+        if (request.payload_source == NULL || request.payload_source->rewind()) {
+            result = connect_server() ? exchange(request, response_header, !session) : ExchangeResult::FAILED;
         }
+        else {
+            result = ExchangeResult::FAILED;
+        }
+    }
+    else if (result == ExchangeResult::SUCCESS && requests_on_connection > 1)
+    {
+        // Server kept the session open for more than one request
+        single_request_sessions = 0;
+    }
+
+    // A drop is only left when it happened on a fresh connection
+    if (result == ExchangeResult::CONNECTION_DROPPED) {
+        std::cerr << "recv failed or connection closed" << std::endl;
+    }
+    last_outcome = result == ExchangeResult::SUCCESS ? RequestOutcome::SUCCESS :
+        result == ExchangeResult::CONNECTION_DROPPED ? RequestOutcome::REJECTED : RequestOutcome::FAILED;
+
+    // cleanup - keep the connection only for a healthy session
+    if (!session || result != ExchangeResult::SUCCESS) {
+        close_connection();
     }
 
-    // cleanup
-    closesocket(connect_socket);
-    WSACleanup();
+    if (request_start != 0) {
+        metrics->record_request(metrics_code, result == ExchangeResult::SUCCESS, RequestMetrics::now_ns() - request_start,
+            stats.bytes_sent - request_stats.bytes_sent, stats.bytes_received - request_stats.bytes_received);
+    }
 
     // Exit success
-    return true;
+    return result == ExchangeResult::SUCCESS;
 }
+
+WinsockClient::ExchangeResult WinsockClient::exchange_pipelined(const std::vector<PipelinedRequest>& requests, const std::vector<PipelinedRequestHeader>& headers, uint32_t first_request_id, size_t max_in_flight, const PipelinedResponseHandler& on_response, std::vector<bool>& answered, size_t& completed)
+{
+    int iBytesReceived = 0;
+    size_t sent = 0;
+    size_t bytes_in_flight = 0;
+    std::vector<WSABUF> send_buffers;
+    PipelinedResponseHeader response{};
+    std::vector<uint8_t> server_payload;
+
+    // Requests are timed one by one from the moment they are sent
+    std::vector<uint64_t> sent_at(RequestMetrics::start(metrics) != 0 ? requests.size() : 0, 0);
+
+    while (completed < requests.size())
+    {
+        // Fill the window - the requests are written back to back without waiting for responses.
+        // The sends block, so only as many bytes as the socket buffers hold are written ahead
+        send_buffers.clear();
+        while (sent < requests.size() && sent - completed < max_in_flight && fits_pipeline_budget(headers[sent], bytes_in_flight)) {
+            if (!sent_at.empty()) sent_at[sent] = RequestMetrics::now_ns();
+            bytes_in_flight += sizeof(PipelinedRequestHeader) + headers[sent].header.payload_size;
+            send_buffers.push_back({ sizeof(PipelinedRequestHeader), (char*)&headers[sent] });
+            for (const ConstBuffer& buffer : requests[sent].payload_buffers) {
+                if (buffer.size > 0) {
+                    send_buffers.push_back({ static_cast<ULONG>(buffer.size), (char*)buffer.data });
+                }
+            }
+            sent++;
+        }
+        if (!send_buffers.empty() && !send_all(send_buffers)) {
+            return completed == 0 ? ExchangeResult::CONNECTION_DROPPED : ExchangeResult::FAILED;
+        }
+
+        // Retrieve the next response, whatever request it belongs to
+        iBytesReceived = recv(connect_socket, (char*)&response, sizeof(response), MSG_WAITALL);
+        if ((iBytesReceived == 0 || iBytesReceived == SOCKET_ERROR) && completed == 0)
+        {
+            // Nothing was received - the server closed the connection without handling the requests
+            return ExchangeResult::CONNECTION_DROPPED;
+        }
+        if (iBytesReceived != sizeof(response))
+        {
+            std::cerr << "recv failed or connection closed" << std::endl;
+            return ExchangeResult::FAILED;
+        }
+        stats.bytes_received += iBytesReceived;
+
+        if (response.header.version != PIPELINED_PROTOCOL_VERSION) {
+            std::cerr << "Server does not support pipelined requests" << std::endl;
+            return completed == 0 ? ExchangeResult::NOT_PIPELINED : ExchangeResult::FAILED;
+        }
+        uint32_t index = response.request_id - first_request_id;
+        if (index >= sent || answered[index]) {
+            std::cerr << "Server responded to an unknown request" << std::endl;
+            return ExchangeResult::FAILED;
+        }
+
+        // Receive straight into a buffer sized once from the header
+        size_t bytes_received = 0;
+        server_payload.resize(response.header.payload_size);
+        while (bytes_received < server_payload.size())
+        {
+            size_t bytes_left = server_payload.size() - bytes_received;
+            iBytesReceived = recv(connect_socket, (char*)&server_payload[bytes_received], bytes_left < INT_MAX ? static_cast<int>(bytes_left) : INT_MAX, MSG_WAITALL);
+            if (iBytesReceived <= 0) {
+                std::cerr << "recv failed or connection closed" << std::endl;
+                return ExchangeResult::FAILED;
+            }
+            bytes_received += iBytesReceived;
+            stats.bytes_received += iBytesReceived;
+        }
+
+        if (!sent_at.empty()) {
+            metrics->record_request(headers[index].header.code, true, RequestMetrics::now_ns() - sent_at[index],
+                sizeof(PipelinedRequestHeader) + headers[index].header.payload_size, sizeof(response) + server_payload.size());
+        }
+
+        answered[index] = true;
+        bytes_in_flight -= sizeof(PipelinedRequestHeader) + headers[index].header.payload_size;
+        completed++;
+        requests_on_connection++;
+        stats.requests++;
+        on_response(index, true, response.header, server_payload);
+        server_payload.clear();
+    }
+
+    return ExchangeResult::SUCCESS;
+}
+
+bool WinsockClient::send_pipelined(const std::vector<PipelinedRequest>& requests, size_t max_in_flight, const PipelinedResponseHandler& on_response)
+{
+    if (requests.empty()) return true;
+
+    // Responses can only be matched on a connection that stays open between them
+    if (!keep_alive || !server_supports_sessions || !server_supports_pipelining) {
+        return send_sequential(requests, on_response);
+    }
+
+    std::vector<PipelinedRequestHeader> headers;
+    uint32_t first_request_id = make_pipelined_headers(requests, headers);
+    std::vector<bool> answered(requests.size(), false);
+    size_t completed = 0;
+    if (max_in_flight == 0) max_in_flight = 1;
+
+    // First connect to server - if there is no open session
+    uint64_t request_start = RequestMetrics::start(metrics);
+    metrics_code = requests[0].header.code;
+    bool reused_connection = connect_socket != INVALID_SOCKET;
+    ExchangeResult result = ExchangeResult::FAILED;
+    if (reused_connection || connect_server()) {
+        result = exchange_pipelined(requests, headers, first_request_id, max_in_flight, on_response, answered, completed);
+    }
+
+    if (result == ExchangeResult::CONNECTION_DROPPED && reused_connection)
+    {
+        // The server closed the idle session - reconnect transparently and send the requests again
+        close_connection();
+        if (connect_server()) {
+            result = exchange_pipelined(requests, headers, first_request_id, max_in_flight, on_response, answered, completed);
+        }
+    }
+    else if (result == ExchangeResult::SUCCESS && requests_on_connection > 1)
+    {
+        // Server kept the session open for more than one request
+        single_request_sessions = 0;
+    }
+
+    if (result == ExchangeResult::SUCCESS) return true;
+
+    if (result == ExchangeResult::NOT_PIPELINED)
+    {
+        // The connection is out of step with the server - send it the requests left one by one
+        close_connection();
+        server_supports_pipelining = false;
+        return send_sequential(requests, on_response, &answered);
+    }
+
+    // cleanup - report the requests left without a response
+    close_connection();
+    ServerResponseHeader empty_header{};
+    std::vector<uint8_t> empty_payload;
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (answered[i]) continue;
+        if (request_start != 0) {
+            metrics->record_request(requests[i].header.code, false, RequestMetrics::now_ns() - request_start, 0, 0);
+        }
+        on_response(i, false, empty_header, empty_payload);
+    }
+    return false;
+}
+
+#endif // _WIN32
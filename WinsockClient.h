@@ -1,4 +1,5 @@
 #pragma once
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 
 #include <windows.h>
@@ -9,8 +10,10 @@
 #include <sstream>
 #include <fstream>
 #include <vector>
+#include <climits>
 
 #include "ProtocolHeaders.h"
+#include "Transport.h"
 #include "Util.h"
 
 // Need to link with Ws2_32.lib, Mswsock.lib, and Advapi32.lib
@@ -18,24 +21,94 @@
 #pragma comment (lib, "Mswsock.lib")
 #pragma comment (lib, "AdvApi32.lib")
 
-class WinsockClient
+// Blocking Winsock backend of the transport
+class WinsockClient : public Transport
 {
-	static constexpr int DEFAULT_BUFLEN = 512;
-	static constexpr const char SERVER_INFO_PATH[] = "server.info";
+	// Number of sessions in a row that the server closed right after the first response
+	// before we decide it does not support sessions and fall back to one-shot connections
+	static constexpr int MAX_SINGLE_REQUEST_SESSIONS = 2;
+
+	// Result of a single request/response exchange over the current connection
+	enum class ExchangeResult
+	{
+		SUCCESS,
+		FAILED,
+		CONNECTION_DROPPED, // Connection was closed before any response byte arrived
+		NOT_PIPELINED,      // First pipelined response came without a request id - an older server
+	};
 
 	SOCKET connect_socket = INVALID_SOCKET;
 
-	// Read server info file and return the servername and port
-	bool parse_address_and_port(std::string& servername, std::string& port);
+	// True if WSAStartup succeeded in the constructor
+	bool wsa_initialized = false;
+
+	// Keep one connection open across requests (session mode)
+	bool keep_alive = true;
+
+	// Cleared once the server proved it closes the connection after every response
+	bool server_supports_sessions = true;
+
+	// Number of responses received over the current connection
+	uint32_t requests_on_connection = 0;
+
+	// Number of sessions in a row that were dropped after a single response
+	int single_request_sessions = 0;
+
+	// Receive buffer for streamed responses
+	std::vector<uint8_t> receive_chunk;
+
+	// Code the phases of the request in flight are recorded under
+	ServerRequestCodes metrics_code{};
 
 	// Connect the server saved in server.info
 	bool connect_server();
 
-	// Shut down the client connection
+	// Try the resolved addresses in order until one connects
+	bool connect_addresses();
+
+	// Shut down the send half of the client connection
 	bool disconnect_server();
 
+	// Close the current connection socket (if open)
+	void close_connection();
+
+	// Parts of a request and where its response payload goes
+	struct Request
+	{
+		const ServerRequestHeader* header;
+		const std::vector<ConstBuffer>* payload_buffers;
+		PayloadSource* payload_source;          // Optional streamed rest of the payload
+		std::vector<uint8_t>* server_payload;   // Response payload is received here,
+		const PayloadHandler* on_payload;       // or streamed here if set
+	};
+
+	// Send all buffers, looping over partial sends
+	bool send_all(std::vector<WSABUF>& send_buffers);
+
+	// Send request over the current connection and read back the response
+	ExchangeResult exchange(const Request& request, ServerResponseHeader& response_header, bool one_shot);
+
+	// Run a request over the session (or a one-shot connection), reconnecting if the session was dropped
+	bool perform_request(const Request& request, ServerResponseHeader& response_header);
+
+	// Send the requests of a pipeline over the current connection and dispatch their responses as they arrive.
+	// The socket is blocking, so the window is filled before each response is read, up to PIPELINE_SEND_BUDGET bytes
+	ExchangeResult exchange_pipelined(const std::vector<PipelinedRequest>& requests, const std::vector<PipelinedRequestHeader>& headers, uint32_t first_request_id, size_t max_in_flight, const PipelinedResponseHandler& on_response, std::vector<bool>& answered, size_t& completed);
+
 public:
-	// Send request to server and return back the response
-	bool send_request(const ServerRequestHeader& request_header, const std::vector<uint8_t>& client_payload, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload);
+	WinsockClient();
+	~WinsockClient() override;
+
+	void set_keep_alive(bool enable) override;
+
+	using Transport::send_request;
+	bool send_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload) override;
+
+	bool send_request(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, PayloadSource& payload_source, ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload) override;
+
+	bool send_request_streamed(const ServerRequestHeader& request_header, const std::vector<ConstBuffer>& payload_buffers, ServerResponseHeader& response_header, const PayloadHandler& on_payload) override;
+
+	bool send_pipelined(const std::vector<PipelinedRequest>& requests, size_t max_in_flight, const PipelinedResponseHandler& on_response) override;
 };
 
+#endif // _WIN32
@@ -0,0 +1,131 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Pool and index of the worker running on this thread
+    thread_local const WorkStealingPool* current_pool = nullptr;
+    thread_local size_t current_index = WorkStealingPool::NOT_A_WORKER;
+}
+
+WorkStealingPool::WorkStealingPool(size_t thread_count)
+{
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < thread_count; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        threads.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    size_t index = current_worker();
+
+    // Counted before it is queued, so the count never drops below the tasks in the queues
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    if (index == NOT_A_WORKER) {
+        index = next_worker;
+        next_worker = (next_worker + 1) % workers.size();
+    }
+    {
+        std::lock_guard<std::mutex> worker_lock(workers[index]->mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+    queued++;
+    sleep_cv.notify_one();
+}
+
+bool WorkStealingPool::take_task(size_t index, Task& task)
+{
+    bool stolen = false;
+    bool found = false;
+
+    // Own tasks in order first
+    {
+        Worker& worker = *workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    // Then the newest task of another worker
+    for (size_t i = 1; !found && i < workers.size(); i++) {
+        Worker& victim = *workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            found = stolen = true;
+        }
+    }
+
+    if (found) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        queued--;
+        tasks_run++;
+        if (stolen) tasks_stolen++;
+    }
+    return found;
+}
+
+void WorkStealingPool::run(size_t index)
+{
+    current_pool = this;
+    current_index = index;
+
+    while (true)
+    {
+        Task task;
+        if (take_task(index, task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleep_cv.wait(lock, [&] { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
+
+size_t WorkStealingPool::get_thread_count() const
+{
+    return workers.size();
+}
+
+size_t WorkStealingPool::current_worker() const
+{
+    return current_pool == this ? current_index : NOT_A_WORKER;
+}
+
+uint64_t WorkStealingPool::get_tasks_run()
+{
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    return tasks_run;
+}
+
+uint64_t WorkStealingPool::get_tasks_stolen()
+{
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    return tasks_stolen;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task queue.
+// A worker runs its own tasks in the order they were queued and steals from the back of
+// the other queues when it runs out, so one long task doesn't hold up the tasks behind it
+class WorkStealingPool
+{
+public:
+	typedef std::function<void()> Task;
+	static constexpr size_t NOT_A_WORKER = SIZE_MAX;
+
+private:
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+
+	// Idle workers sleep until a task is queued anywhere
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_cv;
+	size_t queued = 0;
+	bool stopping = false;
+
+	// Queue for the next task submitted from outside the pool
+	size_t next_worker = 0;
+
+	// Counters - updated under sleep_mutex
+	uint64_t tasks_run = 0;
+	uint64_t tasks_stolen = 0;
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// Worker thread main loop
+	void run(size_t index);
+
+	// Take the next task of the worker, or steal one
+	bool take_task(size_t index, Task& task);
+
+public:
+	// thread_count of 0 uses a thread per core
+	explicit WorkStealingPool(size_t thread_count = 0);
+
+	// Runs the queued tasks before returning
+	~WorkStealingPool();
+
+	// Queue a task. Tasks submitted by a worker go to its own queue
+	void submit(Task task);
+
+	size_t get_thread_count() const;
+
+	// Index of the calling worker thread of this pool, or NOT_A_WORKER
+	size_t current_worker() const;
+
+	uint64_t get_tasks_run();
+	uint64_t get_tasks_stolen();
+};
@@ -0,0 +1,564 @@
+// Microbenchmarks of the primitives the client depends on - crypto, codecs and protocol structs.
+// Results are printed as JSON so runs can be compared between releases.
+//
+// Usage: bench [--filter <substring>] [--min-time-ms <ms>] [--repetitions <count>]
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "../AESWrapper.h"
+#include "../Base64Wrapper.h"
+#include "../LZCodec.h"
+#include "../ProtocolCodec.h"
+#include "../ProtocolHeaders.h"
+#include "../RSAWrapper.h"
+#include "../TextCodec.h"
+#include "../Util.h"
+#include "../WaitingMessagesParser.h"
+
+namespace
+{
+    // Keep the compiler from dropping work whose result is never used
+    template <typename T>
+    inline void do_not_optimize(const T& value)
+    {
+#if defined(_MSC_VER)
+        static const volatile void* sink;
+        sink = &value;
+#else
+        asm volatile("" : : "r,m"(value) : "memory");
+#endif
+    }
+
+    struct Options
+    {
+        std::string filter;
+        double min_time_ms = 200.0;
+        int repetitions = 5;
+    };
+
+    struct Result
+    {
+        std::string name;
+        uint64_t iterations;        // Per repetition
+        double ns_per_op;           // Median of the repetitions
+        double min_ns_per_op;
+        double max_ns_per_op;
+        uint64_t bytes_per_op;      // 0 if throughput doesn't apply
+        uint64_t items_per_op;      // Records handled by one operation
+        double compression_ratio;   // Input size over output size, 0 if it doesn't apply
+    };
+
+    class BenchmarkRunner
+    {
+        const Options& options;
+        std::vector<Result> results;
+
+        // Time iterations calls of the operation in nanoseconds
+        static double time_iterations(const std::function<void()>& operation, uint64_t iterations)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; i++) {
+                operation();
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+
+    public:
+        explicit BenchmarkRunner(const Options& options) : options(options)
+        {
+        }
+
+        // Run the operation until one repetition takes at least min_time_ms, then measure the repetitions
+        void run(const std::string& name, uint64_t bytes_per_op, uint64_t items_per_op, const std::function<void()>& operation, double compression_ratio = 0)
+        {
+            if (!options.filter.empty() && name.find(options.filter) == std::string::npos) return;
+
+            // Warm up and find the iteration count
+            uint64_t iterations = 1;
+            double min_time_ns = options.min_time_ms * 1e6;
+            while (true)
+            {
+                double elapsed_ns = time_iterations(operation, iterations);
+                if (elapsed_ns >= min_time_ns) break;
+                double scale = elapsed_ns > 0 ? min_time_ns / elapsed_ns * 1.2 : 10.0;
+                iterations = static_cast<uint64_t>(static_cast<double>(iterations) * std::min(std::max(scale, 1.5), 10.0)) + 1;
+            }
+
+            std::vector<double> samples;
+            for (int i = 0; i < options.repetitions; i++) {
+                samples.push_back(time_iterations(operation, iterations) / static_cast<double>(iterations));
+            }
+            std::sort(samples.begin(), samples.end());
+
+            results.push_back({ name, iterations, samples[samples.size() / 2], samples.front(), samples.back(), bytes_per_op, items_per_op, compression_ratio });
+            std::cerr << name << ": " << samples[samples.size() / 2] << " ns/op" << std::endl;
+        }
+
+        void print_json(std::ostream& out) const
+        {
+            char host[256] = "unknown";
+#ifndef _WIN32
+            gethostname(host, sizeof(host) - 1);
+#endif
+            char date[64] = "";
+            std::time_t now = std::time(nullptr);
+            std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+            out << "{\n";
+            out << "  \"context\": {\n";
+            out << "    \"date\": \"" << date << "\",\n";
+            out << "    \"host\": \"" << host << "\",\n";
+#if defined(__VERSION__)
+            out << "    \"compiler\": \"" << __VERSION__ << "\",\n";
+#endif
+            out << "    \"min_time_ms\": " << options.min_time_ms << ",\n";
+            out << "    \"repetitions\": " << options.repetitions << "\n";
+            out << "  },\n";
+            out << "  \"benchmarks\": [\n";
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                const Result& result = results[i];
+                out << "    {\"name\": \"" << result.name << "\""
+                    << ", \"iterations\": " << result.iterations
+                    << ", \"ns_per_op\": " << result.ns_per_op
+                    << ", \"min_ns_per_op\": " << result.min_ns_per_op
+                    << ", \"max_ns_per_op\": " << result.max_ns_per_op;
+                if (result.bytes_per_op > 0) {
+                    out << ", \"bytes_per_second\": " << static_cast<double>(result.bytes_per_op) * 1e9 / result.ns_per_op;
+                }
+                if (result.items_per_op > 1) {
+                    out << ", \"ns_per_item\": " << result.ns_per_op / static_cast<double>(result.items_per_op);
+                }
+                if (result.compression_ratio > 0) {
+                    out << ", \"compression_ratio\": " << result.compression_ratio;
+                }
+                out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+            }
+            out << "  ]\n";
+            out << "}" << std::endl;
+        }
+    };
+
+    const size_t PAYLOAD_SIZES[] = { 16, 256, 4 * 1024, 64 * 1024, 1024 * 1024 };
+
+    std::string make_payload(size_t size)
+    {
+        std::string payload(size, '\0');
+        for (size_t i = 0; i < size; i++) {
+            payload[i] = static_cast<char>(i * 31 + 7);
+        }
+        return payload;
+    }
+
+    // Feed ciphertexts to the stream decryptor in random unaligned pieces, the way the download sink gets them
+    // from the network, and compare with AESWrapper::decrypt. Each piece is decrypted into a buffer of exactly
+    // the documented piece + BLOCKSIZE bytes, so a sanitizer build also catches writes past it
+    bool check_stream_decrypt()
+    {
+        unsigned char key[AESWrapper::DEFAULT_KEYLENGTH];
+        AESWrapper::GenerateKey(key, AESWrapper::DEFAULT_KEYLENGTH);
+        AESWrapper aes(key, AESWrapper::DEFAULT_KEYLENGTH);
+        AESStreamDecryptor decryptor(key, AESWrapper::DEFAULT_KEYLENGTH);
+        std::mt19937 random(1);
+
+        for (int trial = 0; trial < 1000; trial++)
+        {
+            std::string plain = make_payload(random() % 4096);
+            std::string cipher = aes.encrypt(plain.data(), static_cast<unsigned int>(plain.size()));
+            std::string expected = aes.decrypt(cipher.data(), static_cast<unsigned int>(cipher.size()));
+
+            std::string decrypted;
+            decryptor.restart();
+            for (size_t position = 0; position < cipher.size();)
+            {
+                size_t piece = std::min<size_t>(cipher.size() - position, random() % 100 + 1);
+                std::vector<unsigned char> out(piece + AESStreamDecryptor::BLOCKSIZE);
+                size_t written = decryptor.update(reinterpret_cast<const unsigned char*>(cipher.data()) + position, piece, out.data());
+                decrypted.append(reinterpret_cast<const char*>(out.data()), written);
+                position += piece;
+            }
+            unsigned char tail[AESStreamDecryptor::BLOCKSIZE];
+            decrypted.append(reinterpret_cast<const char*>(tail), decryptor.final(tail));
+
+            if (decrypted != expected) {
+                std::cerr << "Stream decryption of " << plain.size() << " bytes differs from AESWrapper::decrypt" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void bench_aes(BenchmarkRunner& runner)
+    {
+        unsigned char key[AESWrapper::DEFAULT_KEYLENGTH];
+        AESWrapper::GenerateKey(key, AESWrapper::DEFAULT_KEYLENGTH);
+        AESWrapper aes(key, AESWrapper::DEFAULT_KEYLENGTH);
+        AESSessionCipher session_cipher(key, AESWrapper::DEFAULT_KEYLENGTH);
+
+        for (size_t size : PAYLOAD_SIZES)
+        {
+            std::string plain = make_payload(size);
+            std::string cipher = aes.encrypt(plain.data(), static_cast<unsigned int>(plain.size()));
+            std::vector<unsigned char> out(AESStreamEncryptor::encryptedSize(size));
+            std::string suffix = "/" + std::to_string(size);
+
+            runner.run("aes/encrypt" + suffix, size, 1, [&]() {
+                do_not_optimize(aes.encrypt(plain.data(), static_cast<unsigned int>(plain.size())));
+            });
+            runner.run("aes/decrypt" + suffix, size, 1, [&]() {
+                do_not_optimize(aes.decrypt(cipher.data(), static_cast<unsigned int>(cipher.size())));
+            });
+            runner.run("aes/session_encrypt" + suffix, size, 1, [&]() {
+                do_not_optimize(session_cipher.encrypt(reinterpret_cast<const unsigned char*>(plain.data()), plain.size(), out.data()));
+            });
+            runner.run("aes/session_decrypt" + suffix, size, 1, [&]() {
+                do_not_optimize(session_cipher.decrypt(reinterpret_cast<const unsigned char*>(cipher.data()), cipher.size(), out.data()));
+            });
+        }
+    }
+
+    void bench_rsa(BenchmarkRunner& runner)
+    {
+        RSAPrivateWrapper private_wrapper;
+        char public_key[RSAPublicWrapper::KEYSIZE];
+        private_wrapper.getPublicKey(public_key, RSAPublicWrapper::KEYSIZE);
+        RSAPublicWrapper public_wrapper(public_key, RSAPublicWrapper::KEYSIZE);
+
+        // A symmetric key is what the client encrypts with RSA
+        std::string plain = make_payload(AESWrapper::DEFAULT_KEYLENGTH);
+        std::string cipher = public_wrapper.encrypt(plain);
+
+        runner.run("rsa/keygen", 0, 1, [&]() {
+            RSAPrivateWrapper generated;
+            do_not_optimize(generated);
+        });
+        runner.run("rsa/encrypt", plain.size(), 1, [&]() {
+            do_not_optimize(public_wrapper.encrypt(plain));
+        });
+        runner.run("rsa/decrypt", plain.size(), 1, [&]() {
+            do_not_optimize(private_wrapper.decrypt(cipher));
+        });
+
+        // Parsed once variants used for key deliveries
+        CryptoPP::AutoSeededRandomPool rng;
+        RSAPublicEncryptor encryptor(public_key, RSAPublicWrapper::KEYSIZE);
+        RSAPrivateDecryptor decryptor(private_wrapper.getPrivateKey());
+        std::string decrypted;
+
+        runner.run("rsa/encryptor_encrypt", plain.size(), 1, [&]() {
+            do_not_optimize(encryptor.encrypt(rng, plain.data(), static_cast<unsigned int>(plain.size())));
+        });
+        runner.run("rsa/decryptor_decrypt", plain.size(), 1, [&]() {
+            do_not_optimize(decryptor.decrypt(rng, cipher.data(), static_cast<unsigned int>(cipher.size()), decrypted));
+        });
+        runner.run("rsa/public_key_parse", RSAPublicWrapper::KEYSIZE, 1, [&]() {
+            RSAPublicEncryptor parsed(public_key, RSAPublicWrapper::KEYSIZE);
+            do_not_optimize(parsed);
+        });
+    }
+
+    void bench_codecs(BenchmarkRunner& runner)
+    {
+        for (size_t size : { static_cast<size_t>(RSAPublicWrapper::KEYSIZE), static_cast<size_t>(4 * 1024), static_cast<size_t>(64 * 1024) })
+        {
+            std::string plain = make_payload(size);
+            std::string encoded = Base64Wrapper::encode(plain);
+            std::string suffix = "/" + std::to_string(size);
+
+            runner.run("base64/encode" + suffix, size, 1, [&]() {
+                do_not_optimize(Base64Wrapper::encode(plain));
+            });
+            runner.run("base64/decode" + suffix, size, 1, [&]() {
+                do_not_optimize(Base64Wrapper::decode(encoded));
+            });
+        }
+
+        // A client ID as stored in me.info, and a public key
+        for (size_t size : { static_cast<size_t>(CLIENT_ID_LENGTH), static_cast<size_t>(PUBLIC_KEY_LENGTH) })
+        {
+            std::string hex_str;
+            for (size_t i = 0; i < size; i++) {
+                static const char HEX_DIGITS[] = "0123456789abcdef";
+                hex_str += HEX_DIGITS[(i * 7) % 16];
+                hex_str += HEX_DIGITS[(i * 13) % 16];
+            }
+            std::vector<uint8_t> bytes;
+            bytes.reserve(size);
+
+            runner.run("util/convert_hex_str_to_bytes/" + std::to_string(size), size, 1, [&]() {
+                bytes.clear();
+                Util::convert_hex_str_to_bytes(hex_str, bytes);
+                do_not_optimize(bytes.data());
+            });
+        }
+
+        // Each path of the span codecs this CPU has
+        TextCodecIsa supported_isa = TextCodec::get_supported_isa();
+        for (TextCodecIsa isa : { TextCodecIsa::SCALAR, TextCodecIsa::SSE4, TextCodecIsa::AVX2 })
+        {
+            if (isa > supported_isa) break;
+            TextCodec::set_isa(isa);
+            std::string isa_name = TextCodec::get_isa_name(isa);
+
+            for (size_t size : { static_cast<size_t>(CLIENT_ID_LENGTH), static_cast<size_t>(RSAPublicWrapper::KEYSIZE), static_cast<size_t>(64 * 1024) })
+            {
+                std::string plain = make_payload(size);
+                const uint8_t* data = reinterpret_cast<const uint8_t*>(plain.data());
+                std::vector<char> base64(Base64Codec::encoded_size(size));
+                std::vector<char> hex(HexCodec::encoded_size(size));
+                std::vector<uint8_t> decoded(Base64Codec::max_decoded_size(base64.size()));
+                Base64Codec::encode(data, size, base64.data());
+                HexCodec::encode(data, size, hex.data());
+                std::string suffix = "/" + isa_name + "/" + std::to_string(size);
+
+                runner.run("base64_codec/encode" + suffix, size, 1, [&]() {
+                    do_not_optimize(Base64Codec::encode(data, size, base64.data()));
+                });
+                runner.run("base64_codec/decode" + suffix, size, 1, [&]() {
+                    size_t decoded_size;
+                    do_not_optimize(Base64Codec::decode(base64.data(), base64.size(), decoded.data(), decoded_size));
+                });
+                runner.run("hex_codec/encode" + suffix, size, 1, [&]() {
+                    HexCodec::encode(data, size, hex.data());
+                    do_not_optimize(hex.data());
+                });
+                runner.run("hex_codec/decode" + suffix, size, 1, [&]() {
+                    do_not_optimize(HexCodec::decode(hex.data(), hex.size(), decoded.data()));
+                });
+            }
+        }
+        TextCodec::set_isa(supported_isa);
+    }
+
+    // Chat and log lines - what most messages and sent files look like
+    std::string make_text_payload(size_t size)
+    {
+        static const char* const LINES[] = {
+            "2024-05-14 10:32:07 [INFO] connection from 10.0.0.17 accepted\n",
+            "2024-05-14 10:32:08 [WARN] request timeout exceeded, retrying\n",
+            "2024-05-14 10:32:09 [ERROR] failed to open file /var/log/messageu/client.log\n",
+            "Hi, are we still on for the meeting tomorrow morning? Let me know what you think.\n",
+            "Thanks! I will send you the file later today.\n",
+        };
+        std::string payload;
+        uint32_t state = 7;
+        while (payload.size() < size) {
+            state = state * 1103515245 + 12345;
+            payload += LINES[(state >> 16) % (sizeof(LINES) / sizeof(LINES[0]))];
+        }
+        payload.resize(size);
+        return payload;
+    }
+
+    void bench_compression(BenchmarkRunner& runner)
+    {
+        for (size_t size : PAYLOAD_SIZES)
+        {
+            for (bool text : { true, false })
+            {
+                std::string plain = text ? make_text_payload(size) : make_payload(size);
+                const uint8_t* data = reinterpret_cast<const uint8_t*>(plain.data());
+
+                // The dictionary is only used for texts, and pays off for short ones
+                for (bool use_dictionary : { false, true })
+                {
+                    if (use_dictionary && (!text || size > 4 * 1024)) continue;
+
+                    LZCompressor compressor(use_dictionary);
+                    std::vector<uint8_t> compressed;
+                    compressor.compress(data, plain.size(), compressed);
+                    double ratio = static_cast<double>(plain.size()) / static_cast<double>(compressed.size());
+                    std::string suffix = std::string(text ? "/text" : "/binary") + (use_dictionary ? "_dictionary/" : "/") + std::to_string(size);
+                    std::string decompressed;
+
+                    runner.run("lz/compress" + suffix, size, 1, [&]() {
+                        compressor.compress(data, plain.size(), compressed);
+                        do_not_optimize(compressed.data());
+                    }, ratio);
+                    runner.run("lz/decompress" + suffix, size, 1, [&]() {
+                        LZDecompressor::decompress(compressed.data(), compressed.size(), decompressed);
+                        do_not_optimize(decompressed.data());
+                    }, ratio);
+                }
+            }
+        }
+    }
+
+    // Number of records packed into one payload buffer per operation
+    constexpr size_t RECORDS_PER_OP = 1024;
+
+    // Pack records into a payload buffer back to back and unpack them, the way payloads are built and parsed
+    template <typename T>
+    void bench_struct(BenchmarkRunner& runner, const std::string& name)
+    {
+        std::vector<uint8_t> payload(sizeof(T) * RECORDS_PER_OP);
+        std::vector<T> records(RECORDS_PER_OP);
+        for (size_t i = 0; i < payload.size(); i++) {
+            payload[i] = static_cast<uint8_t>(i * 31 + 7);
+        }
+        memcpy(records.data(), payload.data(), payload.size());
+
+        runner.run("protocol/pack/" + name, payload.size(), RECORDS_PER_OP, [&]() {
+            uint8_t* out = payload.data();
+            for (const T& record : records) {
+                memcpy(out, &record, sizeof(T));
+                out += sizeof(T);
+            }
+            do_not_optimize(payload.data());
+        });
+        runner.run("protocol/unpack/" + name, payload.size(), RECORDS_PER_OP, [&]() {
+            const uint8_t* in = payload.data();
+            for (T& record : records) {
+                memcpy(&record, in, sizeof(T));
+                in += sizeof(T);
+            }
+            do_not_optimize(records.data());
+        });
+    }
+
+    // Write records with the codec and decode them through views, the way the client and server do
+    template <typename T, typename View, typename Writer>
+    void bench_codec(BenchmarkRunner& runner, const std::string& name)
+    {
+        static_assert(View::SIZE == sizeof(T), "Codec size does not match the struct");
+
+        std::vector<uint8_t> payload(View::SIZE * RECORDS_PER_OP);
+        std::vector<T> records(RECORDS_PER_OP);
+        for (size_t i = 0; i < payload.size(); i++) {
+            payload[i] = static_cast<uint8_t>(i * 31 + 7);
+        }
+        memcpy(records.data(), payload.data(), payload.size());
+
+        runner.run("protocol/write/" + name, payload.size(), RECORDS_PER_OP, [&]() {
+            uint8_t* out = payload.data();
+            for (const T& record : records) {
+                Writer(out).assign(record);
+                out += View::SIZE;
+            }
+            do_not_optimize(payload.data());
+        });
+        runner.run("protocol/view/" + name, payload.size(), RECORDS_PER_OP, [&]() {
+            const uint8_t* in = payload.data();
+            for (T& record : records) {
+                record = View(in).to_struct();
+                in += View::SIZE;
+            }
+            do_not_optimize(records.data());
+        });
+    }
+
+    // Parse a large inbox that arrived in one chunk - every message is viewed in place
+    void bench_inbox(BenchmarkRunner& runner)
+    {
+        const size_t MESSAGE_COUNT = 100000;
+        const uint32_t CONTENT_SIZE = 64;
+
+        std::vector<uint8_t> payload;
+        payload.reserve(MESSAGE_COUNT * (ProtocolCodec::WaitingMessageResponseHeaderWriter::SIZE + CONTENT_SIZE));
+        for (size_t i = 0; i < MESSAGE_COUNT; i++) {
+            ProtocolCodec::WaitingMessageResponseHeaderWriter header = ProtocolCodec::append<ProtocolCodec::WaitingMessageResponseHeaderWriter>(payload);
+            header.set_message_id(static_cast<uint32_t>(i));
+            header.set_message_type(ClientMessageType::SEND_TEXT_MESSAGE);
+            header.set_message_size(CONTENT_SIZE);
+            payload.resize(payload.size() + CONTENT_SIZE, static_cast<uint8_t>(i));
+        }
+
+        uint64_t content_bytes = 0;
+        WaitingMessagesParser parser([&](const WaitingMessagesParser::HeaderView& header, const uint8_t* content) {
+            content_bytes += header.message_size() + content[0];
+        });
+
+        runner.run("protocol/inbox/" + std::to_string(MESSAGE_COUNT), payload.size(), MESSAGE_COUNT, [&]() {
+            parser.feed(payload.data(), payload.size());
+            do_not_optimize(content_bytes);
+        });
+    }
+
+    void bench_protocol(BenchmarkRunner& runner)
+    {
+        bench_struct<ServerRequestHeader>(runner, "ServerRequestHeader");
+        bench_struct<ServerResponseHeader>(runner, "ServerResponseHeader");
+        bench_struct<PipelinedRequestHeader>(runner, "PipelinedRequestHeader");
+        bench_struct<PipelinedResponseHeader>(runner, "PipelinedResponseHeader");
+        bench_struct<RegistrationPayload>(runner, "RegistrationPayload");
+        bench_struct<ClientListEntry>(runner, "ClientListEntry");
+        bench_struct<ClientListDeltaRequestPayload>(runner, "ClientListDeltaRequestPayload");
+        bench_struct<ClientListDeltaResponseHeader>(runner, "ClientListDeltaResponseHeader");
+        bench_struct<RetrieveClientPublicKeyPayload>(runner, "RetrieveClientPublicKeyPayload");
+        bench_struct<SendMessageToClientPayloadHeader>(runner, "SendMessageToClientPayloadHeader");
+        bench_struct<SendMessagesBatchPayloadHeader>(runner, "SendMessagesBatchPayloadHeader");
+        bench_struct<BatchMessageResult>(runner, "BatchMessageResult");
+        bench_struct<WaitingMessagesLongPollPayload>(runner, "WaitingMessagesLongPollPayload");
+        bench_struct<WaitingMessageResponseHeader>(runner, "WaitingMessageResponseHeader");
+
+        using namespace ProtocolCodec;
+        bench_codec<ServerRequestHeader, ServerRequestHeaderView, ServerRequestHeaderWriter>(runner, "ServerRequestHeader");
+        bench_codec<PipelinedResponseHeader, PipelinedResponseHeaderView, PipelinedResponseHeaderWriter>(runner, "PipelinedResponseHeader");
+        bench_codec<ClientListEntry, ClientListEntryView, ClientListEntryWriter>(runner, "ClientListEntry");
+        bench_codec<SendMessageToClientPayloadHeader, SendMessageToClientPayloadHeaderView, SendMessageToClientPayloadHeaderWriter>(runner, "SendMessageToClientPayloadHeader");
+        bench_codec<BatchMessageResult, BatchMessageResultView, BatchMessageResultWriter>(runner, "BatchMessageResult");
+        bench_codec<WaitingMessageResponseHeader, WaitingMessageResponseHeaderView, WaitingMessageResponseHeaderWriter>(runner, "WaitingMessageResponseHeader");
+        bench_inbox(runner);
+    }
+
+    bool parse_options(int argc, char* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            if (arg == "--filter") {
+                options.filter = argv[++i];
+            }
+            else if (arg == "--min-time-ms") {
+                options.min_time_ms = std::stod(argv[++i]);
+            }
+            else if (arg == "--repetitions") {
+                options.repetitions = std::max(1, std::stoi(argv[++i]));
+            }
+            else {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: bench [--filter <substring>] [--min-time-ms <ms>] [--repetitions <count>]" << std::endl;
+        return 1;
+    }
+
+    // Results of a wrong implementation are worthless
+    if (!check_stream_decrypt()) return 1;
+
+    // Progress goes to stderr, the results to stdout
+    BenchmarkRunner runner(options);
+    bench_aes(runner);
+    bench_rsa(runner);
+    bench_codecs(runner);
+    bench_compression(runner);
+    bench_protocol(runner);
+    runner.print_json(std::cout);
+    return 0;
+}
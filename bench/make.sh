@@ -0,0 +1 @@
+g++ -std=c++17 -O2 -mrdrnd -pthread -I/usr/include/cryptopp Benchmark.cpp ../AESWrapper.cpp ../RSAWrapper.cpp ../Base64Wrapper.cpp ../LZCodec.cpp ../TextCodec.cpp ../Util.cpp ../WaitingMessagesParser.cpp -o bench -lcryptopp
@@ -0,0 +1,486 @@
+// End-to-end load generator for the MessageU server, built on the client's protocol code.
+// Registers synthetic users, has each one send a symmetric key to its neighbour, then replays
+// a mix of requests at a fixed rate and reports throughput and latency percentiles per request.
+//
+// All users are asynchronous PosixClients on one epoll loop, so one thread drives thousands of
+// connections. The rate is open loop: latency is measured from when a request was due, so a
+// server that falls behind shows up in the percentiles instead of slowing the generator down.
+// The server is read from server.info in the working directory, like the client.
+//
+// Usage: loadgen [--users N] [--rate requests/s] [--duration seconds] [--mix send=50,waiting=30,list=5,key=15]
+//                [--message-size bytes] [--rsa-keys N] [--setup-concurrency N] [--prefix name]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../AESWrapper.h"
+#include "../EpollLoop.h"
+#include "../PosixClient.h"
+#include "../ProtocolHeaders.h"
+#include "../RSAKeyPool.h"
+#include "../RSAWrapper.h"
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    constexpr uint8_t CLIENT_VERSION = 2;
+
+    // Time a setup phase may take before it is abandoned
+    constexpr int SETUP_TIMEOUT_MS = 120000;
+
+    // Time to wait for the requests still in flight when the replay ends
+    constexpr int DRAIN_TIMEOUT_MS = 30000;
+
+    // Requests replayed by the generator
+    enum class Operation
+    {
+        SEND_MESSAGE,
+        WAITING_MESSAGES,
+        CLIENT_LIST,
+        PUBLIC_KEY,
+        COUNT
+    };
+
+    const char* const OPERATION_NAMES[] = { "send", "waiting", "list", "key" };
+
+    struct Options
+    {
+        size_t users = 100;
+        double rate = 1000.0;
+        double duration_seconds = 10.0;
+        double mix[static_cast<size_t>(Operation::COUNT)] = { 50, 30, 5, 15 };
+        size_t message_size = 64;
+        size_t rsa_keys = 4;
+        size_t setup_concurrency = 64;
+        std::string prefix;
+    };
+
+    struct OperationStats
+    {
+        uint64_t completed = 0;
+        uint64_t errors = 0;
+        std::vector<double> latencies_us;
+    };
+
+    // A synthetic client and the buffers of its request in flight - they stay alive until its callback
+    struct VirtualUser
+    {
+        std::unique_ptr<PosixClient> client;
+        uint8_t uuid[CLIENT_ID_LENGTH];
+        size_t key_index;   // Key pair of the shared pool it registered with
+        size_t peer;        // User it sends its messages to
+
+        // Session key sent to the peer
+        std::unique_ptr<AESSessionCipher> cipher;
+
+        ServerRequestHeader request_header;
+        RegistrationPayload registration;
+        SendMessageToClientPayloadHeader message_header;
+        std::vector<uint8_t> content;
+    };
+
+    class LoadGenerator
+    {
+        const Options& options;
+        std::shared_ptr<EpollLoop> loop = std::make_shared<EpollLoop>();
+        std::vector<VirtualUser> users;
+        std::mt19937_64 random{ std::random_device{}() };
+
+        // Public keys of the key pool - generating a pair per user would dominate the setup
+        std::vector<std::string> public_keys;
+        CryptoPP::AutoSeededRandomPool rng;
+
+        OperationStats stats[static_cast<size_t>(Operation::COUNT)];
+
+        // Fill the request header of the user
+        void init_request(VirtualUser& user, ServerRequestCodes code, uint32_t payload_size)
+        {
+            memcpy(user.request_header.client_id, user.uuid, CLIENT_ID_LENGTH);
+            user.request_header.version = CLIENT_VERSION;
+            user.request_header.code = code;
+            user.request_header.payload_size = payload_size;
+        }
+
+        // Encrypt a fresh text message to the peer into the user's content buffer
+        void prepare_message(VirtualUser& user, ClientMessageType message_type, const std::string& plain)
+        {
+            memcpy(user.message_header.client_id, users[user.peer].uuid, CLIENT_ID_LENGTH);
+            user.message_header.message_type = message_type;
+            user.content.resize(AESStreamEncryptor::encryptedSize(plain.size()));
+            user.message_header.content_size = static_cast<uint32_t>(user.cipher->encrypt(reinterpret_cast<const unsigned char*>(plain.data()), plain.size(), user.content.data()));
+        }
+
+        // Run start(user, done) for every user with at most setup_concurrency of them in flight.
+        // done must be called once per user. Returns the number of users that failed
+        size_t run_setup_phase(const char* name, const std::function<void(size_t, const std::function<void(bool)>&)>& start)
+        {
+            auto phase_start = Clock::now();
+            size_t next = 0;
+            size_t in_flight = 0;
+            size_t failed = 0;
+
+            std::function<void(bool)> done = [&](bool success) {
+                in_flight--;
+                if (!success) failed++;
+            };
+
+            auto deadline = phase_start + std::chrono::milliseconds(SETUP_TIMEOUT_MS);
+            while (next < users.size() || in_flight > 0)
+            {
+                while (next < users.size() && in_flight < options.setup_concurrency) {
+                    in_flight++;
+                    start(next++, done);
+                }
+                if (Clock::now() > deadline || loop->run_once(100) < 0) {
+                    std::cerr << name << " timed out" << std::endl;
+                    return users.size();
+                }
+            }
+
+            double elapsed = std::chrono::duration<double>(Clock::now() - phase_start).count();
+            std::cerr << name << ": " << users.size() - failed << " users in " << std::fixed << std::setprecision(2) << elapsed << " s" << std::endl;
+            return failed;
+        }
+
+        void register_user(size_t index, const std::function<void(bool)>& done)
+        {
+            VirtualUser& user = users[index];
+            std::string name = options.prefix + "_" + std::to_string(index);
+
+            memset(user.uuid, 0, CLIENT_ID_LENGTH);
+            init_request(user, ServerRequestCodes::REGISTRATION_CLIENT_REQUEST, sizeof(RegistrationPayload));
+            user.registration = RegistrationPayload{};
+            memcpy(user.registration.name, name.data(), std::min<size_t>(name.size(), MAX_REGISTRATION_NAME_LENGTH - 1));
+            memcpy(user.registration.public_key, public_keys[user.key_index].data(), PUBLIC_KEY_LENGTH);
+
+            bool started = user.client->async_request(user.request_header, { { &user.registration, sizeof(user.registration) } },
+                [&user, done](bool success, const ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload) {
+                    success = success && response_header.code == ServerResponseCodes::REGISTRATION_SUCCESS && server_payload.size() == CLIENT_ID_LENGTH;
+                    if (success) memcpy(user.uuid, server_payload.data(), CLIENT_ID_LENGTH);
+                    done(success);
+                });
+            if (!started) done(false);
+        }
+
+        // Fetch the peer's public key, then send it a new session key encrypted with it
+        void exchange_keys(size_t index, const std::function<void(bool)>& done)
+        {
+            VirtualUser& user = users[index];
+
+            init_request(user, ServerRequestCodes::PUBLIC_KEY_REQUEST, CLIENT_ID_LENGTH);
+            bool started = user.client->async_request(user.request_header, { { users[user.peer].uuid, CLIENT_ID_LENGTH } },
+                [this, &user, done](bool success, const ServerResponseHeader& response_header, std::vector<uint8_t>& server_payload) {
+                    if (!success || response_header.code != ServerResponseCodes::PUBLIC_KEY_RESPONSE || server_payload.size() != CLIENT_ID_LENGTH + PUBLIC_KEY_LENGTH) {
+                        done(false);
+                        return;
+                    }
+
+                    unsigned char key[AESWrapper::DEFAULT_KEYLENGTH];
+                    AESWrapper::GenerateKey(key, AESWrapper::DEFAULT_KEYLENGTH);
+                    user.cipher = std::make_unique<AESSessionCipher>(key, AESWrapper::DEFAULT_KEYLENGTH);
+
+                    std::string encrypted_key;
+                    try {
+                        RSAPublicEncryptor encryptor(reinterpret_cast<const char*>(&server_payload[CLIENT_ID_LENGTH]), PUBLIC_KEY_LENGTH);
+                        encrypted_key = encryptor.encrypt(rng, reinterpret_cast<const char*>(key), AESWrapper::DEFAULT_KEYLENGTH);
+                    }
+                    catch (const std::exception&) {
+                        done(false);
+                        return;
+                    }
+
+                    memcpy(user.message_header.client_id, users[user.peer].uuid, CLIENT_ID_LENGTH);
+                    user.message_header.message_type = ClientMessageType::SEND_SYMMETRIC_KEY;
+                    user.message_header.content_size = static_cast<uint32_t>(encrypted_key.size());
+                    user.content.assign(encrypted_key.begin(), encrypted_key.end());
+
+                    init_request(user, ServerRequestCodes::SEND_MESSAGE_TO_CLIENT, static_cast<uint32_t>(sizeof(user.message_header) + user.content.size()));
+                    bool sent = user.client->async_request(user.request_header, { { &user.message_header, sizeof(user.message_header) }, { user.content.data(), user.content.size() } },
+                        [done](bool success, const ServerResponseHeader& response_header, std::vector<uint8_t>&) {
+                            done(success && response_header.code == ServerResponseCodes::MESSAGE_TO_CLIENT_SENT_TO_SERVER);
+                        });
+                    if (!sent) done(false);
+                });
+            if (!started) done(false);
+        }
+
+        // Start one replayed request on an idle user, calls on_done with the outcome when it completes
+        bool start_operation(VirtualUser& user, Operation operation, const std::string& text, const PosixClient::ResponseCallback& on_done)
+        {
+            switch (operation)
+            {
+            case Operation::SEND_MESSAGE:
+                prepare_message(user, ClientMessageType::SEND_TEXT_MESSAGE, text);
+                init_request(user, ServerRequestCodes::SEND_MESSAGE_TO_CLIENT, static_cast<uint32_t>(sizeof(user.message_header) + user.message_header.content_size));
+                return user.client->async_request(user.request_header, { { &user.message_header, sizeof(user.message_header) }, { user.content.data(), user.message_header.content_size } }, on_done);
+            case Operation::WAITING_MESSAGES:
+                init_request(user, ServerRequestCodes::WAITING_MESSAGES_REQUEST, 0);
+                return user.client->async_request(user.request_header, {}, on_done);
+            case Operation::CLIENT_LIST:
+                init_request(user, ServerRequestCodes::CLIENT_LIST_REQUEST, 0);
+                return user.client->async_request(user.request_header, {}, on_done);
+            case Operation::PUBLIC_KEY:
+            default:
+                init_request(user, ServerRequestCodes::PUBLIC_KEY_REQUEST, CLIENT_ID_LENGTH);
+                return user.client->async_request(user.request_header, { { users[user.peer].uuid, CLIENT_ID_LENGTH } }, on_done);
+            }
+        }
+
+        static ServerResponseCodes expected_response(Operation operation)
+        {
+            switch (operation)
+            {
+            case Operation::SEND_MESSAGE: return ServerResponseCodes::MESSAGE_TO_CLIENT_SENT_TO_SERVER;
+            case Operation::WAITING_MESSAGES: return ServerResponseCodes::WAITING_MESSAGES_RESPONSE;
+            case Operation::CLIENT_LIST: return ServerResponseCodes::CLIENT_LIST_RESPONSE;
+            case Operation::PUBLIC_KEY:
+            default: return ServerResponseCodes::PUBLIC_KEY_RESPONSE;
+            }
+        }
+
+        Operation pick_operation(std::discrete_distribution<size_t>& distribution)
+        {
+            return static_cast<Operation>(distribution(random));
+        }
+
+        // Replay the mix at the target rate - returns the replay time in seconds
+        double replay()
+        {
+            std::discrete_distribution<size_t> distribution(std::begin(options.mix), std::end(options.mix));
+            std::string text(options.message_size, 'x');
+
+            // Users without a request in flight, and requests that were due while all users were busy
+            std::deque<size_t> idle_users;
+            for (size_t i = 0; i < users.size(); i++) idle_users.push_back(i);
+            std::deque<std::pair<Clock::time_point, Operation>> backlog;
+            size_t max_backlog = 0;
+            size_t in_flight = 0;
+
+            auto issue = [&](Clock::time_point due, Operation operation) {
+                size_t index = idle_users.front();
+                idle_users.pop_front();
+                in_flight++;
+
+                bool started = start_operation(users[index], operation, text,
+                    [&, index, due, operation](bool success, const ServerResponseHeader& response_header, std::vector<uint8_t>&) {
+                        OperationStats& operation_stats = stats[static_cast<size_t>(operation)];
+                        if (success && response_header.code == expected_response(operation)) {
+                            operation_stats.completed++;
+                            operation_stats.latencies_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - due).count());
+                        }
+                        else {
+                            operation_stats.errors++;
+                        }
+                        in_flight--;
+                        idle_users.push_back(index);
+                    });
+                if (!started) {
+                    stats[static_cast<size_t>(operation)].errors++;
+                    in_flight--;
+                    idle_users.push_back(index);
+                }
+            };
+
+            auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.rate));
+            auto start = Clock::now();
+            auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_seconds));
+            auto next_due = start;
+
+            while (true)
+            {
+                auto now = Clock::now();
+
+                // Queue every request that is due by now, with the time it was due
+                while (next_due <= now && next_due < end) {
+                    backlog.emplace_back(next_due, pick_operation(distribution));
+                    next_due += interval;
+                }
+                max_backlog = std::max(max_backlog, backlog.size());
+
+                // Hand them to idle users
+                while (!backlog.empty() && !idle_users.empty()) {
+                    issue(backlog.front().first, backlog.front().second);
+                    backlog.pop_front();
+                }
+
+                if (next_due >= end && backlog.empty()) break;
+
+                // Wait for responses until the next request is due
+                int timeout_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next_due - Clock::now()).count());
+                if (loop->run_once(std::max(timeout_ms, 0)) < 0) break;
+            }
+            double replay_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            // Let the requests in flight finish
+            auto deadline = Clock::now() + std::chrono::milliseconds(DRAIN_TIMEOUT_MS);
+            while (in_flight > 0 && Clock::now() < deadline) {
+                if (loop->run_once(100) < 0) break;
+            }
+            if (in_flight > 0) {
+                std::cerr << in_flight << " requests did not complete" << std::endl;
+            }
+
+            std::cerr << "Largest backlog of due requests: " << max_backlog << std::endl;
+            return replay_seconds;
+        }
+
+        static double percentile(const std::vector<double>& sorted, double fraction)
+        {
+            if (sorted.empty()) return 0;
+            size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+            return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+        }
+
+        void report(double replay_seconds)
+        {
+            uint64_t total = 0;
+            for (const OperationStats& operation_stats : stats) total += operation_stats.completed;
+
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << "users " << users.size() << ", target " << options.rate << " req/s, achieved "
+                << static_cast<double>(total) / replay_seconds << " req/s over " << replay_seconds << " s\n";
+            std::cout << std::left << std::setw(10) << "request" << std::right
+                << std::setw(10) << "count" << std::setw(8) << "errors" << std::setw(12) << "req/s"
+                << std::setw(12) << "p50 ms" << std::setw(12) << "p99 ms" << std::setw(12) << "p999 ms" << std::setw(12) << "max ms" << "\n";
+
+            for (size_t i = 0; i < static_cast<size_t>(Operation::COUNT); i++)
+            {
+                OperationStats& operation_stats = stats[i];
+                std::sort(operation_stats.latencies_us.begin(), operation_stats.latencies_us.end());
+                const std::vector<double>& sorted = operation_stats.latencies_us;
+
+                std::cout << std::left << std::setw(10) << OPERATION_NAMES[i] << std::right
+                    << std::setw(10) << operation_stats.completed << std::setw(8) << operation_stats.errors
+                    << std::setw(12) << static_cast<double>(operation_stats.completed) / replay_seconds
+                    << std::setw(12) << percentile(sorted, 0.50) / 1000
+                    << std::setw(12) << percentile(sorted, 0.99) / 1000
+                    << std::setw(12) << percentile(sorted, 0.999) / 1000
+                    << std::setw(12) << (sorted.empty() ? 0 : sorted.back() / 1000) << "\n";
+            }
+            std::cout << std::flush;
+        }
+
+    public:
+        explicit LoadGenerator(const Options& options) : options(options)
+        {
+        }
+
+        bool run()
+        {
+            // Key pairs shared by the users, generated on all cores
+            std::cerr << "Generating " << options.rsa_keys << " RSA key pairs" << std::endl;
+            {
+                RSAKeyPool key_pool(options.rsa_keys, 0, options.rsa_keys);
+                for (size_t i = 0; i < options.rsa_keys; i++) {
+                    RSAKeyPair key_pair = key_pool.take();
+                    public_keys.emplace_back(key_pair.public_key, PUBLIC_KEY_LENGTH);
+                }
+            }
+
+            users.resize(options.users);
+            for (size_t i = 0; i < users.size(); i++) {
+                users[i].client = std::make_unique<PosixClient>(loop);
+                users[i].key_index = i % public_keys.size();
+                users[i].peer = (i + 1) % users.size();
+            }
+
+            using namespace std::placeholders;
+            if (run_setup_phase("Registration", std::bind(&LoadGenerator::register_user, this, _1, _2)) > 0) {
+                std::cerr << "Registration failed" << std::endl;
+                return false;
+            }
+            if (run_setup_phase("Key exchange", std::bind(&LoadGenerator::exchange_keys, this, _1, _2)) > 0) {
+                std::cerr << "Key exchange failed" << std::endl;
+                return false;
+            }
+
+            report(replay());
+            return true;
+        }
+    };
+
+    bool parse_mix(const std::string& value, Options& options)
+    {
+        std::fill(std::begin(options.mix), std::end(options.mix), 0.0);
+
+        std::stringstream stream(value);
+        std::string item;
+        while (std::getline(stream, item, ','))
+        {
+            size_t equals = item.find('=');
+            if (equals == std::string::npos) return false;
+            std::string name = item.substr(0, equals);
+
+            auto found = std::find_if(std::begin(OPERATION_NAMES), std::end(OPERATION_NAMES), [&](const char* operation_name) { return name == operation_name; });
+            if (found == std::end(OPERATION_NAMES)) return false;
+            options.mix[found - std::begin(OPERATION_NAMES)] = std::stod(item.substr(equals + 1));
+        }
+        return std::any_of(std::begin(options.mix), std::end(options.mix), [](double weight) { return weight > 0; });
+    }
+
+    bool parse_options(int argc, char* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+
+            if (arg == "--users") options.users = std::stoul(value);
+            else if (arg == "--rate") options.rate = std::stod(value);
+            else if (arg == "--duration") options.duration_seconds = std::stod(value);
+            else if (arg == "--message-size") options.message_size = std::stoul(value);
+            else if (arg == "--rsa-keys") options.rsa_keys = std::stoul(value);
+            else if (arg == "--setup-concurrency") options.setup_concurrency = std::stoul(value);
+            else if (arg == "--prefix") options.prefix = value;
+            else if (arg == "--mix") {
+                if (!parse_mix(value, options)) {
+                    std::cerr << "Invalid mix " << value << std::endl;
+                    return false;
+                }
+            }
+            else {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return false;
+            }
+        }
+
+        // Two users are needed for a key exchange
+        return options.users >= 2 && options.rate > 0 && options.duration_seconds > 0 && options.rsa_keys > 0 && options.setup_concurrency > 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: loadgen [--users N] [--rate requests/s] [--duration seconds] [--mix send=50,waiting=30,list=5,key=15]\n"
+            << "               [--message-size bytes] [--rsa-keys N] [--setup-concurrency N] [--prefix name]" << std::endl;
+        return 1;
+    }
+
+    // Names must be unique on the server - tell runs apart unless a prefix is given
+    if (options.prefix.empty()) {
+        options.prefix = "load" + std::to_string(getpid());
+    }
+
+    LoadGenerator generator(options);
+    return generator.run() ? 0 : 1;
+}
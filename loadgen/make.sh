@@ -0,0 +1 @@
+g++ -std=c++17 -O2 -mrdrnd -pthread -I/usr/include/cryptopp LoadGenerator.cpp ../AESWrapper.cpp ../RSAWrapper.cpp ../PosixClient.cpp ../EpollLoop.cpp ../Transport.cpp ../RequestMetrics.cpp ../EndpointCache.cpp ../RSAKeyPool.cpp ../TextCodec.cpp ../Util.cpp -o loadgen -lcryptopp
@@ -5,7 +5,6 @@
 #include <fstream>
 
 #include "ConsoleApp.h"
-#include "WinsockClient.h"
 
 int main()
 {
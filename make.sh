@@ -0,0 +1 @@
+g++ -std=c++17 -O2 -mrdrnd -pthread -I/usr/include/cryptopp *.cpp -o MessageU -lcryptopp
@@ -10,11 +10,19 @@ from enum import Enum
 # Constants
 
 SERVER_VERSION = 1
+PIPELINED_VERSION = 3 # Request and response headers carry a request id
 CLIENT_UUID_LENGTH = 16
 PUBLIC_KEY_LENGTH = 160
 CLIENT_NAME_MAX_LENGTH = 255
 REGISTRATION_PAYLOAD_SIZE = 415
 SEND_MESSAGE_PAYLOAD_HEADER_SIZE = 21
+REQUEST_HEADER_SIZE = 23
+RESPONSE_HEADER_SIZE = 7
+REQUEST_ID_SIZE = 4
+CLIENT_LIST_DELTA_PAYLOAD_SIZE = 16
+BATCH_PAYLOAD_HEADER_SIZE = 4
+LONG_POLL_PAYLOAD_SIZE = 4
+MAX_LONG_POLL_TIMEOUT_MS = 60000
 
 # Protocol enums
 
@@ -24,6 +32,9 @@ class ClientCodes(Enum):
     PUBLIC_KEY_REQUEST = 1002
     SEND_MESSAGE_TO_CLIENT = 1003
     WAITING_MESSAGES_REQUEST = 1004
+    CLIENT_LIST_DELTA_REQUEST = 1005
+    SEND_MESSAGES_BATCH = 1006
+    WAITING_MESSAGES_LONG_POLL = 1007
 
 class ServerCodes(Enum):
     REGISTRATION_SUCCESS = 2000
@@ -31,8 +42,14 @@ class ServerCodes(Enum):
     PUBLIC_KEY_RESPONSE = 2002
     MESSAGE_TO_CLIENT_SENT_TO_SERVER = 2003
     WAITING_MESSAGES_RESPONSE = 2004
+    CLIENT_LIST_DELTA_RESPONSE = 2005
+    MESSAGES_BATCH_SENT_TO_SERVER = 2006
     GENERAL_FAILURE = 9000
 
+class BatchMessageStatus(Enum):
+    QUEUED = 0
+    DESTINATION_NOT_FOUND = 1
+
 class MessageType(Enum):
     SYMMETRIC_KEY_REQUEST = 1
     SEND_SYMMETRIC_KEY = 2
@@ -52,18 +69,61 @@ class ClientStruct:
         self.uuid = bytes.fromhex(uuid.uuid4().hex) # Probability grantee us that there is no other user with this UUID
         self.public_key = public_key
         self.waiting_messages = [] # List of Message
+        self.messages_condition = threading.Condition() # Guards waiting_messages and wakes long polls
+        self.directory_version = 0 # Set when added to the directory
 
     def add_message(self, message_type, sender, message_content):
         message = Message(message_type, sender, message_content)
-        self.waiting_messages.append(message)
+        with self.messages_condition:
+            self.waiting_messages.append(message)
+            self.messages_condition.notify_all()
         return message.message_uuid
 
     def pull_messages(self):
-        messages_copy = self.waiting_messages.copy()
-        self.waiting_messages = [] # Delete messages
+        with self.messages_condition:
+            messages_copy = self.waiting_messages
+            self.waiting_messages = [] # Delete messages
         return messages_copy
 
+    def wait_for_messages(self, timeout):
+        """Block until a message is waiting or timeout seconds passed"""
+        with self.messages_condition:
+            self.messages_condition.wait_for(lambda: len(self.waiting_messages) > 0, timeout)
+
 clients = [] # List of ClientStruct
+clients_lock = threading.Lock() # Keeps clients ordered by directory version
+
+# Identifies this run of the server's directory - clients holding another id get the full list
+DIRECTORY_ID = random.randint(1, 0xffffffffffffffff)
+directory_version = 0 # Version of the last client added
+
+def recv_exact(clientsocket, size):
+    """Receive exactly size bytes, returns None if the connection was closed before"""
+    data = b''
+    while len(data) < size:
+        chunk = clientsocket.recv(size - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+class PipelinedSocket:
+    """Client socket for a version 3 request - adds the request id to the response header"""
+    def __init__(self, clientsocket, request_id):
+        self.clientsocket = clientsocket
+        self.request_id = request_id
+        self.header_sent = False
+
+    def recv(self, size):
+        return self.clientsocket.recv(size)
+
+    def sendall(self, data):
+        # Every response starts with its header - rewrite it in the first send
+        if not self.header_sent:
+            self.header_sent = True
+            server_version, server_code, payload_size = struct.unpack_from('<B H I', data)
+            data = struct.pack('<B H I I', PIPELINED_VERSION, server_code, payload_size, self.request_id) + data[RESPONSE_HEADER_SIZE:]
+        self.clientsocket.sendall(data)
 
 def is_client_uuid_exists(client_uuid):
     for client in clients:
@@ -89,8 +149,12 @@ class RequestHandler:
             clientsocket.sendall(server_header)
             return
         # Save user
+        global directory_version
         new_client = ClientStruct(client_name, client_public_key)
-        clients.append(new_client)
+        with clients_lock:
+            directory_version += 1
+            new_client.directory_version = directory_version
+            clients.append(new_client)
         # Create header
         server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.REGISTRATION_SUCCESS.value, len(new_client.uuid))
         print("Response from server:\nHeader = %s\nPayload = %s" % (server_header,new_client.uuid))
@@ -105,6 +169,23 @@ class RequestHandler:
         for client in clients:
             client_null_terminated_str_name = client.name.encode() + b'\0'*(CLIENT_NAME_MAX_LENGTH - len(client.name.encode()))
             clientsocket.sendall(client.uuid + client_null_terminated_str_name)
+
+    def client_list_delta_request(self, clientsocket, client_directory_id, client_cursor):
+        with clients_lock:
+            snapshot = list(clients)
+            cursor = directory_version
+        if client_directory_id == DIRECTORY_ID:
+            # Only clients added after the client's cursor
+            full_list = 0
+            changed = [client for client in snapshot if client.directory_version > client_cursor]
+        else:
+            # Unknown directory - start the client over
+            full_list = 1
+            changed = snapshot
+        entries = [client.uuid + client.name.encode().ljust(CLIENT_NAME_MAX_LENGTH, b'\0') for client in changed]
+        server_payload = struct.pack('<Q Q B', DIRECTORY_ID, cursor, full_list) + b''.join(entries)
+        server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.CLIENT_LIST_DELTA_RESPONSE.value, len(server_payload))
+        clientsocket.sendall(server_header + server_payload)
     
     def public_key_request(self, clientsocket, client_uuid):
         for client in clients:
@@ -131,10 +212,33 @@ class RequestHandler:
                 clientsocket.sendall(server_header + server_payload)
                 return
 
-    def awaiting_messages_request(self, clientsocket, client_uuid):
+        # Failure - destination client not found
+        print("Destination client not found")
+        server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.GENERAL_FAILURE.value, 0)
+        clientsocket.sendall(server_header)
+
+    def messages_batch_request(self, clientsocket, sender_client, messages):
+        server_payload = b""
+        for dest_client, message_type, message_content in messages:
+            # Queue each message - a missing destination fails only its own record
+            status = BatchMessageStatus.DESTINATION_NOT_FOUND.value
+            message_uuid = 0
+            for client in clients:
+                if dest_client == client.uuid:
+                    message_uuid = client.add_message(message_type, sender_client, message_content)
+                    status = BatchMessageStatus.QUEUED.value
+                    break
+            server_payload += struct.pack('<%ds I B' % CLIENT_UUID_LENGTH, dest_client, message_uuid, status)
+        server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.MESSAGES_BATCH_SENT_TO_SERVER.value, len(server_payload))
+        clientsocket.sendall(server_header + server_payload)
+
+    def awaiting_messages_request(self, clientsocket, client_uuid, timeout_ms=0):
         server_payload = b""
         for client in clients:
             if client_uuid == client.uuid:
+                if timeout_ms > 0:
+                    # Long poll - hold the request until there is something to deliver
+                    client.wait_for_messages(min(timeout_ms, MAX_LONG_POLL_TIMEOUT_MS) / 1000)
                 for message in client.pull_messages():
                     server_payload += struct.pack('<%ds I B I' % CLIENT_UUID_LENGTH, message.sender, message.message_uuid, message.type, len(message.content)) + message.content
         server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.WAITING_MESSAGES_RESPONSE.value, len(server_payload))
@@ -171,9 +275,28 @@ class Server:
             threading.Thread(target=self.handle_client, args=(clientsocket,)).start()
 
     def handle_client(self, clientsocket):
-        """Client entry point"""
-        # Receive header from client
-        client_id, client_version, client_code, client_payload_size = struct.unpack('<%ds B H I' % CLIENT_UUID_LENGTH, clientsocket.recv(23))
+        """Client entry point - serves requests until the client closes the connection"""
+        while True:
+            # Receive header from client
+            client_header = recv_exact(clientsocket, REQUEST_HEADER_SIZE)
+            if client_header is None:
+                # Client closed the session (or sent a one-shot request and shut down its side)
+                break
+            request_socket = clientsocket
+            if client_header[CLIENT_UUID_LENGTH] >= PIPELINED_VERSION:
+                # Pipelined request - its response is matched by the request id that follows the header
+                request_id = recv_exact(clientsocket, REQUEST_ID_SIZE)
+                if request_id is None:
+                    break
+                request_socket = PipelinedSocket(clientsocket, struct.unpack('<I', request_id)[0])
+            if not self.handle_request(request_socket, client_header):
+                break
+        # Close connection
+        clientsocket.close()
+
+    def handle_request(self, clientsocket, client_header):
+        """Handle a single request, returns False if the connection should be closed"""
+        client_id, client_version, client_code, client_payload_size = struct.unpack('<%ds B H I' % CLIENT_UUID_LENGTH, client_header)
         # Print header for monitoring
         print("Client ID = %s\nClient Version = %d\nClient Code = %d\nClient Payload Size = %d" % (client_id, client_version, client_code, client_payload_size))
         # Handle request
@@ -181,12 +304,12 @@ class Server:
             # Get payload from user
             if client_payload_size != REGISTRATION_PAYLOAD_SIZE:
                 print("Error: Incorrect payload size, Got %d and expected %d" % (client_payload_size, REGISTRATION_PAYLOAD_SIZE))
-                return
+                return False
             try:
-                client_name, client_public_key = struct.unpack('<%ds %ds' % (CLIENT_NAME_MAX_LENGTH, PUBLIC_KEY_LENGTH), clientsocket.recv(REGISTRATION_PAYLOAD_SIZE))
+                client_name, client_public_key = struct.unpack('<%ds %ds' % (CLIENT_NAME_MAX_LENGTH, PUBLIC_KEY_LENGTH), recv_exact(clientsocket, REGISTRATION_PAYLOAD_SIZE))
             except:
                 print("Error: Could not get client payload")
-                return
+                return False
             client_name = client_name.rstrip(b'\0').decode() # Remove trailing zeros
             # Print for monitoring
             print("Client name = %s\nClient public key = %s" % (client_name, client_public_key))
@@ -196,7 +319,30 @@ class Server:
             if is_client_uuid_exists(client_id):
                 self.request_handler.client_list_request(clientsocket)
             else:
-                # Cannot serve unregistered client
+                # Cannot serve unregistered client - skip its payload so the session stays in sync
+                if client_payload_size > 0 and recv_exact(clientsocket, client_payload_size) is None:
+                    return False
+                server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.GENERAL_FAILURE.value, 0)
+                print("Response from server:\nHeader = %s" % server_header)
+                # Send back response
+                clientsocket.sendall(server_header)
+
+        elif client_code == ClientCodes.CLIENT_LIST_DELTA_REQUEST.value:
+            if is_client_uuid_exists(client_id):
+                if client_payload_size != CLIENT_LIST_DELTA_PAYLOAD_SIZE:
+                    print("Error: Incorrect payload size, Got %d and expected %d" % (client_payload_size, CLIENT_LIST_DELTA_PAYLOAD_SIZE))
+                    return False
+                try:
+                    client_directory_id, client_cursor = struct.unpack('<Q Q', recv_exact(clientsocket, CLIENT_LIST_DELTA_PAYLOAD_SIZE))
+                except:
+                    print("Error: Could not get client payload")
+                    return False
+                print("Directory ID = %d\nCursor = %d" % (client_directory_id, client_cursor))
+                self.request_handler.client_list_delta_request(clientsocket, client_directory_id, client_cursor)
+            else:
+                # Cannot serve unregistered client - skip its payload so the session stays in sync
+                if client_payload_size > 0 and recv_exact(clientsocket, client_payload_size) is None:
+                    return False
                 server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.GENERAL_FAILURE.value, 0)
                 print("Response from server:\nHeader = %s" % server_header)
                 # Send back response
@@ -206,16 +352,18 @@ class Server:
             if is_client_uuid_exists(client_id):
                 # Get payload from user
                 try:
-                    client_uuid = struct.unpack('<%ds' % CLIENT_UUID_LENGTH, clientsocket.recv(CLIENT_UUID_LENGTH))
+                    client_uuid = struct.unpack('<%ds' % CLIENT_UUID_LENGTH, recv_exact(clientsocket, CLIENT_UUID_LENGTH))
                 except:
                     print("Error: Could not get client payload")
-                    return
+                    return False
                 client_uuid = client_uuid[0] # Convert from tuple
                 # Print for monitoring
                 print("Client uuid = %s" % (client_uuid))
                 self.request_handler.public_key_request(clientsocket, client_uuid)
             else:
-                # Cannot serve unregistered client
+                # Cannot serve unregistered client - skip its payload so the session stays in sync
+                if client_payload_size > 0 and recv_exact(clientsocket, client_payload_size) is None:
+                    return False
                 server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.GENERAL_FAILURE.value, 0)
                 print("Response from server:\nHeader = %s" % server_header)
                 # Send back response
@@ -225,19 +373,77 @@ class Server:
             if is_client_uuid_exists(client_id):
                 if client_payload_size < SEND_MESSAGE_PAYLOAD_HEADER_SIZE:
                     print("Error: Payload header is too small, Got %d and expected header is %d" % (client_payload_size, SEND_MESSAGE_PAYLOAD_HEADER_SIZE))
-                    return
+                    return False
                 try:
-                    dest_client, message_type, message_size = struct.unpack('<%ds B I' % CLIENT_UUID_LENGTH, clientsocket.recv(SEND_MESSAGE_PAYLOAD_HEADER_SIZE))
-                    message_content = b''
-                    while len(message_content) < message_size:
-                        message_content += clientsocket.recv(self.DEFAULT_BUFLEN)
+                    dest_client, message_type, message_size = struct.unpack('<%ds B I' % CLIENT_UUID_LENGTH, recv_exact(clientsocket, SEND_MESSAGE_PAYLOAD_HEADER_SIZE))
+                    # Read exactly the message content - the next request may follow on the same connection
+                    message_content = recv_exact(clientsocket, message_size)
+                    if message_content is None:
+                        return False
                 except:
                     print("Error: Could not get client payload")
-                    return
+                    return False
                 print("Client ID = %s\nDestination client ID = %s\nMessage type = %d\nMessage content = %s" % (client_id, dest_client, message_type, message_content))
                 self.request_handler.text_message_request(clientsocket, client_id, dest_client, message_type, message_content)
             else:
-                # Cannot serve unregistered client
+                # Cannot serve unregistered client - skip its payload so the session stays in sync
+                if client_payload_size > 0 and recv_exact(clientsocket, client_payload_size) is None:
+                    return False
+                server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.GENERAL_FAILURE.value, 0)
+                print("Response from server:\nHeader = %s" % server_header)
+                # Send back response
+                clientsocket.sendall(server_header)
+
+        elif client_code == ClientCodes.SEND_MESSAGES_BATCH.value:
+            if is_client_uuid_exists(client_id):
+                if client_payload_size < BATCH_PAYLOAD_HEADER_SIZE:
+                    print("Error: Payload header is too small, Got %d and expected header is %d" % (client_payload_size, BATCH_PAYLOAD_HEADER_SIZE))
+                    return False
+                client_payload = recv_exact(clientsocket, client_payload_size)
+                if client_payload is None:
+                    print("Error: Could not get client payload")
+                    return False
+                # Split the payload into its message records
+                messages = []
+                message_count, = struct.unpack_from('<I', client_payload, 0)
+                offset = BATCH_PAYLOAD_HEADER_SIZE
+                for i in range(message_count):
+                    if offset + SEND_MESSAGE_PAYLOAD_HEADER_SIZE > client_payload_size:
+                        print("Error: Batch is truncated")
+                        return False
+                    dest_client, message_type, message_size = struct.unpack_from('<%ds B I' % CLIENT_UUID_LENGTH, client_payload, offset)
+                    offset += SEND_MESSAGE_PAYLOAD_HEADER_SIZE
+                    if offset + message_size > client_payload_size:
+                        print("Error: Batch is truncated")
+                        return False
+                    messages.append((dest_client, message_type, client_payload[offset:offset + message_size]))
+                    offset += message_size
+                print("Client ID = %s\nBatch of %d messages" % (client_id, message_count))
+                self.request_handler.messages_batch_request(clientsocket, client_id, messages)
+            else:
+                # Cannot serve unregistered client - skip its payload so the session stays in sync
+                if client_payload_size > 0 and recv_exact(clientsocket, client_payload_size) is None:
+                    return False
+                server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.GENERAL_FAILURE.value, 0)
+                print("Response from server:\nHeader = %s" % server_header)
+                # Send back response
+                clientsocket.sendall(server_header)
+
+        elif client_code == ClientCodes.WAITING_MESSAGES_LONG_POLL.value:
+            if is_client_uuid_exists(client_id):
+                if client_payload_size != LONG_POLL_PAYLOAD_SIZE:
+                    print("Error: Incorrect payload size, Got %d and expected %d" % (client_payload_size, LONG_POLL_PAYLOAD_SIZE))
+                    return False
+                client_payload = recv_exact(clientsocket, LONG_POLL_PAYLOAD_SIZE)
+                if client_payload is None:
+                    print("Error: Could not get client payload")
+                    return False
+                timeout_ms, = struct.unpack('<I', client_payload)
+                self.request_handler.awaiting_messages_request(clientsocket, client_id, timeout_ms)
+            else:
+                # Cannot serve unregistered client - skip its payload so the session stays in sync
+                if client_payload_size > 0 and recv_exact(clientsocket, client_payload_size) is None:
+                    return False
                 server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.GENERAL_FAILURE.value, 0)
                 print("Response from server:\nHeader = %s" % server_header)
                 # Send back response
@@ -247,7 +453,9 @@ class Server:
             if is_client_uuid_exists(client_id):
                 self.request_handler.awaiting_messages_request(clientsocket, client_id)
             else:
-                # Cannot serve unregistered client
+                # Cannot serve unregistered client - skip its payload so the session stays in sync
+                if client_payload_size > 0 and recv_exact(clientsocket, client_payload_size) is None:
+                    return False
                 server_header = struct.pack('<B H I', SERVER_VERSION, ServerCodes.GENERAL_FAILURE.value, 0)
                 print("Response from server:\nHeader = %s" % server_header)
                 # Send back response
@@ -255,8 +463,8 @@ class Server:
 
         else:
             print("Unsupported request from client", client_code)
-        # Close connection
-        clientsocket.close()
+            return False
+        return True
 
 def main():
     server = Server()
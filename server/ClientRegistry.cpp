@@ -0,0 +1,155 @@
+#include "ClientRegistry.h"
+#include "ServerWorker.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <random>
+
+namespace
+{
+    // Random numbers for ids - a generator per thread, so registrations and messages don't contend on it
+    uint64_t random_u64()
+    {
+        thread_local std::mt19937_64 generator(std::random_device{}());
+        return generator();
+    }
+}
+
+bool ClientId::operator==(const ClientId& other) const
+{
+    return memcmp(bytes, other.bytes, CLIENT_ID_LENGTH) == 0;
+}
+
+size_t ClientIdHash::operator()(const ClientId& id) const
+{
+    uint64_t hash;
+    memcpy(&hash, id.bytes, sizeof(hash));
+    return static_cast<size_t>(hash);
+}
+
+ClientRegistry::ClientRegistry() : directory_id(random_u64() | 1)
+{
+}
+
+ClientRecord* ClientRegistry::register_client(const std::string& name, const uint8_t* public_key)
+{
+    std::unique_ptr<ClientRecord> record = std::make_unique<ClientRecord>();
+    memcpy(record->public_key, public_key, PUBLIC_KEY_LENGTH);
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    if (names.count(name) != 0) return nullptr;
+
+    // A collision of random ids is practically impossible, but cheap to rule out
+    do {
+        uint64_t random[2] = { random_u64(), random_u64() };
+        memcpy(record->id.bytes, random, CLIENT_ID_LENGTH);
+    } while (clients.count(record->id) != 0);
+
+    ProtocolCodec::ClientListEntryWriter entry = ProtocolCodec::append<ProtocolCodec::ClientListEntryWriter>(directory);
+    entry.set_client_id(record->id.bytes);
+    entry.set_name(name);
+
+    ClientRecord* client = record.get();
+    names.insert(name);
+    clients.emplace(client->id, client);
+    records.push_back(std::move(record));
+    return client;
+}
+
+ClientRecord* ClientRegistry::find(const uint8_t* client_id) const
+{
+    ClientId id;
+    memcpy(id.bytes, client_id, CLIENT_ID_LENGTH);
+
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = clients.find(id);
+    return it == clients.end() ? nullptr : it->second;
+}
+
+uint64_t ClientRegistry::get_directory_id() const
+{
+    return directory_id;
+}
+
+uint64_t ClientRegistry::copy_directory(uint64_t cursor, std::vector<uint8_t>& out) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    uint64_t current = records.size();
+    if (cursor < current) {
+        out.insert(out.end(), directory.begin() + cursor * ProtocolCodec::ClientListEntryView::SIZE, directory.end());
+    }
+    return current;
+}
+
+uint32_t ClientRegistry::queue_message(ClientRecord& client, const uint8_t* sender_id, ClientMessageType type, const uint8_t* content, uint32_t content_size)
+{
+    // Build the message as it will be sent, outside the lock
+    uint32_t message_id = static_cast<uint32_t>(random_u64());
+    StoredMessage message(ProtocolCodec::WaitingMessageResponseHeaderWriter::SIZE + content_size);
+    ProtocolCodec::WaitingMessageResponseHeaderWriter header(message.data());
+    header.set_client_id(sender_id);
+    header.set_message_id(message_id);
+    header.set_message_type(type);
+    header.set_message_size(content_size);
+    if (content_size > 0) {
+        memcpy(message.data() + ProtocolCodec::WaitingMessageResponseHeaderWriter::SIZE, content, content_size);
+    }
+
+    std::vector<MailboxWaiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(client.mailbox_mutex);
+        client.messages.push_back(std::move(message));
+        waiters.swap(client.waiters);
+    }
+
+    for (const MailboxWaiter& waiter : waiters) {
+        waiter.worker->wake(waiter.connection_id);
+    }
+    return message_id;
+}
+
+bool ClientRegistry::take_messages(ClientRecord& client, std::vector<StoredMessage>& out, const MailboxWaiter* waiter)
+{
+    std::lock_guard<std::mutex> lock(client.mailbox_mutex);
+
+    if (client.messages.empty() && waiter != nullptr) {
+        // A connection woken for messages another one took waits again
+        auto it = std::find_if(client.waiters.begin(), client.waiters.end(), [&](const MailboxWaiter& other) {
+            return other.worker == waiter->worker && other.connection_id == waiter->connection_id;
+        });
+        if (it == client.waiters.end()) {
+            client.waiters.push_back(*waiter);
+        }
+        return false;
+    }
+
+    if (out.empty()) {
+        out.swap(client.messages);
+    }
+    else {
+        std::move(client.messages.begin(), client.messages.end(), std::back_inserter(out));
+        client.messages.clear();
+    }
+    return true;
+}
+
+void ClientRegistry::remove_waiter(ClientRecord& client, const MailboxWaiter& waiter)
+{
+    std::lock_guard<std::mutex> lock(client.mailbox_mutex);
+
+    auto it = std::find_if(client.waiters.begin(), client.waiters.end(), [&](const MailboxWaiter& other) {
+        return other.worker == waiter.worker && other.connection_id == waiter.connection_id;
+    });
+    if (it != client.waiters.end()) {
+        client.waiters.erase(it);
+    }
+}
+
+size_t ClientRegistry::get_client_count() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return records.size();
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../ProtocolCodec.h"
+
+class ServerWorker;
+
+// Client id usable as a hash table key
+struct ClientId
+{
+	uint8_t bytes[CLIENT_ID_LENGTH];
+
+	bool operator==(const ClientId& other) const;
+};
+
+// Ids are random, so any 8 of their bytes make a good hash
+struct ClientIdHash
+{
+	size_t operator()(const ClientId& id) const;
+};
+
+// Connection parked in a long poll, woken through its worker when a message is queued
+struct MailboxWaiter
+{
+	ServerWorker* worker;
+	uint64_t connection_id;
+};
+
+// Waiting message - a WaitingMessageResponseHeader followed by the content, sent as is
+typedef std::vector<uint8_t> StoredMessage;
+
+// A registered client. Only the mailbox changes after registration
+struct ClientRecord
+{
+	ClientId id;
+	uint8_t public_key[PUBLIC_KEY_LENGTH];
+
+	std::mutex mailbox_mutex;
+	std::vector<StoredMessage> messages;
+	std::vector<MailboxWaiter> waiters;
+};
+
+// Registered clients and their mailboxes, shared by all the worker threads.
+// Clients are indexed by id and by name, and the directory keeps their list entries
+// serialized in registration order - a full list or a delta is a single copy.
+// Clients are never removed, so a found record stays valid
+class ClientRegistry
+{
+	mutable std::shared_mutex mutex;
+	std::unordered_map<ClientId, ClientRecord*, ClientIdHash> clients;
+	std::unordered_set<std::string> names;
+	std::vector<std::unique_ptr<ClientRecord>> records;
+
+	// ClientListEntry of each client - the one of directory version v is at index v - 1
+	std::vector<uint8_t> directory;
+
+	// Identifies this run of the server's directory - clients holding another id get the full list
+	const uint64_t directory_id;
+
+	ClientRegistry(const ClientRegistry&) = delete;
+	ClientRegistry& operator=(const ClientRegistry&) = delete;
+
+public:
+	ClientRegistry();
+
+	// Register a new client with a random id, returns nullptr if the name is taken
+	ClientRecord* register_client(const std::string& name, const uint8_t* public_key);
+
+	// Returns nullptr if there is no such client
+	ClientRecord* find(const uint8_t* client_id) const;
+
+	uint64_t get_directory_id() const;
+
+	// Append the entries of the clients added after cursor (0 for all of them), returns the current cursor
+	uint64_t copy_directory(uint64_t cursor, std::vector<uint8_t>& out) const;
+
+	// Queue a message for the client and wake its long polls, returns the message id
+	uint32_t queue_message(ClientRecord& client, const uint8_t* sender_id, ClientMessageType type, const uint8_t* content, uint32_t content_size);
+
+	// Move the waiting messages of the client to out. If there are none and a waiter is given,
+	// it is registered to be woken by the next message and false is returned
+	bool take_messages(ClientRecord& client, std::vector<StoredMessage>& out, const MailboxWaiter* waiter = nullptr);
+
+	// The waiter stopped waiting
+	void remove_waiter(ClientRecord& client, const MailboxWaiter& waiter);
+
+	size_t get_client_count() const;
+};
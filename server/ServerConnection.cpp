@@ -0,0 +1,575 @@
+#include "ServerConnection.h"
+#include "ServerWorker.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace
+{
+    bool is_request_code(ServerRequestCodes code)
+    {
+        switch (code)
+        {
+        case ServerRequestCodes::REGISTRATION_CLIENT_REQUEST:
+        case ServerRequestCodes::CLIENT_LIST_REQUEST:
+        case ServerRequestCodes::PUBLIC_KEY_REQUEST:
+        case ServerRequestCodes::SEND_MESSAGE_TO_CLIENT:
+        case ServerRequestCodes::WAITING_MESSAGES_REQUEST:
+        case ServerRequestCodes::CLIENT_LIST_DELTA_REQUEST:
+        case ServerRequestCodes::SEND_MESSAGES_BATCH:
+        case ServerRequestCodes::WAITING_MESSAGES_LONG_POLL:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool check_payload_size(size_t payload_size, size_t expected_size)
+    {
+        if (payload_size != expected_size) {
+            std::cerr << "Error: Incorrect payload size, Got " << payload_size << " and expected " << expected_size << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+ServerConnection::ServerConnection(ServerWorker& worker, uint64_t id, int connection_socket) :
+    worker(worker), registry(worker.get_registry()), id(id), connection_socket(connection_socket)
+{
+}
+
+ServerConnection::~ServerConnection()
+{
+    if (connection_socket >= 0) {
+        ::close(connection_socket);
+    }
+}
+
+bool ServerConnection::start()
+{
+    registered_events = EPOLLIN | EPOLLRDHUP;
+    if (!worker.get_loop().add(connection_socket, registered_events, this)) {
+        std::cerr << "Failed to register connection: " << strerror(errno) << std::endl;
+        ::close(connection_socket);
+        connection_socket = -1;
+        closed = true;
+        return false;
+    }
+    return true;
+}
+
+void ServerConnection::on_events(uint32_t events)
+{
+    if (closed) return;
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        close();
+        return;
+    }
+
+    if ((events & EPOLLRDHUP) && long_poll_client != nullptr) {
+        // The client left while its poll was held - answer it now, without taking its messages, so the
+        // connection is closed as soon as the answer is written instead of when the poll times out
+        peer_closed = true;
+        std::vector<StoredMessage> no_messages;
+        finish_long_poll(no_messages);
+        return;
+    }
+
+    bool succeeded = true;
+    if (events & (EPOLLIN | EPOLLRDHUP)) {
+        succeeded = receive();
+    }
+    if (succeeded && (events & EPOLLOUT)) {
+        succeeded = flush();
+    }
+    if (!succeeded) {
+        close();
+        return;
+    }
+    update();
+}
+
+bool ServerConnection::receive()
+{
+    uint8_t* buffer = worker.get_receive_buffer();
+
+    for (int reads = 0; reads < MAX_READS_PER_EVENT; reads++) {
+        if (peer_closed || long_poll_client != nullptr || pending_output >= MAX_PENDING_OUTPUT) break;
+
+        ssize_t received = recv(connection_socket, buffer, ServerWorker::RECEIVE_BUFFER_SIZE, 0);
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        if (received == 0) {
+            // The client sent its last request (or just left) - a partial request will never complete
+            peer_closed = true;
+            std::vector<uint8_t>().swap(input);
+            break;
+        }
+
+        // Most requests arrive whole - serve them from the shared buffer and keep only what is left
+        if (input.empty()) {
+            size_t consumed = 0;
+            if (!serve_requests(buffer, received, consumed)) return false;
+            input.assign(buffer + consumed, buffer + received);
+        }
+        else {
+            input.insert(input.end(), buffer, buffer + received);
+            if (!serve_pending_input()) return false;
+        }
+
+        if (static_cast<size_t>(received) < ServerWorker::RECEIVE_BUFFER_SIZE) break;
+    }
+
+    return flush();
+}
+
+bool ServerConnection::serve_requests(const uint8_t* data, size_t size, size_t& consumed)
+{
+    consumed = 0;
+
+    while (long_poll_client == nullptr) {
+        size_t available = size - consumed;
+        if (available < ProtocolCodec::ServerRequestHeaderView::SIZE) break;
+
+        ProtocolCodec::ServerRequestHeaderView header(data + consumed);
+        if (!is_request_code(header.code())) {
+            std::cerr << "Unsupported request from client " << static_cast<uint16_t>(header.code()) << std::endl;
+            return false;
+        }
+
+        // Pipelined requests are followed by their id
+        pipelined = header.version() >= PIPELINED_PROTOCOL_VERSION;
+        size_t header_size = pipelined ? ProtocolCodec::PipelinedRequestHeaderView::SIZE : ProtocolCodec::ServerRequestHeaderView::SIZE;
+        uint32_t payload_size = header.payload_size();
+        if (available < header_size || available - header_size < payload_size) break;
+
+        request_id = pipelined ? ProtocolCodec::PipelinedRequestHeaderView(data + consumed).request_id() : 0;
+
+        if (!handle_request(header, data + consumed + header_size, payload_size)) return false;
+        consumed += header_size + payload_size;
+    }
+    return true;
+}
+
+bool ServerConnection::serve_pending_input()
+{
+    if (input.empty()) return true;
+
+    size_t consumed = 0;
+    if (!serve_requests(input.data(), input.size(), consumed)) return false;
+    input.erase(input.begin(), input.begin() + consumed);
+
+    // Don't hold on to the buffer of a large request
+    if (input.empty() && input.capacity() > ServerWorker::RECEIVE_BUFFER_SIZE) {
+        std::vector<uint8_t>().swap(input);
+    }
+    return true;
+}
+
+bool ServerConnection::handle_request(const ProtocolCodec::ServerRequestHeaderView& header, const uint8_t* payload, size_t payload_size)
+{
+    if (header.code() == ServerRequestCodes::REGISTRATION_CLIENT_REQUEST) {
+        return handle_registration(payload, payload_size);
+    }
+
+    // Cannot serve unregistered client - its payload is skipped, so the session stays in sync
+    ClientRecord* client = registry.find(header.client_id());
+    if (client == nullptr) {
+        queue_response(ServerResponseCodes::GENERAL_FAILURE);
+        return true;
+    }
+
+    switch (header.code())
+    {
+    case ServerRequestCodes::CLIENT_LIST_REQUEST:
+        handle_client_list();
+        return true;
+
+    case ServerRequestCodes::CLIENT_LIST_DELTA_REQUEST:
+        return handle_client_list_delta(payload, payload_size);
+
+    case ServerRequestCodes::PUBLIC_KEY_REQUEST:
+        return handle_public_key(payload, payload_size);
+
+    case ServerRequestCodes::SEND_MESSAGE_TO_CLIENT:
+        return handle_send_message(header.client_id(), payload, payload_size);
+
+    case ServerRequestCodes::SEND_MESSAGES_BATCH:
+        return handle_messages_batch(header.client_id(), payload, payload_size);
+
+    case ServerRequestCodes::WAITING_MESSAGES_REQUEST:
+        handle_waiting_messages(*client, 0);
+        return true;
+
+    case ServerRequestCodes::WAITING_MESSAGES_LONG_POLL:
+    {
+        if (!check_payload_size(payload_size, ProtocolCodec::WaitingMessagesLongPollPayloadView::SIZE)) return false;
+
+        handle_waiting_messages(*client, ProtocolCodec::WaitingMessagesLongPollPayloadView(payload).timeout_ms());
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+bool ServerConnection::handle_registration(const uint8_t* payload, size_t payload_size)
+{
+    if (!check_payload_size(payload_size, ProtocolCodec::RegistrationPayloadView::SIZE)) return false;
+
+    ProtocolCodec::RegistrationPayloadView registration(payload);
+    ClientRecord* client = registry.register_client(std::string(registration.name()), registration.public_key());
+    if (client == nullptr) {
+        // Name already taken
+        queue_response(ServerResponseCodes::GENERAL_FAILURE);
+        return true;
+    }
+
+    queue_response(ServerResponseCodes::REGISTRATION_SUCCESS, client->id.bytes, CLIENT_ID_LENGTH);
+    return true;
+}
+
+void ServerConnection::handle_client_list()
+{
+    std::vector<uint8_t> response = start_response(ServerResponseCodes::CLIENT_LIST_RESPONSE);
+    size_t header_size = response.size();
+
+    registry.copy_directory(0, response);
+    finish_response(response, response.size() - header_size);
+}
+
+bool ServerConnection::handle_client_list_delta(const uint8_t* payload, size_t payload_size)
+{
+    if (!check_payload_size(payload_size, ProtocolCodec::ClientListDeltaRequestPayloadView::SIZE)) return false;
+
+    ProtocolCodec::ClientListDeltaRequestPayloadView request(payload);
+
+    // Unknown directory - start the client over
+    uint64_t directory_id = registry.get_directory_id();
+    bool full_list = request.directory_id() != directory_id;
+
+    std::vector<uint8_t> response = start_response(ServerResponseCodes::CLIENT_LIST_DELTA_RESPONSE);
+    size_t header_size = response.size();
+    ProtocolCodec::append<ProtocolCodec::ClientListDeltaResponseHeaderWriter>(response);
+
+    uint64_t cursor = registry.copy_directory(full_list ? 0 : request.cursor(), response);
+    ProtocolCodec::ClientListDeltaResponseHeaderWriter delta(response.data() + header_size);
+    delta.set_directory_id(directory_id);
+    delta.set_cursor(cursor);
+    delta.set_full_list(full_list);
+    finish_response(response, response.size() - header_size);
+    return true;
+}
+
+bool ServerConnection::handle_public_key(const uint8_t* payload, size_t payload_size)
+{
+    if (!check_payload_size(payload_size, ProtocolCodec::RetrieveClientPublicKeyPayloadView::SIZE)) return false;
+
+    ClientRecord* client = registry.find(ProtocolCodec::RetrieveClientPublicKeyPayloadView(payload).client_id());
+    if (client == nullptr) {
+        queue_response(ServerResponseCodes::GENERAL_FAILURE);
+        return true;
+    }
+
+    std::vector<uint8_t> response = start_response(ServerResponseCodes::PUBLIC_KEY_RESPONSE);
+    response.insert(response.end(), client->id.bytes, client->id.bytes + CLIENT_ID_LENGTH);
+    response.insert(response.end(), client->public_key, client->public_key + PUBLIC_KEY_LENGTH);
+    finish_response(response, CLIENT_ID_LENGTH + PUBLIC_KEY_LENGTH);
+    return true;
+}
+
+bool ServerConnection::handle_send_message(const uint8_t* sender_id, const uint8_t* payload, size_t payload_size)
+{
+    ProtocolCodec::Reader reader(payload, payload_size);
+    ProtocolCodec::SendMessageToClientPayloadHeaderView message;
+    if (!reader.read(message)) {
+        std::cerr << "Error: Payload header is too small, Got " << payload_size << " and expected header is " << message.SIZE << std::endl;
+        return false;
+    }
+
+    // The content is the rest of the payload
+    uint32_t content_size = message.content_size();
+    if (content_size != reader.remaining()) {
+        std::cerr << "Error: Message content size " << content_size << " does not match payload size " << payload_size << std::endl;
+        return false;
+    }
+
+    ClientRecord* destination = registry.find(message.client_id());
+    if (destination == nullptr) {
+        queue_response(ServerResponseCodes::GENERAL_FAILURE);
+        return true;
+    }
+
+    uint32_t message_id = registry.queue_message(*destination, sender_id, message.message_type(), reader.position(), content_size);
+
+    // Destination client id and the message id
+    uint8_t sent[CLIENT_ID_LENGTH + sizeof(message_id)];
+    memcpy(sent, message.client_id(), CLIENT_ID_LENGTH);
+    ProtocolCodec::store(sent + CLIENT_ID_LENGTH, message_id);
+    queue_response(ServerResponseCodes::MESSAGE_TO_CLIENT_SENT_TO_SERVER, sent, sizeof(sent));
+    return true;
+}
+
+bool ServerConnection::handle_messages_batch(const uint8_t* sender_id, const uint8_t* payload, size_t payload_size)
+{
+    ProtocolCodec::Reader reader(payload, payload_size);
+    ProtocolCodec::SendMessagesBatchPayloadHeaderView batch;
+    if (!reader.read(batch)) {
+        std::cerr << "Error: Payload header is too small, Got " << payload_size << " and expected header is " << batch.SIZE << std::endl;
+        return false;
+    }
+    uint32_t message_count = batch.message_count();
+
+    // Check the whole batch first - a truncated batch queues nothing
+    ProtocolCodec::SendMessageToClientPayloadHeaderView message;
+    const uint8_t* content = nullptr;
+    for (uint32_t i = 0; i < message_count; i++) {
+        if (!reader.read(message) || !reader.read_bytes(message.content_size(), content)) {
+            std::cerr << "Error: Batch is truncated" << std::endl;
+            return false;
+        }
+    }
+
+    // Queue each message - a missing destination fails only its own record
+    std::vector<uint8_t> response = start_response(ServerResponseCodes::MESSAGES_BATCH_SENT_TO_SERVER);
+    size_t header_size = response.size();
+    response.reserve(header_size + static_cast<size_t>(message_count) * ProtocolCodec::BatchMessageResultWriter::SIZE);
+
+    ProtocolCodec::Reader records(payload + batch.SIZE, payload_size - batch.SIZE);
+    for (uint32_t i = 0; i < message_count; i++) {
+        records.read(message);
+        records.read_bytes(message.content_size(), content);
+
+        ProtocolCodec::BatchMessageResultWriter result = ProtocolCodec::append<ProtocolCodec::BatchMessageResultWriter>(response);
+        result.set_client_id(message.client_id());
+        result.set_status(BatchMessageStatus::DESTINATION_NOT_FOUND);
+
+        ClientRecord* destination = registry.find(message.client_id());
+        if (destination != nullptr) {
+            result.set_message_id(registry.queue_message(*destination, sender_id, message.message_type(), content, message.content_size()));
+            result.set_status(BatchMessageStatus::QUEUED);
+        }
+    }
+
+    finish_response(response, response.size() - header_size);
+    return true;
+}
+
+void ServerConnection::handle_waiting_messages(ClientRecord& client, uint32_t timeout_ms)
+{
+    std::vector<StoredMessage> messages;
+
+    if (timeout_ms > 0) {
+        MailboxWaiter waiter{ &worker, id };
+        if (!registry.take_messages(client, messages, &waiter)) {
+            // Long poll - hold the request until there is something to deliver
+            long_poll_client = &client;
+            long_poll_deadline = ServerWorker::now_ms() + std::min(timeout_ms, MAX_LONG_POLL_TIMEOUT_MS);
+            long_poll_pipelined = pipelined;
+            long_poll_request_id = request_id;
+            worker.add_timer(long_poll_deadline, id);
+            return;
+        }
+    }
+    else {
+        registry.take_messages(client, messages);
+    }
+
+    queue_waiting_messages(messages);
+}
+
+void ServerConnection::on_messages_waiting()
+{
+    if (closed || long_poll_client == nullptr) return;
+
+    // Another connection of the client may have taken the messages first - then keep waiting
+    std::vector<StoredMessage> messages;
+    MailboxWaiter waiter{ &worker, id };
+    if (!registry.take_messages(*long_poll_client, messages, &waiter)) return;
+
+    finish_long_poll(messages);
+}
+
+void ServerConnection::on_timer(uint64_t deadline_ms)
+{
+    if (closed || long_poll_client == nullptr || deadline_ms != long_poll_deadline) return;
+
+    registry.remove_waiter(*long_poll_client, { &worker, id });
+
+    std::vector<StoredMessage> messages;
+    registry.take_messages(*long_poll_client, messages);
+    finish_long_poll(messages);
+}
+
+void ServerConnection::finish_long_poll(std::vector<StoredMessage>& messages)
+{
+    worker.cancel_timer(long_poll_deadline, id);
+    long_poll_client = nullptr;
+
+    pipelined = long_poll_pipelined;
+    request_id = long_poll_request_id;
+    queue_waiting_messages(messages);
+
+    if (!serve_pending_input() || !flush()) {
+        close();
+        return;
+    }
+    update();
+}
+
+std::vector<uint8_t> ServerConnection::start_response(ServerResponseCodes code) const
+{
+    // Pipelined responses are the same header followed by the request id
+    std::vector<uint8_t> response(pipelined ? ProtocolCodec::PipelinedResponseHeaderWriter::SIZE : ProtocolCodec::ServerResponseHeaderWriter::SIZE);
+    ProtocolCodec::ServerResponseHeaderWriter header(response.data());
+    header.set_version(pipelined ? PIPELINED_PROTOCOL_VERSION : SERVER_VERSION);
+    header.set_code(code);
+    if (pipelined) {
+        ProtocolCodec::PipelinedResponseHeaderWriter(response.data()).set_request_id(request_id);
+    }
+    return response;
+}
+
+void ServerConnection::finish_response(std::vector<uint8_t>& response, size_t payload_size)
+{
+    ProtocolCodec::ServerResponseHeaderWriter(response.data()).set_payload_size(static_cast<uint32_t>(payload_size));
+    queue_output(std::move(response));
+}
+
+void ServerConnection::queue_response(ServerResponseCodes code, const void* payload, size_t payload_size)
+{
+    std::vector<uint8_t> response = start_response(code);
+    if (payload_size > 0) {
+        const uint8_t* payload_bytes = static_cast<const uint8_t*>(payload);
+        response.insert(response.end(), payload_bytes, payload_bytes + payload_size);
+    }
+    finish_response(response, payload_size);
+}
+
+void ServerConnection::queue_waiting_messages(std::vector<StoredMessage>& messages)
+{
+    size_t payload_size = 0;
+    for (const StoredMessage& message : messages) {
+        payload_size += message.size();
+    }
+
+    std::vector<uint8_t> response = start_response(ServerResponseCodes::WAITING_MESSAGES_RESPONSE);
+    finish_response(response, payload_size);
+    for (StoredMessage& message : messages) {
+        queue_output(std::move(message));
+    }
+    messages.clear();
+}
+
+void ServerConnection::queue_output(std::vector<uint8_t>&& buffer)
+{
+    if (buffer.empty()) return;
+
+    pending_output += buffer.size();
+    output.push_back(std::move(buffer));
+}
+
+bool ServerConnection::flush()
+{
+    while (pending_output > 0) {
+        // Gather the queued responses into one send
+        struct iovec buffers[MAX_SEND_BUFFERS];
+        size_t buffer_count = 0;
+        for (auto it = output.begin(); it != output.end() && buffer_count < MAX_SEND_BUFFERS; ++it) {
+            size_t skip = buffer_count == 0 ? output_offset : 0;
+            buffers[buffer_count].iov_base = it->data() + skip;
+            buffers[buffer_count].iov_len = it->size() - skip;
+            buffer_count++;
+        }
+
+        struct msghdr message{};
+        message.msg_iov = buffers;
+        message.msg_iovlen = buffer_count;
+
+        ssize_t sent = sendmsg(connection_socket, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            return false;
+        }
+
+        // Drop the buffers that went out whole
+        pending_output -= sent;
+        size_t remaining = sent;
+        while (remaining > 0) {
+            size_t left = output.front().size() - output_offset;
+            if (remaining < left) {
+                output_offset += remaining;
+                break;
+            }
+            remaining -= left;
+            output.pop_front();
+            output_offset = 0;
+        }
+    }
+    return true;
+}
+
+void ServerConnection::update()
+{
+    if (closed) return;
+
+    // Every request of the client is answered
+    if (peer_closed && long_poll_client == nullptr && pending_output == 0) {
+        close();
+        return;
+    }
+
+    uint32_t events = 0;
+    if (!peer_closed && long_poll_client == nullptr && pending_output < MAX_PENDING_OUTPUT) {
+        events |= EPOLLIN | EPOLLRDHUP;
+    }
+    else if (!peer_closed && long_poll_client != nullptr) {
+        // Reading waits for the poll to be answered, but a client leaving is noticed meanwhile
+        events |= EPOLLRDHUP;
+    }
+    if (pending_output > 0) {
+        events |= EPOLLOUT;
+    }
+
+    if (events != registered_events) {
+        if (!worker.get_loop().modify(connection_socket, events, this)) {
+            close();
+            return;
+        }
+        registered_events = events;
+    }
+}
+
+void ServerConnection::close()
+{
+    if (closed) return;
+    closed = true;
+
+    if (long_poll_client != nullptr) {
+        registry.remove_waiter(*long_poll_client, { &worker, id });
+        worker.cancel_timer(long_poll_deadline, id);
+        long_poll_client = nullptr;
+    }
+
+    worker.get_loop().remove(connection_socket);
+    ::close(connection_socket);
+    connection_socket = -1;
+
+    // Deleted by the worker once the events being dispatched are done
+    worker.remove_connection(id);
+}
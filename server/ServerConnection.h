@@ -0,0 +1,123 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "../EpollLoop.h"
+#include "../ProtocolHeaders.h"
+#include "ClientRegistry.h"
+
+class ServerWorker;
+
+// A client connection of a worker. Requests are parsed straight from the worker's receive buffer,
+// only a request split between reads is kept, and responses are queued as buffers that go out in
+// vectored sends - waiting messages are sent from the mailbox buffers without copying them.
+// Requests are served in order: a long poll holds back the requests behind it, like server.py does
+class ServerConnection : public EpollHandler
+{
+	static constexpr uint8_t SERVER_VERSION = 1;
+
+	// Longest a long poll is held, whatever the client asked for
+	static constexpr uint32_t MAX_LONG_POLL_TIMEOUT_MS = 60000;
+
+	// Stop reading requests while this many response bytes wait for a slow client
+	static constexpr size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+
+	// Reads of one readiness event, so a busy connection doesn't hold up the others
+	static constexpr int MAX_READS_PER_EVENT = 16;
+
+	// Buffers gathered by one send
+	static constexpr size_t MAX_SEND_BUFFERS = 256;
+
+	ServerWorker& worker;
+	ClientRegistry& registry;
+	const uint64_t id;
+	int connection_socket;
+	uint32_t registered_events = 0;
+	bool closed = false;
+
+	// The client shut down its side - close once its requests are answered
+	bool peer_closed = false;
+
+	// Start of a request that is not complete yet
+	std::vector<uint8_t> input;
+
+	// Responses to send - output_offset bytes of the first buffer are sent already
+	std::deque<std::vector<uint8_t>> output;
+	size_t output_offset = 0;
+	size_t pending_output = 0;
+
+	// Request being served - version 3 responses carry its id
+	bool pipelined = false;
+	uint32_t request_id = 0;
+
+	// Long poll being held, and the request it answers
+	ClientRecord* long_poll_client = nullptr;
+	uint64_t long_poll_deadline = 0;
+	bool long_poll_pipelined = false;
+	uint32_t long_poll_request_id = 0;
+
+	ServerConnection(const ServerConnection&) = delete;
+	ServerConnection& operator=(const ServerConnection&) = delete;
+
+	// Read what arrived and serve the complete requests, false if the connection has to be closed
+	bool receive();
+
+	// Serve the complete requests at the start of data, consumed is set to their size
+	bool serve_requests(const uint8_t* data, size_t size, size_t& consumed);
+
+	// Serve the requests held back by a long poll
+	bool serve_pending_input();
+
+	// Serve one request, false on a protocol error
+	bool handle_request(const ProtocolCodec::ServerRequestHeaderView& header, const uint8_t* payload, size_t payload_size);
+
+	bool handle_registration(const uint8_t* payload, size_t payload_size);
+	void handle_client_list();
+	bool handle_client_list_delta(const uint8_t* payload, size_t payload_size);
+	bool handle_public_key(const uint8_t* payload, size_t payload_size);
+	bool handle_send_message(const uint8_t* sender_id, const uint8_t* payload, size_t payload_size);
+	bool handle_messages_batch(const uint8_t* sender_id, const uint8_t* payload, size_t payload_size);
+	void handle_waiting_messages(ClientRecord& client, uint32_t timeout_ms);
+
+	// Answer the long poll with whatever is waiting, and serve the requests behind it
+	void finish_long_poll(std::vector<StoredMessage>& messages);
+
+	// Response buffer holding the header of the current request's response - the payload is appended to it
+	std::vector<uint8_t> start_response(ServerResponseCodes code) const;
+
+	// Set the payload size in the header and queue the response
+	void finish_response(std::vector<uint8_t>& response, size_t payload_size);
+
+	// Queue a response with its payload
+	void queue_response(ServerResponseCodes code, const void* payload = nullptr, size_t payload_size = 0);
+
+	// Queue a WAITING_MESSAGES_RESPONSE - the messages are moved to the output as they are
+	void queue_waiting_messages(std::vector<StoredMessage>& messages);
+
+	void queue_output(std::vector<uint8_t>&& buffer);
+
+	// Send as much of the output as the socket takes, false on error
+	bool flush();
+
+	// Close if done, or update the events of the socket to what the connection waits for
+	void update();
+
+	void close();
+
+public:
+	ServerConnection(ServerWorker& worker, uint64_t id, int connection_socket);
+	~ServerConnection() override;
+
+	// Register the socket with the worker's loop, closes it on failure
+	bool start();
+
+	void on_events(uint32_t events) override;
+
+	// A message was queued for the client of the long poll
+	void on_messages_waiting();
+
+	// A timer of the connection is due
+	void on_timer(uint64_t deadline_ms);
+};
@@ -0,0 +1,124 @@
+// Native MessageU server. Speaks the protocol of server.py, built on the same ProtocolHeaders.h
+// as the client: sessions, pipelined version 3 requests, client list deltas, batches and long polls.
+//
+// A worker thread per core runs its own epoll loop and accepts on its own SO_REUSEPORT socket.
+// Clients and their mailboxes live in hash tables shared by the workers, and waiting messages
+// are kept ready to send, so an inbox response is one vectored send.
+// The port is read from port.info in the working directory, like server.py does.
+//
+// Usage: MessageUServer [--threads N] [--host address]
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "../Util.h"
+#include "ClientRegistry.h"
+#include "ServerWorker.h"
+
+namespace
+{
+    const char* const PORT_INFO_PATH = "port.info";
+
+    struct Options
+    {
+        size_t threads = 0;
+        std::string host = "127.0.0.1";
+    };
+
+    bool parse_options(int argc, char* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; i++) {
+            std::string option = argv[i];
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value of " << option << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+
+            if (option == "--threads") {
+                options.threads = std::strtoul(value.c_str(), NULL, 10);
+            }
+            else if (option == "--host") {
+                options.host = value;
+            }
+            else {
+                std::cerr << "Unknown option " << option << std::endl;
+                return false;
+            }
+        }
+
+        if (options.threads == 0) {
+            options.threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return true;
+    }
+
+    bool read_port(uint16_t& port)
+    {
+        std::string port_str;
+        if (!Util::read_file(PORT_INFO_PATH, port_str)) {
+            std::cerr << "Error: Unable to parse server port" << std::endl;
+            return false;
+        }
+
+        char* end = NULL;
+        unsigned long value = std::strtoul(port_str.c_str(), &end, 10);
+        if (end == port_str.c_str() || value == 0 || value > 65535) {
+            std::cerr << "Error: Unable to parse server port" << std::endl;
+            return false;
+        }
+        port = static_cast<uint16_t>(value);
+        return true;
+    }
+
+    // Every connection is a file descriptor - take as many as the hard limit allows
+    void raise_file_limit()
+    {
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == limit.rlim_max) return;
+
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+            std::cerr << "setrlimit failed with error: " << strerror(errno) << std::endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--threads N] [--host address]" << std::endl;
+        return 1;
+    }
+
+    uint16_t port;
+    if (!read_port(port)) return 1;
+
+    raise_file_limit();
+
+    ClientRegistry registry;
+    std::vector<std::unique_ptr<ServerWorker>> workers;
+    for (size_t i = 0; i < options.threads; i++) {
+        workers.push_back(std::make_unique<ServerWorker>(registry));
+        if (!workers.back()->listen(options.host, port)) return 1;
+    }
+
+    std::cout << "Server starting on port " << port << " with " << options.threads << " threads ..." << std::endl;
+
+    for (std::unique_ptr<ServerWorker>& worker : workers) {
+        worker->start();
+    }
+    for (std::unique_ptr<ServerWorker>& worker : workers) {
+        worker->join();
+    }
+    return 0;
+}
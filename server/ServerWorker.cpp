@@ -0,0 +1,247 @@
+#include "ServerWorker.h"
+#include "ServerConnection.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+ServerWorker::WakeHandler::WakeHandler(ServerWorker& worker) : worker(worker)
+{
+}
+
+void ServerWorker::WakeHandler::on_events(uint32_t /*events*/)
+{
+    worker.handle_wakeups();
+}
+
+ServerWorker::ServerWorker(ClientRegistry& registry) : registry(registry), receive_buffer(RECEIVE_BUFFER_SIZE)
+{
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        std::cerr << "eventfd failed with error: " << strerror(errno) << std::endl;
+        return;
+    }
+    loop.add(wake_fd, EPOLLIN, &wake_handler);
+}
+
+ServerWorker::~ServerWorker()
+{
+    if (thread.joinable()) {
+        thread.join();
+    }
+    connections.clear();
+    if (listen_socket >= 0) {
+        close(listen_socket);
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+    }
+}
+
+bool ServerWorker::listen(const std::string& host, uint16_t port)
+{
+    struct addrinfo hints{};
+    struct addrinfo* result = NULL;
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+
+    std::string port_str = std::to_string(port);
+    int iResult = getaddrinfo(host.c_str(), port_str.c_str(), &hints, &result);
+    if (iResult != 0) {
+        std::cerr << "getaddrinfo failed with error: " << gai_strerror(iResult) << std::endl;
+        return false;
+    }
+
+    listen_socket = socket(result->ai_family, result->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, result->ai_protocol);
+    if (listen_socket < 0) {
+        std::cerr << "socket failed with error: " << strerror(errno) << std::endl;
+        freeaddrinfo(result);
+        return false;
+    }
+
+    int enable = 1;
+    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+        std::cerr << "setsockopt SO_REUSEPORT failed with error: " << strerror(errno) << std::endl;
+        freeaddrinfo(result);
+        return false;
+    }
+
+    iResult = bind(listen_socket, result->ai_addr, result->ai_addrlen);
+    freeaddrinfo(result);
+    if (iResult != 0) {
+        std::cerr << "bind failed with error: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (::listen(listen_socket, SOMAXCONN) != 0) {
+        std::cerr << "listen failed with error: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    return loop.add(listen_socket, EPOLLIN, this);
+}
+
+void ServerWorker::start()
+{
+    thread = std::thread(&ServerWorker::run, this);
+}
+
+void ServerWorker::join()
+{
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void ServerWorker::run()
+{
+    while (true) {
+        if (loop.run_once(get_timeout_ms()) < 0) break;
+        closed_connections.clear();
+
+        expire_timers();
+        closed_connections.clear();
+    }
+}
+
+void ServerWorker::on_events(uint32_t /*events*/)
+{
+    while (true) {
+        int connection_socket = accept4(listen_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connection_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+            std::cerr << "accept failed with error: " << strerror(errno) << std::endl;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // The backlog keeps the connections until descriptors are freed
+                loop.modify(listen_socket, 0, this);
+                add_timer(now_ms() + ACCEPT_RETRY_MS, ACCEPT_TIMER_ID);
+            }
+            break;
+        }
+
+        // Responses are written whole - don't hold back their last segment
+        int enable = 1;
+        setsockopt(connection_socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        uint64_t connection_id = next_connection_id++;
+        std::unique_ptr<ServerConnection> connection = std::make_unique<ServerConnection>(*this, connection_id, connection_socket);
+        if (!connection->start()) continue;
+        connections.emplace(connection_id, std::move(connection));
+    }
+}
+
+void ServerWorker::handle_wakeups()
+{
+    uint64_t value;
+    while (read(wake_fd, &value, sizeof(value)) < 0 && errno == EINTR) {}
+
+    std::vector<uint64_t> connection_ids;
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        connection_ids.swap(wakeups);
+    }
+
+    for (uint64_t connection_id : connection_ids) {
+        auto it = connections.find(connection_id);
+        if (it != connections.end()) {
+            it->second->on_messages_waiting();
+        }
+    }
+}
+
+void ServerWorker::wake(uint64_t connection_id)
+{
+    bool signal;
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wakeups.push_back(connection_id);
+        signal = wakeups.size() == 1;
+    }
+
+    // A non-empty list was signalled already
+    if (signal) {
+        uint64_t value = 1;
+        while (write(wake_fd, &value, sizeof(value)) < 0 && errno == EINTR) {}
+    }
+}
+
+int ServerWorker::get_timeout_ms() const
+{
+    if (timers.empty()) return -1;
+
+    uint64_t now = now_ms();
+    uint64_t deadline = timers.begin()->first;
+    return deadline <= now ? 0 : static_cast<int>(deadline - now);
+}
+
+void ServerWorker::expire_timers()
+{
+    uint64_t now = now_ms();
+    while (!timers.empty() && timers.begin()->first <= now) {
+        std::pair<uint64_t, uint64_t> timer = *timers.begin();
+        timers.erase(timers.begin());
+
+        if (timer.second == ACCEPT_TIMER_ID) {
+            loop.modify(listen_socket, EPOLLIN, this);
+            continue;
+        }
+
+        auto it = connections.find(timer.second);
+        if (it != connections.end()) {
+            it->second->on_timer(timer.first);
+        }
+    }
+}
+
+ClientRegistry& ServerWorker::get_registry()
+{
+    return registry;
+}
+
+EpollLoop& ServerWorker::get_loop()
+{
+    return loop;
+}
+
+uint8_t* ServerWorker::get_receive_buffer()
+{
+    return receive_buffer.data();
+}
+
+void ServerWorker::add_timer(uint64_t deadline_ms, uint64_t connection_id)
+{
+    timers.emplace(deadline_ms, connection_id);
+}
+
+void ServerWorker::cancel_timer(uint64_t deadline_ms, uint64_t connection_id)
+{
+    timers.erase({ deadline_ms, connection_id });
+}
+
+void ServerWorker::remove_connection(uint64_t connection_id)
+{
+    auto it = connections.find(connection_id);
+    if (it == connections.end()) return;
+
+    closed_connections.push_back(std::move(it->second));
+    connections.erase(it);
+}
+
+uint64_t ServerWorker::now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../EpollLoop.h"
+#include "ClientRegistry.h"
+
+class ServerConnection;
+
+// One thread of the server, with its own listening socket, epoll loop, connections and timers.
+// Every worker binds the server port with SO_REUSEPORT, so the kernel spreads new connections
+// over the workers and a connection is served by one thread for its whole life
+class ServerWorker : private EpollHandler
+{
+public:
+	// Bytes read from a socket at once - the buffer is shared by the connections of the worker
+	static constexpr size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+private:
+	// Time to stop accepting when out of file descriptors, instead of spinning on the listening socket
+	static constexpr uint64_t ACCEPT_RETRY_MS = 100;
+
+	// Timer id that resumes accepting - connection ids start at 1
+	static constexpr uint64_t ACCEPT_TIMER_ID = 0;
+
+	// Signalled by other threads to wake long polls of this worker
+	class WakeHandler : public EpollHandler
+	{
+		ServerWorker& worker;
+
+	public:
+		explicit WakeHandler(ServerWorker& worker);
+		void on_events(uint32_t events) override;
+	};
+
+	ClientRegistry& registry;
+	EpollLoop loop;
+	int listen_socket = -1;
+	int wake_fd = -1;
+	WakeHandler wake_handler{ *this };
+	std::thread thread;
+
+	uint64_t next_connection_id = 1;
+	std::unordered_map<uint64_t, std::unique_ptr<ServerConnection>> connections;
+
+	// Closed while the loop dispatched events - deleted once it returns, as events may still point to them
+	std::vector<std::unique_ptr<ServerConnection>> closed_connections;
+
+	// Connections to wake, queued by any thread
+	std::mutex wake_mutex;
+	std::vector<uint64_t> wakeups;
+
+	// Deadline in milliseconds and connection id, in deadline order
+	std::set<std::pair<uint64_t, uint64_t>> timers;
+
+	std::vector<uint8_t> receive_buffer;
+
+	ServerWorker(const ServerWorker&) = delete;
+	ServerWorker& operator=(const ServerWorker&) = delete;
+
+	// Accept the pending connections
+	void on_events(uint32_t events) override;
+
+	// Serve the connections woken by other threads
+	void handle_wakeups();
+
+	// Time until the next timer is due for epoll_wait, -1 if there is none
+	int get_timeout_ms() const;
+
+	void expire_timers();
+
+	// Event loop of the thread
+	void run();
+
+public:
+	explicit ServerWorker(ClientRegistry& registry);
+	~ServerWorker() override;
+
+	// Bind and listen on the address - done for every worker before any is started
+	bool listen(const std::string& host, uint16_t port);
+
+	// Start the thread and wait for it, the worker runs until the process ends
+	void start();
+	void join();
+
+	// Queue a wakeup of a connection of this worker. Thread safe
+	void wake(uint64_t connection_id);
+
+	// Used by the connections, from the worker thread only
+	ClientRegistry& get_registry();
+	EpollLoop& get_loop();
+	uint8_t* get_receive_buffer();
+	void add_timer(uint64_t deadline_ms, uint64_t connection_id);
+	void cancel_timer(uint64_t deadline_ms, uint64_t connection_id);
+
+	// Forget a connection whose socket was closed
+	void remove_connection(uint64_t connection_id);
+
+	// Steady clock milliseconds
+	static uint64_t now_ms();
+};
@@ -0,0 +1 @@
+g++ -std=c++17 -O2 -pthread ServerMain.cpp ServerWorker.cpp ServerConnection.cpp ClientRegistry.cpp ../EpollLoop.cpp ../TextCodec.cpp ../Util.cpp -o MessageUServer